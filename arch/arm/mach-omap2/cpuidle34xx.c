@@ -24,6 +24,8 @@
 
 #include <linux/sched.h>
 #include <linux/cpuidle.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 
 #include <plat/prcm.h>
 #include <plat/irqs.h>
@@ -61,6 +63,7 @@ static struct cpuidle_params cpuidle_params_table[] = {
 	{10000 + 30000, 300000, 1},
 };
 #define OMAP3_NUM_STATES ARRAY_SIZE(cpuidle_params_table)
+#define OMAP3_STATE_C7 6 /* C7 . MPU OFF + Core OFF */
 
 /* Mach specific information to be recorded in the C-state driver_data */
 struct omap3_idle_statedata {
@@ -71,6 +74,58 @@ struct omap3_idle_statedata {
 struct omap3_idle_statedata omap3_idle_data[OMAP3_NUM_STATES];
 
 struct powerdomain *mpu_pd, *core_pd, *per_pd, *cam_pd;
+static struct powerdomain *dss_pd;
+
+/*
+ * What the CORE RET/OFF requests turned into, split by whether DSS was on.
+ * With the display on, CORE only idles if the DSS FIFOs are large enough
+ * for the display DMA to leave the interconnect alone between refills.
+ */
+struct omap3_core_idle_stats {
+	u32 requested;
+	u32 ret;
+	u32 off;
+	u64 idle_us;	/* in idle with CORE RET or OFF requested */
+	u64 low_us;	/* of which CORE did leave ON */
+};
+static struct omap3_core_idle_stats core_idle_stats[2];
+
+static void omap3_core_idle_account(u32 core_state, bool dss_on, u32 us)
+{
+	struct omap3_core_idle_stats *st = &core_idle_stats[dss_on];
+	int prev;
+
+	if (core_state >= PWRDM_POWER_ON)
+		return;
+
+	prev = pwrdm_read_prev_pwrst(core_pd);
+	st->requested++;
+	st->idle_us += us;
+	if (prev == PWRDM_POWER_ON)
+		return;
+	if (prev == PWRDM_POWER_OFF)
+		st->off++;
+	else
+		st->ret++;
+	st->low_us += us;
+}
+
+int omap3_idle_core_stats_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "dss\trequested\tret\toff\tidle_ms\tcore_low_ms\n");
+	for (i = 0; i < ARRAY_SIZE(core_idle_stats); i++) {
+		struct omap3_core_idle_stats *st = &core_idle_stats[i];
+
+		seq_printf(s, "%s\t%u\t\t%u\t%u\t%llu\t%llu\n",
+			   i ? "on" : "off", st->requested, st->ret, st->off,
+			   div_u64(st->idle_us, USEC_PER_MSEC),
+			   div_u64(st->low_us, USEC_PER_MSEC));
+	}
+
+	return 0;
+}
 
 static int _cpuidle_allow_idle(struct powerdomain *pwrdm,
 				struct clockdomain *clkdm)
@@ -108,6 +163,8 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 	struct omap3_idle_statedata *cx = cpuidle_get_statedata(state);
 	struct timespec ts_preidle, ts_postidle, ts_idle;
 	u32 mpu_state = cx->mpu_state, core_state = cx->core_state;
+	bool slept = false, dss_on = false;
+	u32 idle_us;
 
 	/* Used to keep track of the total time in idle */
 	getnstimeofday(&ts_preidle);
@@ -137,8 +194,12 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 #endif
 /* E], 20120922, mannsik.chung@lge.com, PM from froyo. */
 
+	if (core_state < PWRDM_POWER_ON)
+		dss_on = pwrdm_read_pwrst(dss_pd) == PWRDM_POWER_ON;
+
 	/* Execute ARM wfi */
 	omap_sram_idle(false);
+	slept = true;
 
 /* S[, 20120922, mannsik.chung@lge.com, PM from froyo. */
 #if defined(CONFIG_PRODUCT_LGE_LU6800)
@@ -159,11 +220,15 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 return_sleep_time:
 	getnstimeofday(&ts_postidle);
 	ts_idle = timespec_sub(ts_postidle, ts_preidle);
+	idle_us = ts_idle.tv_nsec / NSEC_PER_USEC + ts_idle.tv_sec * USEC_PER_SEC;
+
+	if (slept)
+		omap3_core_idle_account(core_state, dss_on, idle_us);
 
 	local_irq_enable();
 	local_fiq_enable();
 
-	return ts_idle.tv_nsec / NSEC_PER_USEC + ts_idle.tv_sec * USEC_PER_SEC;
+	return idle_us;
 }
 
 /**
@@ -239,6 +304,41 @@ static struct cpuidle_state *next_valid_state(struct cpuidle_device *dev,
 	return next;
 }
 
+/**
+ * omap3_idle_prepare - Hides the C-states that can't be entered right now
+ * @dev: cpuidle device
+ *
+ * Flags the states next_valid_state() would demote anyway, such as the
+ * OFF states while off mode is disabled, so that the governor picks
+ * among the states that are really entered and its residency history
+ * is not attributed to the wrong state.
+ *
+ * The board latencies of C7 are hardware ones, the measured cost of
+ * saving and restoring the CORE context in software is added on top.
+ */
+static int omap3_idle_prepare(struct cpuidle_device *dev)
+{
+	struct cpuidle_state *c7 = &dev->states[OMAP3_STATE_C7];
+	u32 ctx_us = omap3_pm_core_off_context_us();
+	int i;
+
+	c7->exit_latency =
+		cpuidle_params_table[OMAP3_STATE_C7].exit_latency + ctx_us;
+	c7->target_residency =
+		cpuidle_params_table[OMAP3_STATE_C7].target_residency + ctx_us;
+
+	for (i = 1; i < OMAP3_NUM_STATES; i++) {
+		struct cpuidle_state *state = &dev->states[i];
+
+		if (next_valid_state(dev, state) == state)
+			state->flags &= ~CPUIDLE_FLAG_IGNORE;
+		else
+			state->flags |= CPUIDLE_FLAG_IGNORE;
+	}
+
+	return 0;
+}
+
 /**
  * omap3_enter_idle_bm - Checks for any bus activity
  * @dev: cpuidle device
@@ -365,6 +465,7 @@ int __init omap3_idle_init(void)
 	core_pd = pwrdm_lookup("core_pwrdm");
 	per_pd = pwrdm_lookup("per_pwrdm");
 	cam_pd = pwrdm_lookup("cam_pwrdm");
+	dss_pd = pwrdm_lookup("dss_pwrdm");
 
 	cpuidle_register_driver(&omap3_idle_driver);
 	dev = &per_cpu(omap3_idle_dev, smp_processor_id());
@@ -418,6 +519,7 @@ int __init omap3_idle_init(void)
 	cx->core_state = PWRDM_POWER_OFF;
 
 	dev->state_count = OMAP3_NUM_STATES;
+	dev->prepare = omap3_idle_prepare;
 	if (cpuidle_register_device(dev)) {
 		printk(KERN_ERR "%s: CPUidle register device failed\n",
 		       __func__);
@@ -103,9 +103,13 @@ static struct clk *gpmc_l3_clk;
 
 static irqreturn_t gpmc_handle_irq(int irq, void *dev);
 
+/* a register in gpmc_context was written since the last save */
+static bool gpmc_context_dirty = true;
+
 static void gpmc_write_reg(int idx, u32 val)
 {
 	__raw_writel(val, gpmc_base + idx);
+	gpmc_context_dirty = true;
 }
 
 static u32 gpmc_read_reg(int idx)
@@ -135,6 +139,7 @@ void gpmc_cs_write_reg(int cs, int idx, u32 val)
 
 	reg_addr = gpmc_base + GPMC_CS0_OFFSET + (cs * GPMC_CS_SIZE) + idx;
 	__raw_writel(val, reg_addr);
+	gpmc_context_dirty = true;
 }
 
 u32 gpmc_cs_read_reg(int cs, int idx)
@@ -778,10 +783,20 @@ static irqreturn_t gpmc_handle_irq(int irq, void *dev)
 
 static struct omap_gpmc_regs gpmc_context;
 
-void omap_gpmc_save_context(void)
+/**
+ * omap_gpmc_save_context - save the GPMC registers lost in CORE OFF
+ *
+ * Returns 1 if the registers were read, or 0 if none was written since
+ * the last save and the saved copy is still valid.
+ */
+int omap_gpmc_save_context(void)
 {
 	int i;
 
+	if (!gpmc_context_dirty)
+		return 0;
+	gpmc_context_dirty = false;
+
 	gpmc_context.sysconfig = gpmc_read_reg(GPMC_SYSCONFIG);
 	gpmc_context.irqenable = gpmc_read_reg(GPMC_IRQENABLE);
 	gpmc_context.timeout_ctrl = gpmc_read_reg(GPMC_TIMEOUT_CONTROL);
@@ -808,6 +823,8 @@ void omap_gpmc_save_context(void)
 				gpmc_cs_read_reg(i, GPMC_CS_CONFIG7);
 		}
 	}
+
+	return 1;
 }
 
 void omap_gpmc_restore_context(void)
@@ -839,6 +856,9 @@ void omap_gpmc_restore_context(void)
 				gpmc_context.cs_context[i].config7);
 		}
 	}
+
+	/* the registers now match the saved copy again */
+	gpmc_context_dirty = false;
 }
 
 /**
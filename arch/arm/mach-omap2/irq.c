@@ -184,9 +184,22 @@ void __init omap_init_irq(void)
 #ifdef CONFIG_ARCH_OMAP3
 static struct omap3_intc_regs intc_context[ARRAY_SIZE(irq_banks)];
 
-void omap_intc_save_context(void)
+/*
+ * Nothing but omap_intc_restore_context() writes the ILRs, with the values
+ * read here, so they only need to be read on the first save.
+ */
+static bool intc_ilr_saved;
+
+/**
+ * omap_intc_save_context - save the INTC registers lost in CORE OFF
+ *
+ * Returns 1 if all the registers were read, 0 if the ILRs were skipped.
+ */
+int omap_intc_save_context(void)
 {
 	int ind = 0, i = 0;
+	int full = !intc_ilr_saved;
+
 	for (ind = 0; ind < ARRAY_SIZE(irq_banks); ind++) {
 		struct omap_irq_bank *bank = irq_banks + ind;
 		intc_context[ind].sysconfig =
@@ -197,7 +210,7 @@ void omap_intc_save_context(void)
 			intc_bank_read_reg(bank, INTC_IDLE);
 		intc_context[ind].threshold =
 			intc_bank_read_reg(bank, INTC_THRESHOLD);
-		for (i = 0; i < INTCPS_NR_IRQS; i++)
+		for (i = 0; full && i < INTCPS_NR_IRQS; i++)
 			intc_context[ind].ilr[i] =
 				intc_bank_read_reg(bank, (0x100 + 0x4*i));
 		for (i = 0; i < INTCPS_NR_MIR_REGS; i++)
@@ -205,6 +218,9 @@ void omap_intc_save_context(void)
 				intc_bank_read_reg(&irq_banks[0], INTC_MIR0 +
 				(0x20 * i));
 	}
+	intc_ilr_saved = true;
+
+	return full;
 }
 
 void omap_intc_restore_context(void)
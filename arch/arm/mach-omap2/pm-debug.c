@@ -218,6 +218,8 @@ enum {
 	DEBUG_FILE_TIMERS,
 	DEBUG_FILE_LAST_COUNTERS,
 	DEBUG_FILE_LAST_TIMERS,
+	DEBUG_FILE_CONTEXT_COST,
+	DEBUG_FILE_CORE_IDLE,
 };
 
 struct pm_module_def {
@@ -573,6 +575,14 @@ static int pm_dbg_open(struct inode *inode, struct file *file)
 	case DEBUG_FILE_LAST_COUNTERS:
 		return single_open(file, pm_dbg_show_last_counters,
 			&inode->i_private);
+	case DEBUG_FILE_CONTEXT_COST:
+		return single_open(file, omap3_pm_context_cost_show,
+			&inode->i_private);
+#ifdef CONFIG_CPU_IDLE
+	case DEBUG_FILE_CORE_IDLE:
+		return single_open(file, omap3_idle_core_stats_show,
+			&inode->i_private);
+#endif
 	case DEBUG_FILE_LAST_TIMERS:
 	default:
 		return single_open(file, pm_dbg_show_last_timers,
@@ -810,6 +820,13 @@ static int __init pm_dbg_init(void)
 	if (cpu_is_omap44xx())
 		goto skip_reg_debufs;
 
+	(void) debugfs_create_file("context_cost", S_IRUGO,
+		d, (void *)DEBUG_FILE_CONTEXT_COST, &debug_fops);
+#ifdef CONFIG_CPU_IDLE
+	(void) debugfs_create_file("core_idle", S_IRUGO,
+		d, (void *)DEBUG_FILE_CORE_IDLE, &debug_fops);
+#endif
+
 	pm_dbg_dir = debugfs_create_dir("registers", d);
 	if (IS_ERR(pm_dbg_dir))
 		return PTR_ERR(pm_dbg_dir);
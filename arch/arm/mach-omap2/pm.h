@@ -15,12 +15,17 @@
 
 #include "powerdomain.h"
 
+struct seq_file;
+
 extern void *omap3_secure_ram_storage;
 extern void omap3_pm_off_mode_enable(int);
 extern void omap_sram_idle(bool suspend);
 extern int omap3_can_sleep(void);
 extern int omap_set_pwrdm_state(struct powerdomain *pwrdm, u32 state);
 extern int omap3_idle_init(void);
+extern u32 omap3_pm_core_off_context_us(void);
+extern int omap3_pm_context_cost_show(struct seq_file *s, void *unused);
+extern int omap3_idle_core_stats_show(struct seq_file *s, void *unused);
 extern int omap4_idle_init(void);
 extern void omap4_enter_sleep(unsigned int cpu, unsigned int power_state,
 				bool suspend);
@@ -29,6 +29,8 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/console.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 #include <trace/events/power.h>
 
 // LGE_CHANGE [daewung.kim] power optimization code
@@ -97,6 +99,151 @@ static struct powerdomain *mpu_pwrdm, *neon_pwrdm;
 static struct powerdomain *core_pwrdm, *per_pwrdm;
 static struct powerdomain *cam_pwrdm;
 
+/*
+ * CORE OFF context save/restore cost, measured with the MPU cycle counter
+ * since the 32k sched_clock is far too coarse. The averages are added to
+ * the exit latency of the CORE OFF C-state, and shown in
+ * /sys/kernel/debug/pm_debug/context_cost.
+ */
+enum {
+	CTX_PADCONF,
+	CTX_INTC,
+	CTX_GPMC,
+	CTX_SCM,
+	CTX_DMA,
+	CTX_CM,
+	CTX_SRAM,
+	CTX_SMS,
+	CTX_GPIO,
+	CTX_NR,
+};
+
+struct omap3_ctx_cost {
+	const char	*name;
+	u32		save_ns;	/* running average, 1/8 weight */
+	u32		save_max_ns;
+	u32		restore_ns;
+	u32		restore_max_ns;
+	unsigned long	saves;
+	unsigned long	skipped;	/* saves found clean */
+	unsigned long	restores;
+};
+
+static struct omap3_ctx_cost ctx_cost[CTX_NR] = {
+	[CTX_PADCONF]	= { .name = "padconf" },
+	[CTX_INTC]	= { .name = "intc" },
+	[CTX_GPMC]	= { .name = "gpmc" },
+	[CTX_SCM]	= { .name = "scm" },
+	[CTX_DMA]	= { .name = "dma" },
+	[CTX_CM]	= { .name = "cm" },
+	[CTX_SRAM]	= { .name = "sram" },
+	[CTX_SMS]	= { .name = "sms" },
+	[CTX_GPIO]	= { .name = "gpio" },
+};
+
+static struct clk *ctx_mpu_clk;
+static u32 ctx_mhz;
+
+static inline u32 ctx_cycles(void)
+{
+	u32 ccnt;
+
+	asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (ccnt));
+	return ccnt;
+}
+
+/*
+ * Enables the cycle counter, which is reset by MPU OFF, and picks up the
+ * current MPU rate. Called with interrupts disabled.
+ */
+static void ctx_profile_begin(void)
+{
+#ifndef CONFIG_HW_PERF_EVENTS
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (val));
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (val | 1));
+	asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (1 << 31));
+#endif
+	if (ctx_mpu_clk)
+		ctx_mhz = clk_get_rate(ctx_mpu_clk) / 1000000;
+}
+
+static void ctx_account(u32 *avg, u32 *max, u32 start)
+{
+	u32 ns;
+
+	if (!ctx_mhz)
+		return;
+
+	ns = div_u64((u64)(ctx_cycles() - start) * 1000, ctx_mhz);
+	if (*avg)
+		*avg = *avg - (*avg >> 3) + (ns >> 3);
+	else
+		*avg = ns;
+	if (ns > *max)
+		*max = ns;
+}
+
+static void ctx_saved(int mod, u32 start, int full)
+{
+	struct omap3_ctx_cost *c = &ctx_cost[mod];
+
+	c->saves++;
+	if (!full)
+		c->skipped++;
+	ctx_account(&c->save_ns, &c->save_max_ns, start);
+}
+
+static void ctx_restored(int mod, u32 start)
+{
+	struct omap3_ctx_cost *c = &ctx_cost[mod];
+
+	c->restores++;
+	ctx_account(&c->restore_ns, &c->restore_max_ns, start);
+}
+
+/**
+ * omap3_pm_core_off_context_us - measured software cost of CORE OFF
+ *
+ * Returns the average time spent saving and restoring the CORE context
+ * around a CORE OFF transition, in microseconds. GPIO is left out as it
+ * depends on PER, which may go off without CORE.
+ */
+u32 omap3_pm_core_off_context_us(void)
+{
+	u32 ns = 0;
+	int i;
+
+	for (i = 0; i < CTX_NR; i++) {
+		if (i == CTX_GPIO)
+			continue;
+		ns += ctx_cost[i].save_ns + ctx_cost[i].restore_ns;
+	}
+
+	return DIV_ROUND_UP(ns, 1000);
+}
+
+int omap3_pm_context_cost_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "%-8s %8s %8s %8s %8s %8s %8s %8s\n", "context",
+		   "save_ns", "max_ns", "rest_ns", "max_ns", "saves",
+		   "skipped", "restores");
+	for (i = 0; i < CTX_NR; i++) {
+		struct omap3_ctx_cost *c = &ctx_cost[i];
+
+		seq_printf(s, "%-8s %8u %8u %8u %8u %8lu %8lu %8lu\n",
+			   c->name, c->save_ns, c->save_max_ns,
+			   c->restore_ns, c->restore_max_ns, c->saves,
+			   c->skipped, c->restores);
+	}
+	seq_printf(s, "core off: %u us\n", omap3_pm_core_off_context_us());
+
+	return 0;
+}
+
 static void omap3_enable_io_chain(void)
 {
 	int timeout = 0;
@@ -130,6 +277,10 @@ static void omap3_disable_io_chain(void)
 
 static void omap3_core_save_context(void)
 {
+	u32 start;
+	int full;
+
+	start = ctx_cycles();
 	omap3_ctrl_save_padconf();
 
 	/*
@@ -145,19 +296,29 @@ static void omap3_core_save_context(void)
 	if (omap_rev() <= OMAP3630_REV_ES1_1)
 		omap_ctrl_writew(0x1f, OMAP343X_CONTROL_MEM_WKUP +
 			OMAP3_CONTROL_PADCONF_SDRC_CKE1_OFFSET);
-
+	ctx_saved(CTX_PADCONF, start, 1);
 
 	/* Save the Interrupt controller context */
-	omap_intc_save_context();
+	start = ctx_cycles();
+	full = omap_intc_save_context();
+	ctx_saved(CTX_INTC, start, full);
 	/* Save the GPMC context */
-	omap_gpmc_save_context();
+	start = ctx_cycles();
+	full = omap_gpmc_save_context();
+	ctx_saved(CTX_GPMC, start, full);
 	/* Save the system control module context, padconf already save above*/
+	start = ctx_cycles();
 	omap3_control_save_context();
+	ctx_saved(CTX_SCM, start, 1);
+	start = ctx_cycles();
 	omap_dma_global_context_save();
+	ctx_saved(CTX_DMA, start, 1);
 }
 
 static void omap3_core_restore_context(void)
 {
+	u32 start;
+
 	if (omap_rev() <= OMAP3630_REV_ES1_1) {
 		/*
 		 * errata i583 workaround, safe transition sequence for CKE1:
@@ -170,12 +331,20 @@ static void omap3_core_restore_context(void)
 			OMAP3_CONTROL_PADCONF_SDRC_CKE1_OFFSET);
 	}
 	/* Restore the control module context, padconf restored by h/w */
+	start = ctx_cycles();
 	omap3_control_restore_context();
+	ctx_restored(CTX_SCM, start);
 	/* Restore the GPMC context */
+	start = ctx_cycles();
 	omap_gpmc_restore_context();
+	ctx_restored(CTX_GPMC, start);
 	/* Restore the interrupt controller context */
+	start = ctx_cycles();
 	omap_intc_restore_context();
+	ctx_restored(CTX_INTC, start);
+	start = ctx_cycles();
 	omap_dma_global_context_restore();
+	ctx_restored(CTX_DMA, start);
 }
 
 /*
@@ -423,6 +592,7 @@ void omap_sram_idle(bool suspend)
 	int usb_fclken;
 	int iva2_idlest;
 	int dma_idlest;
+	u32 start;
 
 	if (!_omap_sram_idle)
 		return;
@@ -494,13 +664,18 @@ void omap_sram_idle(bool suspend)
 		}
 	}
 
+	ctx_profile_begin();
+
 	/* PER */
 // LGE_CHANGE_S [daewung.kim@lge.com] 2012-03-16, preventing GPIO interrupt lost when cpu idle
 //	if (per_next_state < PWRDM_POWER_ON) {
 	if (per_next_state < PWRDM_POWER_ON && core_next_state < PWRDM_POWER_ON) {
 // LGE_CHANGE_E [daewung.kim@lge.com] 2012-03-16
 		per_going_off = (per_next_state == PWRDM_POWER_OFF) ? 1 : 0;
+		start = ctx_cycles();
 		omap2_gpio_prepare_for_idle(per_going_off, suspend);
+		if (per_going_off)
+			ctx_saved(CTX_GPIO, start, 1);
 		hgg_padconf_save();	// LGE_CHANGE [daewung.kim] power optimization code
 	}
 
@@ -513,7 +688,10 @@ void omap_sram_idle(bool suspend)
 						   OMAP3_PRM_VOLTCTRL_OFFSET);
 // LGE_CHANGE_E [daewung.kim@lge.com] 2012-04-04
 			omap3_core_save_context();
+			/* the clock framework keeps writing CM, always saved */
+			start = ctx_cycles();
 			omap3_cm_save_context();
+			ctx_saved(CTX_CM, start, 1);
 // LGE_CHANGE_S [daewung.kim@lge.com] 2012-04-04, Enabling voltage off in the off mode
 		} else {
 			omap2_prm_set_mod_reg_bits(OMAP3430_AUTO_RET_MASK,
@@ -543,6 +721,7 @@ void omap_sram_idle(bool suspend)
 	 */
 	_omap_sram_idle(omap3_arm_context, save_state);
 	cpu_init();
+	ctx_profile_begin();
 
 	/* Restore normal SDRC POWER settings */
 	if (omap_rev() >= OMAP3430_REV_ES3_0 &&
@@ -559,9 +738,15 @@ void omap_sram_idle(bool suspend)
 		core_prev_state = pwrdm_read_prev_pwrst(core_pwrdm);
 		if (core_prev_state == PWRDM_POWER_OFF) {
 			omap3_core_restore_context();
+			start = ctx_cycles();
 			omap3_cm_restore_context();
+			ctx_restored(CTX_CM, start);
+			start = ctx_cycles();
 			omap3_sram_restore_context();
+			ctx_restored(CTX_SRAM, start);
+			start = ctx_cycles();
 			omap2_sms_restore_context();
+			ctx_restored(CTX_SMS, start);
 		}
 		if (core_next_state == PWRDM_POWER_OFF)
 			omap2_prm_clear_mod_reg_bits(OMAP3430_AUTO_OFF_MASK,
@@ -590,7 +775,10 @@ void omap_sram_idle(bool suspend)
 // LGE_CHANGE_E [daewung.kim@lge.com] 2012-03-16
 		per_prev_state = pwrdm_read_prev_pwrst(per_pwrdm);
 		hgg_padconf_restore();  // LGE_CHANGE [daewung.kim] power optimization code
+		start = ctx_cycles();
 		omap2_gpio_resume_after_idle(per_going_off);
+		if (per_going_off && per_prev_state == PWRDM_POWER_OFF)
+			ctx_restored(CTX_GPIO, start);
 	}
 
 
@@ -1047,6 +1235,10 @@ static int __init omap3_pm_init(void)
 
 	pm_errata_configure();
 
+	ctx_mpu_clk = clk_get(NULL, "dpll1_ck");
+	if (IS_ERR(ctx_mpu_clk))
+		ctx_mpu_clk = NULL;
+
 	/* XXX prcm_setup_regs needs to be before enabling hw
 	 * supervised mode for powerdomains */
 	prcm_setup_regs();
@@ -26,6 +26,8 @@
 #include <linux/compiler.h>
 #include <linux/blktrace_api.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 /*
  * enum row_queue_prio - Priorities of the ROW queues
@@ -85,6 +87,26 @@ static const struct row_queue_params row_queues_def[] = {
 #define ROW_IDLE_TIME_MSEC 5	/* msec */
 #define ROW_READ_FREQ_MSEC 20	/* msec */
 
+/* Default values for the adaptive quantum/idling logic */
+#define ROW_READ_LAT_TARGET_USEC	10000	/* usec */
+#define ROW_ADAPT_WINDOW		32	/* completed reads per step */
+#define ROW_MAX_WRITE_SCALE		16
+#define ROW_MAX_IDLE_FREQ_MSEC		100	/* msec */
+
+/* Dispatch latency histogram: bucket i holds [2^(i-1), 2^i) usec */
+#define ROW_LAT_BUCKETS			24
+
+/**
+ * struct row_lat_hist - dispatch latency histogram of a queue
+ * @bucket:	number of requests per log2(usec) bucket
+ * @count:	total number of requests accounted
+ *
+ */
+struct row_lat_hist {
+	unsigned long	bucket[ROW_LAT_BUCKETS];
+	unsigned long	count;
+};
+
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
  * @last_insert_time:	time the last request was inserted
@@ -109,6 +131,7 @@ struct rowq_idling_data {
  * @dispatch quantum:	number of requests this queue may
  *			dispatch in a dispatch cycle
  * @idle_data:		data for idling on queues
+ * @disp_lat:		insert to dispatch latency histogram
  *
  */
 struct row_queue {
@@ -124,6 +147,8 @@ struct row_queue {
 
 	/* used only for READ queues */
 	struct rowq_idling_data	idle_data;
+
+	struct row_lat_hist	disp_lat;
 };
 
 /**
@@ -142,6 +167,38 @@ struct idling_data {
 	struct delayed_work		idle_work;
 };
 
+/**
+ * struct row_adapt_data - state of the adaptive quantum/idling logic
+ * @enabled:		apply the adapted values to dispatching
+ * @read_lat_target:	target for READ insert to completion latency (usec)
+ * @svc_us:		running average of the device service time
+ *			(dispatch to completion), per direction (usec)
+ * @read_lat_us:	running average of READ insert to completion
+ *			latency (usec)
+ * @write_scale:	multiplier applied to the WRITE queues quantum
+ * @nr_reads:		READs completed in the current adaptation window
+ * @nr_steps:		number of adaptation steps taken
+ *
+ * Every ROW_ADAPT_WINDOW completed READs the WRITE quantum multiplier is
+ * adjusted: halved if READ latency is above target, otherwise grown by
+ * one up to the number of WRITEs that fit into the latency budget left
+ * after a READ is served. While adaptive, READ idling is only triggered
+ * for READs arriving closer than one WRITE service time, since waiting
+ * longer than that costs more than letting a WRITE through.
+ *
+ */
+struct row_adapt_data {
+	int			enabled;
+	int			read_lat_target;
+
+	long			svc_us[2];
+	long			read_lat_us;
+
+	unsigned int		write_scale;
+	unsigned int		nr_reads;
+	unsigned long		nr_steps;
+};
+
 /**
  * struct row_queue - Per block device rqueue structure
  * @dispatch_queue:	dispatch rqueue
@@ -153,6 +210,7 @@ struct idling_data {
  *			scheduler, nr_reqs[1] holds the number of all WRITE
  *			requests in scheduler
  * @cycle_flags:	used for marking unserved queueus
+ * @adapt:		adaptive quantum/idling state
  *
  */
 struct row_data {
@@ -166,9 +224,18 @@ struct row_data {
 	unsigned int			nr_reqs[2];
 
 	unsigned int			cycle_flags;
+
+	struct row_adapt_data		adapt;
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
+/* Insert and dispatch timestamps, in usec truncated to 32 bit */
+#define RQ_INSERT_TIME(rq) ((u32)(unsigned long)((rq)->elevator_private[1]))
+#define RQ_DISP_TIME(rq) ((u32)(unsigned long)((rq)->elevator_private[2]))
+#define RQ_SET_INSERT_TIME(rq, t) \
+	((rq)->elevator_private[1] = (void *)(unsigned long)(t))
+#define RQ_SET_DISP_TIME(rq, t) \
+	((rq)->elevator_private[2] = (void *)(unsigned long)(t))
 
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
@@ -206,6 +273,132 @@ static inline void __maybe_unused row_dump_queues_stat(struct row_data *rd)
 			rd->row_queues[i].nr_req);
 }
 
+static inline u32 row_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+static inline bool row_rowq_is_write(enum row_queue_prio qnum)
+{
+	return qnum == ROWQ_PRIO_HIGH_SWRITE ||
+	       qnum == ROWQ_PRIO_REG_SWRITE ||
+	       qnum == ROWQ_PRIO_REG_WRITE ||
+	       qnum == ROWQ_PRIO_LOW_SWRITE;
+}
+
+/* Effective dispatch quantum of a queue */
+static inline int row_rowq_quantum(struct row_data *rd,
+				   enum row_queue_prio qnum)
+{
+	int quantum = rd->row_queues[qnum].disp_quantum;
+
+	if (rd->adapt.enabled && row_rowq_is_write(qnum))
+		quantum *= rd->adapt.write_scale;
+
+	return quantum;
+}
+
+/* Max time (msec) between two READ inserts that triggers idling */
+static inline u32 row_idle_freq(struct row_data *rd)
+{
+	long svc_write = rd->adapt.svc_us[WRITE];
+
+	if (!rd->adapt.enabled || !svc_write)
+		return rd->read_idle.freq;
+
+	return clamp_t(u32, DIV_ROUND_UP(svc_write, USEC_PER_MSEC),
+		       1, ROW_MAX_IDLE_FREQ_MSEC);
+}
+
+/* Idling duration (jiffies) */
+static inline unsigned long row_idle_time(struct row_data *rd)
+{
+	long svc_write = rd->adapt.svc_us[WRITE];
+
+	if (!rd->adapt.enabled || !svc_write)
+		return rd->read_idle.idle_time;
+
+	return clamp_t(unsigned long, usecs_to_jiffies(svc_write),
+		       1, rd->read_idle.idle_time);
+}
+
+static void row_lat_hist_add(struct row_lat_hist *hist, u32 usec)
+{
+	int i = min(fls(usec), ROW_LAT_BUCKETS - 1);
+
+	hist->bucket[i]++;
+	hist->count++;
+}
+
+/*
+ * row_lat_percentile() - Estimate a percentile from a latency histogram
+ * @hist:	the histogram
+ * @pct:	percentile (1..100)
+ *
+ * The value is interpolated linearly inside the log2 bucket holding
+ * the requested rank. Returns usec.
+ */
+static unsigned long row_lat_percentile(const struct row_lat_hist *hist,
+					unsigned int pct)
+{
+	unsigned long rank, seen = 0, lo, hi;
+	int i;
+
+	if (!hist->count)
+		return 0;
+
+	rank = div_u64((u64)hist->count * pct + 99, 100);
+	for (i = 0; i < ROW_LAT_BUCKETS; i++) {
+		if (seen + hist->bucket[i] >= rank) {
+			lo = i ? 1UL << (i - 1) : 0;
+			hi = 1UL << i;
+			return lo + div_u64((u64)(hi - lo) * (rank - seen),
+					    hist->bucket[i]);
+		}
+		seen += hist->bucket[i];
+	}
+
+	return 1UL << (ROW_LAT_BUCKETS - 1);
+}
+
+/* Running average with a weight of 1/8 for the new sample */
+static inline void row_ewma(long *avg, long sample)
+{
+	if (!*avg)
+		*avg = sample;
+	else
+		*avg += (sample - *avg) / 8;
+}
+
+/*
+ * row_adapt() - Take one adaptation step
+ * @rd:	pointer to struct row_data
+ *
+ * See struct row_adapt_data for the policy.
+ */
+static void row_adapt(struct row_data *rd)
+{
+	struct row_adapt_data *ad = &rd->adapt;
+	long budget = ad->read_lat_target - ad->svc_us[READ];
+	unsigned int cap = 1;
+
+	if (budget > 0 && ad->svc_us[WRITE])
+		cap = clamp_t(long, budget / ad->svc_us[WRITE],
+			      1, ROW_MAX_WRITE_SCALE);
+
+	if (ad->read_lat_us > ad->read_lat_target)
+		ad->write_scale = max(ad->write_scale / 2, 1U);
+	else if (ad->write_scale < cap)
+		ad->write_scale++;
+	ad->write_scale = min(ad->write_scale, cap);
+	ad->nr_steps++;
+
+	row_log(rd->dispatch_queue,
+		"adapt: svc r/w=%ld/%ldus read_lat=%ldus write_scale=%u",
+		ad->svc_us[READ], ad->svc_us[WRITE], ad->read_lat_us,
+		ad->write_scale);
+}
+
 /******************** Static helper functions ***********************/
 /*
  * kick_queue() - Wake up device driver queue thread
@@ -281,6 +474,7 @@ static void row_add_request(struct request_queue *q,
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	RQ_SET_INSERT_TIME(rq, row_now_us());
 
 	if (row_queues_def[rqueue->prio].idling_enabled) {
 		if (delayed_work_pending(&rd->read_idle.idle_work))
@@ -288,7 +482,7 @@ static void row_add_request(struct request_queue *q,
 				&rd->read_idle.idle_work);
 		if (ktime_to_ms(ktime_sub(ktime_get(),
 				rqueue->idle_data.last_insert_time)) <
-				rd->read_idle.freq) {
+				row_idle_freq(rd)) {
 			rqueue->idle_data.begin_idling = true;
 			row_log_rowq(rd, rqueue->prio, "Enable idling");
 		} else {
@@ -393,9 +587,13 @@ static void row_remove_request(struct request_queue *q,
 static void row_dispatch_insert(struct row_data *rd)
 {
 	struct request *rq;
+	u32 now = row_now_us();
 
 	rq = rq_entry_fifo(rd->row_queues[rd->curr_queue].fifo.next);
 	row_remove_request(rd->dispatch_queue, rq);
+	row_lat_hist_add(&rd->row_queues[rd->curr_queue].disp_lat,
+			 now - RQ_INSERT_TIME(rq));
+	RQ_SET_DISP_TIME(rq, now);
 	elv_dispatch_add_tail(rd->dispatch_queue, rq);
 	rd->row_queues[rd->curr_queue].nr_dispatched++;
 	row_clear_rowq_unserved(rd, rd->curr_queue);
@@ -470,7 +668,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 	}
 
 	if (rd->row_queues[currq].nr_dispatched >=
-	    rd->row_queues[currq].disp_quantum) {
+	    row_rowq_quantum(rd, currq)) {
 		rd->row_queues[currq].nr_dispatched = 0;
 		row_log_rowq(rd, currq, "Expiring rqueue");
 		ret = row_choose_queue(rd);
@@ -499,7 +697,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 		    rd->row_queues[currq].idle_data.begin_idling) {
 			if (!queue_delayed_work(rd->read_idle.idle_workqueue,
 						&rd->read_idle.idle_work,
-						rd->read_idle.idle_time)) {
+						row_idle_time(rd))) {
 				row_log_rowq(rd, currq,
 					     "Work already on queue!");
 				pr_err("ROW_BUG: Work already on queue!");
@@ -573,6 +771,10 @@ static void *row_init_queue(struct request_queue *q)
 
 	rdata->nr_reqs[READ] = rdata->nr_reqs[WRITE] = 0;
 
+	rdata->adapt.enabled = 1;
+	rdata->adapt.read_lat_target = ROW_READ_LAT_TARGET_USEC;
+	rdata->adapt.write_scale = 1;
+
 	return rdata;
 }
 
@@ -611,6 +813,36 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 	rqueue->rdata->nr_reqs[rq_data_dir(rq)]--;
 }
 
+/*
+ * row_completed_request() - Called when a request was completed
+ * @q:		requests queue
+ * @rq:		completed request
+ *
+ * Feeds the service time and READ latency averages and drives the
+ * adaptation steps.
+ */
+static void row_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_adapt_data *ad = &rd->adapt;
+	const int data_dir = rq_data_dir(rq);
+	u32 now = row_now_us();
+
+	/* Discards say nothing about READ/WRITE cost */
+	if (rq->cmd_flags & REQ_DISCARD)
+		return;
+
+	row_ewma(&ad->svc_us[data_dir], now - RQ_DISP_TIME(rq));
+	if (data_dir != READ)
+		return;
+
+	row_ewma(&ad->read_lat_us, now - RQ_INSERT_TIME(rq));
+	if (++ad->nr_reads >= ROW_ADAPT_WINDOW) {
+		ad->nr_reads = 0;
+		row_adapt(rd);
+	}
+}
+
 /*
  * get_queue_type() - Get queue type for a given request
  *
@@ -694,6 +926,8 @@ SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 0);
 SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
+SHOW_FUNCTION(row_adaptive_show, rowd->adapt.enabled, 0);
+SHOW_FUNCTION(row_read_lat_target_show, rowd->adapt.read_lat_target, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -734,12 +968,105 @@ STORE_FUNCTION(row_lp_swrite_quantum_store,
 			1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 0);
 STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
+STORE_FUNCTION(row_adaptive_store, &rowd->adapt.enabled, 0, 1, 0);
+STORE_FUNCTION(row_read_lat_target_store, &rowd->adapt.read_lat_target,
+			1, INT_MAX, 0);
 
 #undef STORE_FUNCTION
 
+static const char * const row_queue_names[ROWQ_MAX_PRIO] = {
+	"hp_read", "rp_read", "hp_swrite", "rp_swrite",
+	"rp_write", "lp_read", "lp_swrite",
+};
+
+static ssize_t row_adaptive_state_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+	struct row_adapt_data ad;
+	int quantum[ROWQ_MAX_PRIO];
+	u32 idle_freq;
+	unsigned long idle_time;
+	ssize_t len;
+	int i;
+
+	spin_lock_irq(rowd->dispatch_queue->queue_lock);
+	ad = rowd->adapt;
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		quantum[i] = row_rowq_quantum(rowd, i);
+	idle_freq = row_idle_freq(rowd);
+	idle_time = row_idle_time(rowd);
+	spin_unlock_irq(rowd->dispatch_queue->queue_lock);
+
+	len = scnprintf(page, PAGE_SIZE,
+			"enabled: %d\n"
+			"read_lat_target: %d us\n"
+			"read_service: %ld us\n"
+			"write_service: %ld us\n"
+			"read_latency: %ld us\n"
+			"write_scale: %u\n"
+			"idle_freq: %u ms\n"
+			"idle_time: %u ms\n"
+			"steps: %lu\n",
+			ad.enabled, ad.read_lat_target, ad.svc_us[READ],
+			ad.svc_us[WRITE], ad.read_lat_us, ad.write_scale,
+			idle_freq, jiffies_to_msecs(idle_time), ad.nr_steps);
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		len += scnprintf(page + len, PAGE_SIZE - len,
+				 "%s_quantum: %d\n", row_queue_names[i],
+				 quantum[i]);
+
+	return len;
+}
+
+static ssize_t row_dispatch_latency_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+	unsigned long count[ROWQ_MAX_PRIO], p50[ROWQ_MAX_PRIO];
+	unsigned long p99[ROWQ_MAX_PRIO];
+	ssize_t len;
+	int i;
+
+	spin_lock_irq(rowd->dispatch_queue->queue_lock);
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		struct row_lat_hist *hist = &rowd->row_queues[i].disp_lat;
+
+		count[i] = hist->count;
+		p50[i] = row_lat_percentile(hist, 50);
+		p99[i] = row_lat_percentile(hist, 99);
+	}
+	spin_unlock_irq(rowd->dispatch_queue->queue_lock);
+
+	len = scnprintf(page, PAGE_SIZE, "%-10s %10s %10s %10s\n",
+			"queue", "count", "p50_us", "p99_us");
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		len += scnprintf(page + len, PAGE_SIZE - len,
+				 "%-10s %10lu %10lu %10lu\n",
+				 row_queue_names[i], count[i], p50[i], p99[i]);
+
+	return len;
+}
+
+/* Any write resets the histograms */
+static ssize_t row_dispatch_latency_store(struct elevator_queue *e,
+		const char *page, size_t count)
+{
+	struct row_data *rowd = e->elevator_data;
+	int i;
+
+	spin_lock_irq(rowd->dispatch_queue->queue_lock);
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		memset(&rowd->row_queues[i].disp_lat, 0,
+		       sizeof(rowd->row_queues[i].disp_lat));
+	spin_unlock_irq(rowd->dispatch_queue->queue_lock);
+
+	return count;
+}
+
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
+#define ROW_ATTR_RO(name) \
+	__ATTR(name, S_IRUGO, row_##name##_show, NULL)
 
 static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(hp_read_quantum),
@@ -751,12 +1078,17 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(lp_swrite_quantum),
 	ROW_ATTR(read_idle),
 	ROW_ATTR(read_idle_freq),
+	ROW_ATTR(adaptive),
+	ROW_ATTR(read_lat_target),
+	ROW_ATTR_RO(adaptive_state),
+	ROW_ATTR(dispatch_latency),
 	__ATTR_NULL
 };
 
 static struct elevator_type iosched_row = {
 	.ops = {
 		.elevator_merge_req_fn		= row_merged_requests,
+		.elevator_completed_req_fn	= row_completed_request,
 		.elevator_dispatch_fn		= row_dispatch_requests,
 		.elevator_add_req_fn		= row_add_request,
 		.elevator_reinsert_req_fn	= row_reinsert_req,
@@ -12,15 +12,24 @@
  * Asynchronous and synchronous requests are not treated separately, but
  * we relay on deadlines to ensure fairness.
  *
+ * Requests are also split by the io priority class of the submitter
+ * (RT, BE and IDLE). Each class gets a weighted share of the dispatches
+ * in every round, so background writers running in the idle class can
+ * no longer starve foreground reads. The only exception to the no sorting
+ * rule are asynchronous writes, which are dispatched in sector ordered
+ * batches starting at the oldest one.
+ *
  */
 #include <linux/blkdev.h>
 #include <linux/elevator.h>
 #include <linux/bio.h>
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/ioprio.h>
 #include <linux/version.h>
 
 enum { ASYNC, SYNC };
+enum { SIO_RT, SIO_BE, SIO_IDLE, SIO_NR_CLASSES };
 
 /* Tunables */
 static const int sync_read_expire  = HZ / 2;	/* max time before a sync read is submitted. */
@@ -32,22 +41,106 @@ static const int async_write_expire = 16 * HZ;	/* ditto for async, these limits
 static const int writes_starved = 2;		/* max times reads can starve a write */
 static const int fifo_batch     = 1;		/* # of sequential requests treated as one
 						   by the above parameters. For throughput. */
+static const int async_write_batch = 8;		/* max async writes dispatched in sector order */
+
+static const int rt_weight   = 8;		/* dispatches per round for each io class */
+static const int be_weight   = 4;
+static const int idle_weight = 1;
 
 /* Elevator data */
 struct sio_data {
 	/* Request queues */
-	struct list_head fifo_list[2][2];
+	struct list_head fifo_list[SIO_NR_CLASSES][2][2];
+	struct rb_root sort_list[SIO_NR_CLASSES];	/* async writes by sector */
+	struct request *next_write[SIO_NR_CLASSES];
 
 	/* Attributes */
 	unsigned int batched;
 	unsigned int starved;
+	unsigned int write_batched[SIO_NR_CLASSES];
+	int credit[SIO_NR_CLASSES];
 
 	/* Settings */
 	int fifo_expire[2][2];
 	int fifo_batch;
 	int writes_starved;
+	int async_write_batch;
+	int class_weight[SIO_NR_CLASSES];
 };
 
+static inline int
+sio_class(unsigned long ioprio_class)
+{
+	switch (ioprio_class) {
+	case IOPRIO_CLASS_RT:
+		return SIO_RT;
+	case IOPRIO_CLASS_IDLE:
+		return SIO_IDLE;
+	default:
+		return SIO_BE;
+	}
+}
+
+static inline int
+sio_rq_class(struct request *rq)
+{
+	/* Requests allocated without elevator data fall into BE */
+	return sio_class((unsigned long) rq->elevator_private[0]);
+}
+
+static unsigned long
+sio_current_ioprio_class(void)
+{
+	struct io_context *ioc = current->io_context;
+
+	/*
+	 * Requests inherit the class set by ioprio_set(), or the one
+	 * implied by the scheduling policy of the submitter.
+	 */
+	if (ioc && ioprio_valid(ioc->ioprio))
+		return IOPRIO_PRIO_CLASS(ioc->ioprio);
+
+	return task_nice_ioclass(current);
+}
+
+static inline int
+sio_rq_sorted(struct request *rq)
+{
+	return !rq_is_sync(rq) && rq_data_dir(rq) == WRITE;
+}
+
+static void
+sio_del_rq_rb(struct sio_data *sd, struct request *rq)
+{
+	const int class = sio_rq_class(rq);
+
+	/* Keep the current write batch going past a removed request */
+	if (sd->next_write[class] == rq)
+		sd->next_write[class] = elv_rb_latter_request(rq->q, rq);
+
+	elv_rb_del(&sd->sort_list[class], rq);
+}
+
+static int
+sio_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	rq->elevator_private[0] = (void *) sio_current_ioprio_class();
+
+	return 0;
+}
+
+static int
+sio_allow_merge(struct request_queue *q, struct request *rq, struct bio *bio)
+{
+	const int sync = bio_data_dir(bio) == READ || (bio->bi_rw & REQ_SYNC);
+
+	/* Keep bios in requests of their own io class and sync type */
+	if (sync != rq_is_sync(rq))
+		return 0;
+
+	return sio_class(sio_current_ioprio_class()) == sio_rq_class(rq);
+}
+
 static void
 sio_merged_requests(struct request_queue *q, struct request *rq,
 		    struct request *next)
@@ -55,8 +148,12 @@ sio_merged_requests(struct request_queue *q, struct request *rq,
 	/*
 	 * If next expires before rq, assign its expire time to rq
 	 * and move into next position (next will be deleted) in fifo.
+	 * Request merges are not filtered by sio_allow_merge(), so
+	 * only do so when both sit on the same fifo list.
 	 */
-	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist)) {
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    sio_rq_class(rq) == sio_rq_class(next) &&
+	    rq_is_sync(rq) == rq_is_sync(next)) {
 		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
 			list_move(&rq->queuelist, &next->queuelist);
 			rq_set_fifo_time(rq, rq_fifo_time(next));
@@ -65,12 +162,29 @@ sio_merged_requests(struct request_queue *q, struct request *rq,
 
 	/* Delete next request */
 	rq_fifo_clear(next);
+	if (sio_rq_sorted(next))
+		sio_del_rq_rb(q->elevator->elevator_data, next);
+}
+
+static void
+sio_merged_request(struct request_queue *q, struct request *rq, int type)
+{
+	struct sio_data *sd = q->elevator->elevator_data;
+
+	/* A front merge moves the request start, so resort it */
+	if (type == ELEVATOR_FRONT_MERGE && sio_rq_sorted(rq)) {
+		struct rb_root *root = &sd->sort_list[sio_rq_class(rq)];
+
+		elv_rb_del(root, rq);
+		elv_rb_add(root, rq);
+	}
 }
 
 static void
 sio_add_request(struct request_queue *q, struct request *rq)
 {
 	struct sio_data *sd = q->elevator->elevator_data;
+	const int class = sio_rq_class(rq);
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
 
@@ -79,7 +193,19 @@ sio_add_request(struct request_queue *q, struct request *rq)
 	 * expire time.
 	 */
 	rq_set_fifo_time(rq, jiffies + sd->fifo_expire[sync][data_dir]);
-	list_add_tail(&rq->queuelist, &sd->fifo_list[sync][data_dir]);
+	list_add_tail(&rq->queuelist, &sd->fifo_list[class][sync][data_dir]);
+
+	if (sio_rq_sorted(rq))
+		elv_rb_add(&sd->sort_list[class], rq);
+}
+
+static int
+sio_class_empty(struct sio_data *sd, int class)
+{
+	return list_empty(&sd->fifo_list[class][SYNC][READ]) &&
+	       list_empty(&sd->fifo_list[class][SYNC][WRITE]) &&
+	       list_empty(&sd->fifo_list[class][ASYNC][READ]) &&
+	       list_empty(&sd->fifo_list[class][ASYNC][WRITE]);
 }
 
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
@@ -87,17 +213,21 @@ static int
 sio_queue_empty(struct request_queue *q)
 {
 	struct sio_data *sd = q->elevator->elevator_data;
+	int class;
 
 	/* Check if fifo lists are empty */
-	return list_empty(&sd->fifo_list[SYNC][READ]) && list_empty(&sd->fifo_list[SYNC][WRITE])
-	       list_empty(&sd->fifo_list[ASYNC][READ]) && list_empty(&sd->fifo_list[ASYNC][WRITE]);
+	for (class = 0; class < SIO_NR_CLASSES; class++)
+		if (!sio_class_empty(sd, class))
+			return 0;
+
+	return 1;
 }
 #endif
 
 static struct request *
-sio_expired_request(struct sio_data *sd, int sync, int data_dir)
+sio_expired_request(struct sio_data *sd, int class, int sync, int data_dir)
 {
-	struct list_head *list = &sd->fifo_list[sync][data_dir];
+	struct list_head *list = &sd->fifo_list[class][sync][data_dir];
 	struct request *rq;
 
 	if (list_empty(list))
@@ -117,49 +247,108 @@ static struct request *
 sio_choose_expired_request(struct sio_data *sd)
 {
 	struct request *rq;
+	int class;
 
 	/*
-	 * Check expired requests.
+	 * Check expired requests, higher io classes first.
 	 * Asynchronous requests have priority over synchronous.
 	 * Write requests have priority over read.
 	 */
-	rq = sio_expired_request(sd, ASYNC, WRITE);
-	if (rq)
-		return rq;
-	rq = sio_expired_request(sd, ASYNC, READ);
-	if (rq)
-		return rq;
-
-	rq = sio_expired_request(sd, SYNC, WRITE);
-	if (rq)
-		return rq;
-	rq = sio_expired_request(sd, SYNC, READ);
-	if (rq)
-		return rq;
+	for (class = 0; class < SIO_NR_CLASSES; class++) {
+		rq = sio_expired_request(sd, class, ASYNC, WRITE);
+		if (rq)
+			return rq;
+		rq = sio_expired_request(sd, class, ASYNC, READ);
+		if (rq)
+			return rq;
+
+		rq = sio_expired_request(sd, class, SYNC, WRITE);
+		if (rq)
+			return rq;
+		rq = sio_expired_request(sd, class, SYNC, READ);
+		if (rq)
+			return rq;
+	}
 
 	return NULL;
 }
 
+static int
+sio_choose_class(struct sio_data *sd)
+{
+	int class, pending = -1;
+
+	/*
+	 * Serve the highest class that still has credit left in
+	 * this round. Once every backlogged class has used its
+	 * share, start a new round.
+	 */
+	for (class = 0; class < SIO_NR_CLASSES; class++) {
+		if (sio_class_empty(sd, class))
+			continue;
+		if (sd->credit[class] > 0)
+			return class;
+		if (pending < 0)
+			pending = class;
+	}
+
+	if (pending >= 0)
+		for (class = 0; class < SIO_NR_CLASSES; class++)
+			sd->credit[class] = sd->class_weight[class];
+
+	return pending;
+}
+
 static struct request *
-sio_choose_request(struct sio_data *sd, int data_dir)
+sio_fifo_request(struct sio_data *sd, int class, int sync, int data_dir)
 {
-	struct list_head *sync = sd->fifo_list[SYNC];
-	struct list_head *async = sd->fifo_list[ASYNC];
+	struct list_head *list = &sd->fifo_list[class][sync][data_dir];
+
+	if (list_empty(list)) {
+		/* The next asynchronous write starts a new batch */
+		if (sync == ASYNC && data_dir == WRITE)
+			sd->write_batched[class] = 0;
+		return NULL;
+	}
+
+	/*
+	 * Asynchronous writes continue the current batch in sector
+	 * order, or start a new one at the oldest request.
+	 */
+	if (sync == ASYNC && data_dir == WRITE) {
+		if (sd->next_write[class] &&
+		    sd->write_batched[class] < sd->async_write_batch)
+			return sd->next_write[class];
+
+		sd->write_batched[class] = 0;
+	}
+
+	return rq_entry_fifo(list->next);
+}
+
+static struct request *
+sio_choose_request(struct sio_data *sd, int class, int data_dir)
+{
+	struct request *rq;
 
 	/*
 	 * Retrieve request from available fifo list.
 	 * Synchronous requests have priority over asynchronous.
 	 * Read requests have priority over write.
 	 */
-	if (!list_empty(&sync[data_dir]))
-		return rq_entry_fifo(sync[data_dir].next);
-	if (!list_empty(&async[data_dir]))
-		return rq_entry_fifo(async[data_dir].next);
+	rq = sio_fifo_request(sd, class, SYNC, data_dir);
+	if (rq)
+		return rq;
+	rq = sio_fifo_request(sd, class, ASYNC, data_dir);
+	if (rq)
+		return rq;
 
-	if (!list_empty(&sync[!data_dir]))
-		return rq_entry_fifo(sync[!data_dir].next);
-	if (!list_empty(&async[!data_dir]))
-		return rq_entry_fifo(async[!data_dir].next);
+	rq = sio_fifo_request(sd, class, SYNC, !data_dir);
+	if (rq)
+		return rq;
+	rq = sio_fifo_request(sd, class, ASYNC, !data_dir);
+	if (rq)
+		return rq;
 
 	return NULL;
 }
@@ -167,14 +356,24 @@ sio_choose_request(struct sio_data *sd, int data_dir)
 static inline void
 sio_dispatch_request(struct sio_data *sd, struct request *rq)
 {
+	const int class = sio_rq_class(rq);
+
 	/*
 	 * Remove the request from the fifo list
 	 * and dispatch it.
 	 */
 	rq_fifo_clear(rq);
+	if (sio_rq_sorted(rq)) {
+		struct request *next = elv_rb_latter_request(rq->q, rq);
+
+		elv_rb_del(&sd->sort_list[class], rq);
+		sd->next_write[class] = next;
+		sd->write_batched[class]++;
+	}
 	elv_dispatch_add_tail(rq->q, rq);
 
 	sd->batched++;
+	sd->credit[class]--;
 
 	if (rq_data_dir(rq))
 		sd->starved = 0;
@@ -188,6 +387,7 @@ sio_dispatch_requests(struct request_queue *q, int force)
 	struct sio_data *sd = q->elevator->elevator_data;
 	struct request *rq = NULL;
 	int data_dir = READ;
+	int class;
 
 	/*
 	 * Retrieve any expired request after a batch of
@@ -200,10 +400,14 @@ sio_dispatch_requests(struct request_queue *q, int force)
 
 	/* Retrieve request */
 	if (!rq) {
+		class = sio_choose_class(sd);
+		if (class < 0)
+			return 0;
+
 		if (sd->starved > sd->writes_starved)
 			data_dir = WRITE;
 
-		rq = sio_choose_request(sd, data_dir);
+		rq = sio_choose_request(sd, class, data_dir);
 		if (!rq)
 			return 0;
 	}
@@ -218,10 +422,11 @@ static struct request *
 sio_former_request(struct request_queue *q, struct request *rq)
 {
 	struct sio_data *sd = q->elevator->elevator_data;
+	const int class = sio_rq_class(rq);
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
 
-	if (rq->queuelist.prev == &sd->fifo_list[sync][data_dir])
+	if (rq->queuelist.prev == &sd->fifo_list[class][sync][data_dir])
 		return NULL;
 
 	/* Return former request */
@@ -232,10 +437,11 @@ static struct request *
 sio_latter_request(struct request_queue *q, struct request *rq)
 {
 	struct sio_data *sd = q->elevator->elevator_data;
+	const int class = sio_rq_class(rq);
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
 
-	if (rq->queuelist.next == &sd->fifo_list[sync][data_dir])
+	if (rq->queuelist.next == &sd->fifo_list[class][sync][data_dir])
 		return NULL;
 
 	/* Return latter request */
@@ -246,6 +452,7 @@ static void *
 sio_init_queue(struct request_queue *q)
 {
 	struct sio_data *sd;
+	int class;
 
 	/* Allocate structure */
 	sd = kmalloc_node(sizeof(*sd), GFP_KERNEL, q->node);
@@ -253,18 +460,31 @@ sio_init_queue(struct request_queue *q)
 		return NULL;
 
 	/* Initialize fifo lists */
-	INIT_LIST_HEAD(&sd->fifo_list[SYNC][READ]);
-	INIT_LIST_HEAD(&sd->fifo_list[SYNC][WRITE]);
-	INIT_LIST_HEAD(&sd->fifo_list[ASYNC][READ]);
-	INIT_LIST_HEAD(&sd->fifo_list[ASYNC][WRITE]);
+	for (class = 0; class < SIO_NR_CLASSES; class++) {
+		INIT_LIST_HEAD(&sd->fifo_list[class][SYNC][READ]);
+		INIT_LIST_HEAD(&sd->fifo_list[class][SYNC][WRITE]);
+		INIT_LIST_HEAD(&sd->fifo_list[class][ASYNC][READ]);
+		INIT_LIST_HEAD(&sd->fifo_list[class][ASYNC][WRITE]);
+		sd->sort_list[class] = RB_ROOT;
+		sd->next_write[class] = NULL;
+		sd->write_batched[class] = 0;
+	}
 
 	/* Initialize data */
 	sd->batched = 0;
+	sd->starved = 0;
 	sd->fifo_expire[SYNC][READ] = sync_read_expire;
 	sd->fifo_expire[SYNC][WRITE] = sync_write_expire;
 	sd->fifo_expire[ASYNC][READ] = async_read_expire;
 	sd->fifo_expire[ASYNC][WRITE] = async_write_expire;
 	sd->fifo_batch = fifo_batch;
+	sd->writes_starved = writes_starved;
+	sd->async_write_batch = async_write_batch;
+	sd->class_weight[SIO_RT] = rt_weight;
+	sd->class_weight[SIO_BE] = be_weight;
+	sd->class_weight[SIO_IDLE] = idle_weight;
+	for (class = 0; class < SIO_NR_CLASSES; class++)
+		sd->credit[class] = sd->class_weight[class];
 
 	return sd;
 }
@@ -273,11 +493,14 @@ static void
 sio_exit_queue(struct elevator_queue *e)
 {
 	struct sio_data *sd = e->elevator_data;
+	int class;
 
-	BUG_ON(!list_empty(&sd->fifo_list[SYNC][READ]));
-	BUG_ON(!list_empty(&sd->fifo_list[SYNC][WRITE]));
-	BUG_ON(!list_empty(&sd->fifo_list[ASYNC][READ]));
-	BUG_ON(!list_empty(&sd->fifo_list[ASYNC][WRITE]));
+	for (class = 0; class < SIO_NR_CLASSES; class++) {
+		BUG_ON(!list_empty(&sd->fifo_list[class][SYNC][READ]));
+		BUG_ON(!list_empty(&sd->fifo_list[class][SYNC][WRITE]));
+		BUG_ON(!list_empty(&sd->fifo_list[class][ASYNC][READ]));
+		BUG_ON(!list_empty(&sd->fifo_list[class][ASYNC][WRITE]));
+	}
 
 	/* Free structure */
 	kfree(sd);
@@ -317,6 +540,10 @@ SHOW_FUNCTION(sio_async_read_expire_show, sd->fifo_expire[ASYNC][READ], 1);
 SHOW_FUNCTION(sio_async_write_expire_show, sd->fifo_expire[ASYNC][WRITE], 1);
 SHOW_FUNCTION(sio_fifo_batch_show, sd->fifo_batch, 0);
 SHOW_FUNCTION(sio_writes_starved_show, sd->writes_starved, 0);
+SHOW_FUNCTION(sio_async_write_batch_show, sd->async_write_batch, 0);
+SHOW_FUNCTION(sio_rt_weight_show, sd->class_weight[SIO_RT], 0);
+SHOW_FUNCTION(sio_be_weight_show, sd->class_weight[SIO_BE], 0);
+SHOW_FUNCTION(sio_idle_weight_show, sd->class_weight[SIO_IDLE], 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -341,6 +568,10 @@ STORE_FUNCTION(sio_async_read_expire_store, &sd->fifo_expire[ASYNC][READ], 0, IN
 STORE_FUNCTION(sio_async_write_expire_store, &sd->fifo_expire[ASYNC][WRITE], 0, INT_MAX, 1);
 STORE_FUNCTION(sio_fifo_batch_store, &sd->fifo_batch, 0, INT_MAX, 0);
 STORE_FUNCTION(sio_writes_starved_store, &sd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(sio_async_write_batch_store, &sd->async_write_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(sio_rt_weight_store, &sd->class_weight[SIO_RT], 1, INT_MAX, 0);
+STORE_FUNCTION(sio_be_weight_store, &sd->class_weight[SIO_BE], 1, INT_MAX, 0);
+STORE_FUNCTION(sio_idle_weight_store, &sd->class_weight[SIO_IDLE], 1, INT_MAX, 0);
 #undef STORE_FUNCTION
 
 #define DD_ATTR(name) \
@@ -354,12 +585,18 @@ static struct elv_fs_entry sio_attrs[] = {
 	DD_ATTR(async_write_expire),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(writes_starved),
+	DD_ATTR(async_write_batch),
+	DD_ATTR(rt_weight),
+	DD_ATTR(be_weight),
+	DD_ATTR(idle_weight),
 	__ATTR_NULL
 };
 
 static struct elevator_type iosched_sio = {
 	.ops = {
+		.elevator_allow_merge_fn	= sio_allow_merge,
 		.elevator_merge_req_fn		= sio_merged_requests,
+		.elevator_merged_fn		= sio_merged_request,
 		.elevator_dispatch_fn		= sio_dispatch_requests,
 		.elevator_add_req_fn		= sio_add_request,
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
@@ -367,6 +604,7 @@ static struct elevator_type iosched_sio = {
 #endif
 		.elevator_former_req_fn		= sio_former_request,
 		.elevator_latter_req_fn		= sio_latter_request,
+		.elevator_set_req_fn		= sio_set_request,
 		.elevator_init_fn		= sio_init_queue,
 		.elevator_exit_fn		= sio_exit_queue,
 	},
@@ -396,4 +634,4 @@ module_exit(sio_exit);
 MODULE_AUTHOR("Miguel Boton");
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Simple IO scheduler");
-MODULE_VERSION("0.2");
+MODULE_VERSION("0.3");
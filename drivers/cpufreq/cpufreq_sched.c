@@ -0,0 +1,499 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Scheduler driven governor. Instead of sampling idle time from a timer,
+ * the scheduler reports the busy fraction of each runqueue on wakeups and
+ * ticks (see sched_cpufreq_set_hook()), and the frequency is picked from
+ * the table right away. The actual transition is done by a kthread, kicked
+ * through a short hrtimer since the hook runs under the runqueue lock.
+ * Nothing runs while the CPU is idle, except one timer to ramp down after
+ * the CPU went idle above the minimum frequency.
+ *
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+static atomic_t active_count = ATOMIC_INIT(0);
+
+struct cpufreq_sched_cpuinfo {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	struct hrtimer kick_timer;
+	struct hrtimer idle_timer;
+	unsigned int target_freq;
+	u64 target_set_time;
+	int governor_enabled;
+	int cpu;		/* owner, the timers may fire elsewhere */
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpuinfo, cpuinfo);
+
+static struct task_struct *speedchange_task;
+static cpumask_t speedchange_cpumask;
+static spinlock_t speedchange_cpumask_lock;
+static struct mutex set_speed_lock;
+
+/* Delay between the hook asking for a change and the kthread wakeup */
+#define KICK_DELAY_NS		(20 * NSEC_PER_USEC)
+
+/* Busy percentage to aim for at the chosen frequency. */
+#define DEFAULT_TARGET_LOAD 80
+static unsigned long target_load;
+
+/* Go to hispeed_freq at once when busy at or above this percentage. */
+#define DEFAULT_GO_HISPEED_LOAD 90
+static unsigned long go_hispeed_load;
+
+/* Hi speed to bump to on a load burst, 0 means policy max. */
+static unsigned int hispeed_freq;
+
+/* The minimum time to spend at a frequency before ramping down. */
+#define DEFAULT_DOWN_DELAY (20 * USEC_PER_MSEC)
+static unsigned long down_delay;
+
+/* Go to max speed when an RT task is running at the tick. */
+static unsigned int rt_boost = 1;
+
+static u64 cpufreq_sched_now_us(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
+static void cpufreq_sched_request(struct cpufreq_sched_cpuinfo *pcpu,
+				  int cpu, unsigned int freq)
+{
+	unsigned long flags;
+
+	pcpu->target_freq = freq;
+	pcpu->target_set_time = cpufreq_sched_now_us();
+
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+	cpumask_set_cpu(cpu, &speedchange_cpumask);
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+	/*
+	 * Can't wake the kthread here: the hook runs with the runqueue
+	 * lock held. The timer is pinned, so it fires on this CPU as soon
+	 * as the interrupts are enabled again.
+	 */
+	__hrtimer_start_range_ns(&pcpu->kick_timer, ns_to_ktime(KICK_DELAY_NS),
+				 0, HRTIMER_MODE_REL_PINNED, 0);
+}
+
+/*
+ * Called by the scheduler with the runqueue lock held, see
+ * sched_cpufreq_set_hook().
+ */
+static void cpufreq_sched_update(int cpu, unsigned long util,
+				 unsigned int flags)
+{
+	struct cpufreq_sched_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	struct cpufreq_policy *policy;
+	unsigned int load, freq, hispeed, index;
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	policy = pcpu->policy;
+
+	if (flags & SCHED_CPUFREQ_IDLE) {
+		if (pcpu->target_freq > policy->min)
+			__hrtimer_start_range_ns(&pcpu->idle_timer,
+				ns_to_ktime(down_delay * NSEC_PER_USEC), 0,
+				HRTIMER_MODE_REL_PINNED, 0);
+		return;
+	}
+
+	load = util * 100 / SCHED_POWER_SCALE;
+	hispeed = hispeed_freq ? hispeed_freq : policy->max;
+
+	if (rt_boost && (flags & SCHED_CPUFREQ_RT) &&
+	    (flags & SCHED_CPUFREQ_TICK)) {
+		freq = policy->max;
+	} else {
+		/* the frequency that would run this load at target_load */
+		freq = div_u64((u64)policy->cur * load, target_load);
+		if (load >= go_hispeed_load && freq < hispeed)
+			freq = hispeed;
+	}
+
+	if (cpufreq_frequency_table_target(policy, pcpu->freq_table, freq,
+					   CPUFREQ_RELATION_L, &index))
+		return;
+	freq = pcpu->freq_table[index].frequency;
+
+	if (freq == pcpu->target_freq)
+		return;
+
+	if (freq < pcpu->target_freq &&
+	    cpufreq_sched_now_us() - pcpu->target_set_time < down_delay)
+		return;
+
+	cpufreq_sched_request(pcpu, cpu, freq);
+}
+
+static enum hrtimer_restart cpufreq_sched_kick(struct hrtimer *timer)
+{
+	wake_up_process(speedchange_task);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * The CPU went idle above the minimum speed and stayed idle for down_delay:
+ * no tick will come to lower the speed, so do it here.
+ */
+static enum hrtimer_restart cpufreq_sched_idle_timer(struct hrtimer *timer)
+{
+	struct cpufreq_sched_cpuinfo *pcpu =
+		container_of(timer, struct cpufreq_sched_cpuinfo, idle_timer);
+	int cpu = pcpu->cpu;
+	unsigned long flags;
+
+	if (!pcpu->governor_enabled || !idle_cpu(cpu) ||
+	    pcpu->target_freq == pcpu->policy->min)
+		return HRTIMER_NORESTART;
+
+	pcpu->target_freq = pcpu->policy->min;
+	pcpu->target_set_time = cpufreq_sched_now_us();
+
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+	cpumask_set_cpu(cpu, &speedchange_cpumask);
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+	wake_up_process(speedchange_task);
+	return HRTIMER_NORESTART;
+}
+
+static int cpufreq_sched_speedchange_task(void *data)
+{
+	unsigned int cpu;
+	cpumask_t tmp_mask;
+	unsigned long flags;
+	struct cpufreq_sched_cpuinfo *pcpu;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+
+		if (cpumask_empty(&speedchange_cpumask)) {
+			spin_unlock_irqrestore(&speedchange_cpumask_lock,
+					       flags);
+			schedule();
+
+			if (kthread_should_stop())
+				break;
+
+			spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+		}
+
+		set_current_state(TASK_RUNNING);
+		tmp_mask = speedchange_cpumask;
+		cpumask_clear(&speedchange_cpumask);
+		spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+		for_each_cpu(cpu, &tmp_mask) {
+			unsigned int j;
+			unsigned int max_freq = 0;
+
+			pcpu = &per_cpu(cpuinfo, cpu);
+			smp_rmb();
+
+			if (!pcpu->governor_enabled)
+				continue;
+
+			mutex_lock(&set_speed_lock);
+
+			for_each_cpu(j, pcpu->policy->cpus) {
+				struct cpufreq_sched_cpuinfo *pjcpu =
+					&per_cpu(cpuinfo, j);
+
+				if (pjcpu->target_freq > max_freq)
+					max_freq = pjcpu->target_freq;
+			}
+
+			if (max_freq != pcpu->policy->cur)
+				__cpufreq_driver_target(pcpu->policy,
+							max_freq,
+							CPUFREQ_RELATION_H);
+
+			mutex_unlock(&set_speed_lock);
+		}
+	}
+
+	return 0;
+}
+
+static ssize_t show_target_load(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", target_load);
+}
+
+static ssize_t store_target_load(struct kobject *kobj,
+				 struct attribute *attr, const char *buf,
+				 size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (!val || val > 100)
+		return -EINVAL;
+	target_load = val;
+	return count;
+}
+
+static struct global_attr target_load_attr = __ATTR(target_load, 0644,
+		show_target_load, store_target_load);
+
+static ssize_t show_go_hispeed_load(struct kobject *kobj,
+				    struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", go_hispeed_load);
+}
+
+static ssize_t store_go_hispeed_load(struct kobject *kobj,
+				     struct attribute *attr, const char *buf,
+				     size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	go_hispeed_load = val;
+	return count;
+}
+
+static struct global_attr go_hispeed_load_attr = __ATTR(go_hispeed_load, 0644,
+		show_go_hispeed_load, store_go_hispeed_load);
+
+static ssize_t show_hispeed_freq(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", hispeed_freq);
+}
+
+static ssize_t store_hispeed_freq(struct kobject *kobj,
+				  struct attribute *attr, const char *buf,
+				  size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	hispeed_freq = val;
+	return count;
+}
+
+static struct global_attr hispeed_freq_attr = __ATTR(hispeed_freq, 0644,
+		show_hispeed_freq, store_hispeed_freq);
+
+static ssize_t show_down_delay(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", down_delay);
+}
+
+static ssize_t store_down_delay(struct kobject *kobj,
+				struct attribute *attr, const char *buf,
+				size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	down_delay = val;
+	return count;
+}
+
+static struct global_attr down_delay_attr = __ATTR(down_delay, 0644,
+		show_down_delay, store_down_delay);
+
+static ssize_t show_rt_boost(struct kobject *kobj,
+			     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", rt_boost);
+}
+
+static ssize_t store_rt_boost(struct kobject *kobj,
+			      struct attribute *attr, const char *buf,
+			      size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	rt_boost = !!val;
+	return count;
+}
+
+static struct global_attr rt_boost_attr = __ATTR(rt_boost, 0644,
+		show_rt_boost, store_rt_boost);
+
+static struct attribute *cpufreq_sched_attributes[] = {
+	&target_load_attr.attr,
+	&go_hispeed_load_attr.attr,
+	&hispeed_freq_attr.attr,
+	&down_delay_attr.attr,
+	&rt_boost_attr.attr,
+	NULL,
+};
+
+static struct attribute_group cpufreq_sched_attr_group = {
+	.attrs = cpufreq_sched_attributes,
+	.name = "sched",
+};
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+				  unsigned int event)
+{
+	int rc;
+	unsigned int j;
+	struct cpufreq_sched_cpuinfo *pcpu;
+	struct cpufreq_frequency_table *freq_table;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu))
+			return -EINVAL;
+
+		freq_table = cpufreq_frequency_get_table(policy->cpu);
+		if (!freq_table)
+			return -EINVAL;
+
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->policy = policy;
+			pcpu->freq_table = freq_table;
+			pcpu->target_freq = policy->cur;
+			pcpu->target_set_time = cpufreq_sched_now_us();
+			smp_wmb();
+			pcpu->governor_enabled = 1;
+		}
+
+		if (atomic_inc_return(&active_count) > 1)
+			return 0;
+
+		rc = sysfs_create_group(cpufreq_global_kobject,
+					&cpufreq_sched_attr_group);
+		if (rc)
+			return rc;
+
+		sched_cpufreq_set_hook(cpufreq_sched_update);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->governor_enabled = 0;
+		}
+
+		/* no hook may still be arming the timers */
+		synchronize_sched();
+
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			hrtimer_cancel(&pcpu->kick_timer);
+			hrtimer_cancel(&pcpu->idle_timer);
+		}
+
+		if (atomic_dec_return(&active_count) > 0)
+			return 0;
+
+		sched_cpufreq_set_hook(NULL);
+		sysfs_remove_group(cpufreq_global_kobject,
+				   &cpufreq_sched_attr_group);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&set_speed_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		mutex_unlock(&set_speed_lock);
+		break;
+	}
+	return 0;
+}
+
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+static int __init cpufreq_sched_init(void)
+{
+	unsigned int i;
+	struct cpufreq_sched_cpuinfo *pcpu;
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+
+	target_load = DEFAULT_TARGET_LOAD;
+	go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
+	down_delay = DEFAULT_DOWN_DELAY;
+
+	for_each_possible_cpu(i) {
+		pcpu = &per_cpu(cpuinfo, i);
+		pcpu->cpu = i;
+		hrtimer_init(&pcpu->kick_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		pcpu->kick_timer.function = cpufreq_sched_kick;
+		hrtimer_init(&pcpu->idle_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		pcpu->idle_timer.function = cpufreq_sched_idle_timer;
+	}
+
+	spin_lock_init(&speedchange_cpumask_lock);
+	mutex_init(&set_speed_lock);
+
+	speedchange_task = kthread_create(cpufreq_sched_speedchange_task, NULL,
+					  "kschedfreq");
+	if (IS_ERR(speedchange_task))
+		return PTR_ERR(speedchange_task);
+
+	sched_setscheduler_nocheck(speedchange_task, SCHED_FIFO, &param);
+	get_task_struct(speedchange_task);
+
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+fs_initcall(cpufreq_sched_init);
+#else
+module_init(cpufreq_sched_init);
+#endif
+
+MODULE_DESCRIPTION("'cpufreq_sched' - scheduler driven cpufreq governor");
+MODULE_LICENSE("GPL");
@@ -34,6 +34,10 @@
 #include <linux/moduleparam.h>
 #include <asm/cputime.h>
 #include <linux/earlysuspend.h>
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 
 /******************** Tunable parameters: ********************/
@@ -110,6 +114,28 @@ static unsigned int sleep_wakeup_freq;
 #define DEFAULT_SAMPLE_RATE_JIFFIES 2
 static unsigned int sample_rate_jiffies;
 
+/*
+ * The frequency to jump to on touchscreen input. Zero disables input boost.
+ * While boosted we never ramp down below this frequency.
+ */
+#define DEFAULT_INPUT_BOOST_FREQ 800000
+static unsigned int input_boost_freq;
+
+/*
+ * How long the boost lasts after the last input event. Input events closer
+ * than this are considered one touch stream.
+ */
+#define DEFAULT_INPUT_BOOST_US 100000
+static unsigned long input_boost_us;
+
+/*
+ * When a new touch stream begins, jump to the frequency that would have
+ * kept the peak load of the recent touch streams at max_cpu_load, if that
+ * is higher than input_boost_freq. Zero always uses input_boost_freq.
+ */
+#define DEFAULT_TOUCH_PREDICT 1
+static unsigned int touch_predict;
+
 
 /*************** End of tunables ***************/
 
@@ -130,6 +156,7 @@ struct smartass_info_s {
 	int ramp_dir;
 	unsigned int enable;
 	int ideal_speed;
+	unsigned int boost_req;
 };
 static DEFINE_PER_CPU(struct smartass_info_s, smartass_info);
 
@@ -143,6 +170,33 @@ static spinlock_t cpumask_lock;
 
 static unsigned int suspended;
 
+/*
+ * Touch stream state. A stream begins with the first input event after the
+ * boost has expired. During a stream the timer records the peak load as the
+ * frequency (kHz) that would be needed to run it at 100% load; the peaks of
+ * the last SMARTASS_TOUCH_HIST streams are the history used for prediction.
+ */
+#define SMARTASS_TOUCH_HIST 4
+
+static spinlock_t boost_lock;
+static unsigned long boost_until;
+static unsigned int stream_peak;
+static unsigned int touch_hist[SMARTASS_TOUCH_HIST];
+static unsigned int touch_hist_idx;
+
+/* Frequency transition counters, see the cpufreq_smartass2 debugfs file */
+static struct smartass_stats_s {
+	unsigned long ramp_up;
+	unsigned long ramp_down;
+	unsigned long input_boost;
+	unsigned long predicted_boost;
+	unsigned long touch_streams;
+	unsigned long predict_under;
+	unsigned long predict_over;
+} smartass_stats;
+
+static struct dentry *smartass_debugfs;
+
 #define dprintk(flag,msg...) do { \
 	if (debug_mask & flag) printk(KERN_DEBUG msg); \
 	} while (0)
@@ -270,6 +324,55 @@ inline static int target_freq(struct cpufreq_policy *policy, struct smartass_inf
 	return target;
 }
 
+inline static int boost_active(void) {
+	return input_boost_freq && time_before(jiffies, boost_until);
+}
+
+/*
+ * Record the load demand of the current touch stream, called by the timer
+ * while boosted.
+ */
+static void touch_stream_sample(int freq, int cpu_load) {
+	unsigned int demand = freq / 100 * cpu_load;
+	unsigned long flags;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	if (demand > stream_peak)
+		stream_peak = demand;
+	spin_unlock_irqrestore(&boost_lock, flags);
+}
+
+/*
+ * A new touch stream begins: push the peak of the last one into the history
+ * and return the frequency to boost to. Called with boost_lock held.
+ */
+static unsigned int touch_stream_begin(void) {
+	unsigned int i, n = 0, sum = 0, freq;
+
+	if (stream_peak) {
+		touch_hist[touch_hist_idx] = stream_peak;
+		touch_hist_idx = (touch_hist_idx + 1) % SMARTASS_TOUCH_HIST;
+		stream_peak = 0;
+	}
+	smartass_stats.touch_streams++;
+
+	if (!touch_predict)
+		return input_boost_freq;
+
+	for (i = 0; i < SMARTASS_TOUCH_HIST; i++) {
+		if (touch_hist[i]) {
+			sum += touch_hist[i];
+			n++;
+		}
+	}
+	if (!n)
+		return input_boost_freq;
+
+	// the frequency at which the average peak would be at max_cpu_load:
+	freq = sum / n / max_cpu_load * 100;
+	return freq > input_boost_freq ? freq : input_boost_freq;
+}
+
 static void cpufreq_smartass_timer(unsigned long cpu)
 {
 	u64 delta_idle;
@@ -309,6 +412,9 @@ static void cpufreq_smartass_timer(unsigned long cpu)
 	this_smartass->cur_cpu_load = cpu_load;
 	this_smartass->old_freq = old_freq;
 
+	if (boost_active())
+		touch_stream_sample(old_freq, cpu_load);
+
 	// Scale up if load is above max or if there where no idle cycles since coming out of idle,
 	// additionally, if we are at or above the ideal_speed, verify we have been at this frequency
 	// for at least up_rate_us:
@@ -330,6 +436,7 @@ static void cpufreq_smartass_timer(unsigned long cpu)
 	// Similarly for scale down: load should be below min and if we are at or below ideal
 	// frequency we require that we have been at this frequency for at least down_rate_us:
 	else if (cpu_load < min_cpu_load && old_freq > policy->min &&
+		 !(boost_active() && old_freq <= (int)input_boost_freq) &&
 		 (old_freq > this_smartass->ideal_speed ||
 		  cputime64_sub(update_time, this_smartass->freq_change_time) >= down_rate_us))
 	{
@@ -377,6 +484,8 @@ static void cpufreq_smartass_freq_change_time_work(struct work_struct *work)
 	int new_freq;
 	int old_freq;
 	int ramp_dir;
+	int boosted;
+	unsigned int boost_req;
 	struct smartass_info_s *this_smartass;
 	struct cpufreq_policy *policy;
 	unsigned int relation = CPUFREQ_RELATION_L;
@@ -387,9 +496,14 @@ static void cpufreq_smartass_freq_change_time_work(struct work_struct *work)
 
 		ramp_dir = this_smartass->ramp_dir;
 		this_smartass->ramp_dir = 0;
+		boost_req = this_smartass->boost_req;
+		this_smartass->boost_req = 0;
 
-		old_freq = this_smartass->old_freq;
 		policy = this_smartass->cur_policy;
+		// queued by input only, the timer did not sample the frequency:
+		if (boost_req && !ramp_dir)
+			this_smartass->old_freq = policy->cur;
+		old_freq = this_smartass->old_freq;
 
 		if (old_freq != policy->cur) {
 			// frequency was changed by someone else?
@@ -439,12 +553,40 @@ static void cpufreq_smartass_freq_change_time_work(struct work_struct *work)
 				old_freq,ramp_dir,nr_running());
 		}
 
+		// input boost: jump to the requested frequency, and while boosted
+		// never go below input_boost_freq:
+		boosted = boost_active();
+		if (boost_req > input_boost_freq && new_freq < (int)boost_req) {
+			new_freq = boost_req;
+			relation = CPUFREQ_RELATION_L;
+		}
+		else if (boosted && new_freq < (int)input_boost_freq) {
+			new_freq = input_boost_freq;
+			relation = CPUFREQ_RELATION_L;
+		}
+
 		// do actual ramp up (returns 0, if frequency change failed):
 		new_freq = target_freq(policy,this_smartass,new_freq,old_freq,relation);
-		if (new_freq)
+		if (new_freq) {
 			this_smartass->freq_change_time_in_idle =
 				get_cpu_idle_time_us(cpu,&this_smartass->freq_change_time);
 
+			if (boost_req > input_boost_freq)
+				smartass_stats.predicted_boost++;
+			else if (boost_req)
+				smartass_stats.input_boost++;
+			else if (new_freq > old_freq) {
+				smartass_stats.ramp_up++;
+				if (boosted)
+					smartass_stats.predict_under++;
+			}
+			else {
+				smartass_stats.ramp_down++;
+				if (boosted)
+					smartass_stats.predict_over++;
+			}
+		}
+
 		// reset timer:
 		if (new_freq < policy->max)
 			reset_timer(cpu,this_smartass);
@@ -455,6 +597,156 @@ static void cpufreq_smartass_freq_change_time_work(struct work_struct *work)
 	}
 }
 
+/*
+ * Touchscreen input: on every report extend the boost, and when a new touch
+ * stream begins ramp up right away instead of waiting for the timer to see
+ * the load. This runs in atomic context, so the work queue does the change.
+ */
+static void smartass_input_event(struct input_handle *handle, unsigned int type,
+				 unsigned int code, int value)
+{
+	unsigned long flags;
+	unsigned int freq = 0;
+	unsigned int cpu;
+	int queued = 0;
+
+	if (!input_boost_freq || suspended || type != EV_SYN || code != SYN_REPORT)
+		return;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	if (!time_before(jiffies, boost_until))
+		freq = touch_stream_begin();
+	boost_until = jiffies + usecs_to_jiffies(input_boost_us);
+	spin_unlock_irqrestore(&boost_lock, flags);
+
+	if (!freq)
+		return;
+
+	for_each_online_cpu(cpu) {
+		struct smartass_info_s *this_smartass = &per_cpu(smartass_info, cpu);
+		if (!this_smartass->enable || this_smartass->cur_policy->cur >= freq)
+			continue;
+		this_smartass->boost_req = freq;
+		work_cpumask_set(cpu);
+		queued = 1;
+	}
+	if (queued)
+		queue_work(up_wq, &freq_scale_work);
+}
+
+static int smartass_input_connect(struct input_handler *handler,
+				  struct input_dev *dev,
+				  const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_smartass2";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void smartass_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id smartass_input_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	}, /* multi-touch touchscreen */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
+	}, /* touchpad */
+	{ },
+};
+
+static struct input_handler smartass_input_handler = {
+	.event		= smartass_input_event,
+	.connect	= smartass_input_connect,
+	.disconnect	= smartass_input_disconnect,
+	.name		= "cpufreq_smartass2",
+	.id_table	= smartass_input_ids,
+};
+
+/* Input boost is optional, the governor runs without the handler */
+static bool input_handler_registered;
+
+static int smartass_stats_show(struct seq_file *m, void *unused)
+{
+	struct smartass_stats_s stats;
+	unsigned int hist[SMARTASS_TOUCH_HIST];
+	unsigned int peak;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	stats = smartass_stats;
+	for (i = 0; i < SMARTASS_TOUCH_HIST; i++)
+		hist[i] = touch_hist[(touch_hist_idx + i) % SMARTASS_TOUCH_HIST];
+	peak = stream_peak;
+	spin_unlock_irqrestore(&boost_lock, flags);
+
+	seq_printf(m, "ramp_up: %lu\n", stats.ramp_up);
+	seq_printf(m, "ramp_down: %lu\n", stats.ramp_down);
+	seq_printf(m, "input_boost: %lu\n", stats.input_boost);
+	seq_printf(m, "predicted_boost: %lu\n", stats.predicted_boost);
+	seq_printf(m, "touch_streams: %lu\n", stats.touch_streams);
+	seq_printf(m, "predict_under: %lu\n", stats.predict_under);
+	seq_printf(m, "predict_over: %lu\n", stats.predict_over);
+	seq_printf(m, "boosted: %d\n", boost_active());
+	seq_printf(m, "stream_peak: %u\n", peak);
+	seq_printf(m, "touch_hist:");
+	for (i = 0; i < SMARTASS_TOUCH_HIST; i++)
+		seq_printf(m, " %u", hist[i]);
+	seq_printf(m, "\n");
+
+	return 0;
+}
+
+static int smartass_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, smartass_stats_show, NULL);
+}
+
+static const struct file_operations smartass_stats_fops = {
+	.open		= smartass_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static ssize_t show_debug_mask(struct kobject *kobj, struct attribute *attr, char *buf)
 {
 	return sprintf(buf, "%lu\n", debug_mask);
@@ -626,6 +918,51 @@ static ssize_t store_min_cpu_load(struct kobject *kobj, struct attribute *attr,
 	return count;
 }
 
+static ssize_t show_input_boost_freq(struct kobject *kobj, struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct kobject *kobj, struct attribute *attr, const char *buf, size_t count)
+{
+	ssize_t res;
+	unsigned long input;
+	res = strict_strtoul(buf, 0, &input);
+	if (res >= 0)
+		input_boost_freq = input;
+	return count;
+}
+
+static ssize_t show_input_boost_us(struct kobject *kobj, struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_us);
+}
+
+static ssize_t store_input_boost_us(struct kobject *kobj, struct attribute *attr, const char *buf, size_t count)
+{
+	ssize_t res;
+	unsigned long input;
+	res = strict_strtoul(buf, 0, &input);
+	if (res >= 0 && input <= 10000000)
+		input_boost_us = input;
+	return count;
+}
+
+static ssize_t show_touch_predict(struct kobject *kobj, struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", touch_predict);
+}
+
+static ssize_t store_touch_predict(struct kobject *kobj, struct attribute *attr, const char *buf, size_t count)
+{
+	ssize_t res;
+	unsigned long input;
+	res = strict_strtoul(buf, 0, &input);
+	if (res >= 0)
+		touch_predict = !!input;
+	return count;
+}
+
 #define define_global_rw_attr(_name)		\
 static struct global_attr _name##_attr =	\
 	__ATTR(_name, 0644, show_##_name, store_##_name)
@@ -641,6 +978,9 @@ define_global_rw_attr(ramp_up_step);
 define_global_rw_attr(ramp_down_step);
 define_global_rw_attr(max_cpu_load);
 define_global_rw_attr(min_cpu_load);
+define_global_rw_attr(input_boost_freq);
+define_global_rw_attr(input_boost_us);
+define_global_rw_attr(touch_predict);
 
 static struct attribute * smartass_attributes[] = {
 	&debug_mask_attr.attr,
@@ -654,6 +994,9 @@ static struct attribute * smartass_attributes[] = {
 	&ramp_down_step_attr.attr,
 	&max_cpu_load_attr.attr,
 	&min_cpu_load_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_us_attr.attr,
+	&touch_predict_attr.attr,
 	NULL,
 };
 
@@ -696,6 +1039,12 @@ static int cpufreq_governor_smartass(struct cpufreq_policy *new_policy,
 
 			pm_idle_old = pm_idle;
 			pm_idle = cpufreq_idle;
+
+			rc = input_register_handler(&smartass_input_handler);
+			if (rc)
+				printk(KERN_WARNING "Smartass: failed to register input handler\n");
+			else
+				input_handler_registered = true;
 		}
 
 		if (this_smartass->cur_policy->cur < new_policy->max && !timer_pending(&this_smartass->timer))
@@ -730,6 +1079,9 @@ static int cpufreq_governor_smartass(struct cpufreq_policy *new_policy,
 		this_smartass->idle_exit_time = 0;
 
 		if (atomic_dec_return(&active_count) <= 1) {
+			if (input_handler_registered)
+				input_unregister_handler(&smartass_input_handler);
+			input_handler_registered = false;
 			sysfs_remove_group(cpufreq_global_kobject,
 					   &smartass_attr_group);
 			pm_idle = pm_idle_old;
@@ -812,8 +1164,13 @@ static int __init cpufreq_smartass_init(void)
 	ramp_down_step = DEFAULT_RAMP_DOWN_STEP;
 	max_cpu_load = DEFAULT_MAX_CPU_LOAD;
 	min_cpu_load = DEFAULT_MIN_CPU_LOAD;
+	input_boost_freq = DEFAULT_INPUT_BOOST_FREQ;
+	input_boost_us = DEFAULT_INPUT_BOOST_US;
+	touch_predict = DEFAULT_TOUCH_PREDICT;
 
 	spin_lock_init(&cpumask_lock);
+	spin_lock_init(&boost_lock);
+	boost_until = jiffies;
 
 	suspended = 0;
 
@@ -828,6 +1185,7 @@ static int __init cpufreq_smartass_init(void)
 		this_smartass->freq_change_time = 0;
 		this_smartass->freq_change_time_in_idle = 0;
 		this_smartass->cur_cpu_load = 0;
+		this_smartass->boost_req = 0;
 		// intialize timer:
 		init_timer_deferrable(&this_smartass->timer);
 		this_smartass->timer.function = cpufreq_smartass_timer;
@@ -845,6 +1203,9 @@ static int __init cpufreq_smartass_init(void)
 
 	register_early_suspend(&smartass_power_suspend);
 
+	smartass_debugfs = debugfs_create_file("cpufreq_smartass2", S_IRUGO,
+					       NULL, NULL, &smartass_stats_fops);
+
 	return cpufreq_register_governor(&cpufreq_gov_smartass2);
 }
 
@@ -856,6 +1217,7 @@ module_init(cpufreq_smartass_init);
 
 static void __exit cpufreq_smartass_exit(void)
 {
+	debugfs_remove(smartass_debugfs);
 	cpufreq_unregister_governor(&cpufreq_gov_smartass2);
 	destroy_workqueue(up_wq);
 	destroy_workqueue(down_wq);
@@ -20,6 +20,11 @@
 #include <linux/kobject.h>
 #include <linux/spinlock.h>
 #include <linux/notifier.h>
+#include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <asm/cputime.h>
 
 static spinlock_t cpufreq_stats_lock;
@@ -165,6 +170,235 @@ static int freq_table_get_index(struct cpufreq_stats *stat, unsigned int freq)
 	return -1;
 }
 
+#ifdef CONFIG_CPU_FREQ_STAT_TASKS
+/*
+ * Per task time in state. The frequencies of the first policy created are
+ * the columns. Each task forked after that gets an array of cputimes,
+ * charged from the tick accounting without locking: only the CPU the task
+ * runs on updates it. When a task is freed, its times are folded into its
+ * uid, so /proc/uid_time_in_state also covers the tasks that exited. The
+ * uid table is only locked on task exit and when reading that file.
+ */
+#define UID_HASH_BITS	6
+
+struct uid_entry {
+	uid_t uid;
+	struct hlist_node hash;
+	/* exited tasks, then a scratch copy for the readers */
+	cputime64_t times[0];
+};
+
+#define uid_entry_sum(e)	((e)->times + task_stats_max_state)
+
+static unsigned int *task_stats_freqs;
+static unsigned int task_stats_max_state;
+static DEFINE_PER_CPU(int, task_stats_index) = -1;
+
+static struct hlist_head uid_hash_table[1 << UID_HASH_BITS];
+static DEFINE_SPINLOCK(uid_lock);
+static DEFINE_MUTEX(uid_read_lock);
+
+static int task_stats_freq_index(unsigned int freq)
+{
+	int index;
+	for (index = 0; index < task_stats_max_state; index++)
+		if (task_stats_freqs[index] == freq)
+			return index;
+	return -1;
+}
+
+static void task_stats_set_freq(unsigned int cpu, unsigned int freq)
+{
+	if (task_stats_max_state)
+		per_cpu(task_stats_index, cpu) = task_stats_freq_index(freq);
+}
+
+static void task_stats_init_freqs(struct cpufreq_stats *stat)
+{
+	unsigned int *freqs;
+
+	if (task_stats_max_state || !stat->state_num)
+		return;
+	freqs = kmemdup(stat->freq_table, stat->state_num * sizeof(*freqs),
+			GFP_KERNEL);
+	if (!freqs)
+		return;
+	task_stats_freqs = freqs;
+	/* the columns are never changed once tasks are sized after them */
+	smp_wmb();
+	task_stats_max_state = stat->state_num;
+}
+
+void cpufreq_task_stats_init(struct task_struct *p)
+{
+	unsigned int max_state = ACCESS_ONCE(task_stats_max_state);
+
+	p->time_in_state = NULL;
+	if (!max_state)
+		return;
+	smp_rmb();
+	p->time_in_state = kcalloc(max_state, sizeof(cputime64_t),
+				   GFP_KERNEL);
+}
+
+void cpufreq_task_stats_account(struct task_struct *p, cputime_t cputime)
+{
+	int index = per_cpu(task_stats_index, task_cpu(p));
+
+	if (p->time_in_state && index >= 0)
+		p->time_in_state[index] =
+			cputime64_add(p->time_in_state[index],
+				      cputime_to_cputime64(cputime));
+}
+
+/* must be called with uid_lock held */
+static struct uid_entry *uid_entry_get(uid_t uid)
+{
+	struct hlist_head *head = &uid_hash_table[hash_32(uid, UID_HASH_BITS)];
+	struct uid_entry *e;
+	struct hlist_node *n;
+
+	hlist_for_each_entry(e, n, head, hash)
+		if (e->uid == uid)
+			return e;
+
+	e = kzalloc(sizeof(*e) + 2 * task_stats_max_state *
+		    sizeof(cputime64_t), GFP_ATOMIC);
+	if (!e)
+		return NULL;
+	e->uid = uid;
+	hlist_add_head(&e->hash, head);
+	return e;
+}
+
+void cpufreq_task_stats_exit(struct task_struct *p)
+{
+	struct uid_entry *e;
+	unsigned long flags;
+	unsigned int i;
+
+	if (!p->time_in_state)
+		return;
+
+	spin_lock_irqsave(&uid_lock, flags);
+	e = uid_entry_get(task_uid(p));
+	if (e)
+		for (i = 0; i < task_stats_max_state; i++)
+			e->times[i] = cputime64_add(e->times[i],
+						    p->time_in_state[i]);
+	spin_unlock_irqrestore(&uid_lock, flags);
+}
+
+void cpufreq_task_stats_free(struct task_struct *p)
+{
+	kfree(p->time_in_state);
+	p->time_in_state = NULL;
+}
+
+int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
+			    struct pid *pid, struct task_struct *p)
+{
+	unsigned int i;
+
+	if (!p->time_in_state)
+		return 0;
+
+	for (i = 0; i < task_stats_max_state; i++)
+		seq_printf(m, "%u %llu\n", task_stats_freqs[i],
+			   (unsigned long long)
+			   cputime64_to_clock_t(p->time_in_state[i]));
+	return 0;
+}
+
+static int uid_time_in_state_show(struct seq_file *m, void *v)
+{
+	struct task_struct *g, *p;
+	struct uid_entry *e;
+	struct hlist_node *n;
+	unsigned long flags;
+	unsigned int i, bkt;
+
+	if (!task_stats_max_state)
+		return 0;
+
+	mutex_lock(&uid_read_lock);
+
+	spin_lock_irqsave(&uid_lock, flags);
+	for (bkt = 0; bkt < ARRAY_SIZE(uid_hash_table); bkt++)
+		hlist_for_each_entry(e, n, &uid_hash_table[bkt], hash)
+			memcpy(uid_entry_sum(e), e->times,
+			       task_stats_max_state * sizeof(cputime64_t));
+	spin_unlock_irqrestore(&uid_lock, flags);
+
+	/*
+	 * A task seen here is only folded into its uid after an RCU grace
+	 * period, so it can't be counted twice.
+	 */
+	rcu_read_lock();
+	do_each_thread(g, p) {
+		cputime64_t *sum;
+
+		if (!p->time_in_state)
+			continue;
+
+		spin_lock_irqsave(&uid_lock, flags);
+		e = uid_entry_get(task_uid(p));
+		spin_unlock_irqrestore(&uid_lock, flags);
+		if (!e)
+			continue;
+
+		sum = uid_entry_sum(e);
+		for (i = 0; i < task_stats_max_state; i++)
+			sum[i] = cputime64_add(sum[i], p->time_in_state[i]);
+	} while_each_thread(g, p);
+	rcu_read_unlock();
+
+	seq_puts(m, "uid:");
+	for (i = 0; i < task_stats_max_state; i++)
+		seq_printf(m, " %u", task_stats_freqs[i]);
+	seq_putc(m, '\n');
+
+	spin_lock_irqsave(&uid_lock, flags);
+	for (bkt = 0; bkt < ARRAY_SIZE(uid_hash_table); bkt++) {
+		hlist_for_each_entry(e, n, &uid_hash_table[bkt], hash) {
+			cputime64_t *sum = uid_entry_sum(e);
+
+			seq_printf(m, "%u:", e->uid);
+			for (i = 0; i < task_stats_max_state; i++)
+				seq_printf(m, " %llu", (unsigned long long)
+					   cputime64_to_clock_t(sum[i]));
+			seq_putc(m, '\n');
+		}
+	}
+	spin_unlock_irqrestore(&uid_lock, flags);
+
+	mutex_unlock(&uid_read_lock);
+	return 0;
+}
+
+static int uid_time_in_state_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, uid_time_in_state_show, NULL);
+}
+
+static const struct file_operations uid_time_in_state_fops = {
+	.open		= uid_time_in_state_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void task_stats_create_proc(void)
+{
+	proc_create("uid_time_in_state", S_IRUGO, NULL,
+		    &uid_time_in_state_fops);
+}
+#else
+static inline void task_stats_set_freq(unsigned int cpu, unsigned int freq) {}
+static inline void task_stats_init_freqs(struct cpufreq_stats *stat) {}
+static inline void task_stats_create_proc(void) {}
+#endif
+
 /* should be called late in the CPU removal sequence so that the stats
  * memory is still available in case someone tries to use it.
  */
@@ -253,6 +487,8 @@ static int cpufreq_stats_create_table(struct cpufreq_policy *policy,
 	stat->last_time = get_jiffies_64();
 	stat->last_index = freq_table_get_index(stat, policy->cur);
 	spin_unlock(&cpufreq_stats_lock);
+	task_stats_init_freqs(stat);
+	task_stats_set_freq(cpu, policy->cur);
 	cpufreq_cpu_put(data);
 	return 0;
 error_out:
@@ -295,6 +531,8 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	if (!stat)
 		return 0;
 
+	task_stats_set_freq(freq->cpu, freq->new);
+
 	old_index = stat->last_index;
 	new_index = freq_table_get_index(stat, freq->new);
 
@@ -402,6 +640,7 @@ static int __init cpufreq_stats_init(void)
 	for_each_online_cpu(cpu) {
 		cpufreq_update_policy(cpu);
 	}
+	task_stats_create_proc();
 	return 0;
 }
 static void __exit cpufreq_stats_exit(void)
@@ -0,0 +1,405 @@
+/*
+ * irqpredict.c - idle governor predicting wakeups from interrupt history
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/cpu.h>
+#include <linux/pm_qos_params.h>
+#include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include <linux/interrupt.h>
+#include <linux/bitops.h>
+#include <linux/sysfs.h>
+
+/*
+ * The menu governor only knows the next timer event, and corrects it with
+ * a running factor. Devices like the modem or the display however wake the
+ * CPU up periodically from their own interrupt, which no timer tells about.
+ *
+ * This governor records the inter-arrival time of each interrupt, keeping
+ * an average period and an average deviation from it. An interrupt whose
+ * deviation stays small compared to its period is considered periodic, and
+ * its next occurrence is predicted as the last one plus the period, minus
+ * the deviation to err on the early side. The expected idle time is the
+ * earliest of these predictions and of the next timer event, and the
+ * deepest state whose target residency fits in it and whose exit latency
+ * satisfies pm_qos is selected.
+ *
+ * The outcome of every idle period is checked against the choice, and the
+ * mispredictions are counted in /sys/devices/system/cpu/irqpredict/.
+ */
+
+#define MIN_SAMPLES	4
+/* periodic if the average deviation is below 1/8 of the period */
+#define REGULAR_SHIFT	3
+/* longer intervals restart the learning for that interrupt */
+#define MAX_PERIOD_NS	(4ULL * NSEC_PER_SEC)
+
+struct irq_history {
+	u64		last;		/* local_clock() of the last occurrence */
+	u32		period_us;
+	u32		dev_us;
+	unsigned int	samples;
+};
+
+static struct irq_history irq_history[NR_IRQS];
+static DECLARE_BITMAP(irq_regular, NR_IRQS);
+static int irqpredict_enabled;
+
+struct irqpredict_stats {
+	unsigned long	entries;
+	unsigned long	hits;
+	unsigned long	too_deep;
+	unsigned long	too_shallow;
+	unsigned long	demoted;
+	unsigned long	irq_hits;
+	unsigned long	irq_misses;
+};
+
+struct irqpredict_device {
+	int		last_state_idx;
+	int		needs_update;
+
+	unsigned int	expected_us;
+	unsigned int	predicted_us;
+	int		predicted_irq;
+	/* target residency of the next deeper allowed state, 0 if none */
+	unsigned int	deeper_residency;
+
+	/* set while idle, the first interrupt taken is the wakeup source */
+	int		waiting;
+	int		wake_irq;
+
+	struct irqpredict_stats stats;
+};
+
+static DEFINE_PER_CPU(struct irqpredict_device, irqpredict_devices);
+
+static void irqpredict_update(struct cpuidle_device *dev);
+
+/**
+ * cpuidle_irq_record - records an interrupt occurrence
+ * @irq: the interrupt number
+ * @flags: the IRQF_ flags of its first action
+ *
+ * Called from the generic interrupt handling, before the handlers run.
+ */
+void cpuidle_irq_record(unsigned int irq, unsigned long flags)
+{
+	struct irqpredict_device *data;
+	struct irq_history *h;
+	u64 now, delta;
+	s32 err;
+	u32 us;
+
+	if (!irqpredict_enabled || irq >= NR_IRQS)
+		return;
+
+	data = &__get_cpu_var(irqpredict_devices);
+	if (data->waiting) {
+		data->waiting = 0;
+		data->wake_irq = irq;
+	}
+
+	/* the timer is already known from tick_nohz_get_sleep_length() */
+	if (flags & IRQF_TIMER)
+		return;
+
+	h = &irq_history[irq];
+	now = local_clock();
+	delta = now - h->last;
+	h->last = now;
+
+	if (!h->samples || delta > MAX_PERIOD_NS) {
+		h->samples = 1;
+		__clear_bit(irq, irq_regular);
+		return;
+	}
+
+	us = (u32)delta / NSEC_PER_USEC;
+	if (h->samples == 1) {
+		h->period_us = us;
+		h->dev_us = us / 2;
+	} else {
+		err = us - h->period_us;
+		h->period_us += err / 8;
+		h->dev_us += ((s32)abs(err) - (s32)h->dev_us) / 4;
+	}
+	if (h->samples < UINT_MAX)
+		h->samples++;
+
+	if (h->samples >= MIN_SAMPLES &&
+	    h->dev_us <= h->period_us >> REGULAR_SHIFT)
+		__set_bit(irq, irq_regular);
+	else
+		__clear_bit(irq, irq_regular);
+}
+
+/*
+ * Returns the time until the earliest predicted periodic interrupt, capped
+ * to @limit_us, and sets @irq to its number or -1 if none comes earlier.
+ */
+static unsigned int irqpredict_next_irq(unsigned int limit_us, int *irq)
+{
+	u64 now = local_clock();
+	unsigned int next_us = limit_us;
+	int i;
+
+	*irq = -1;
+	for_each_set_bit(i, irq_regular, NR_IRQS) {
+		struct irq_history *h = &irq_history[i];
+		u64 since_us = div_u64(now - h->last, NSEC_PER_USEC);
+		unsigned int due_us;
+
+		/* went quiet, it'll be relearned when it fires again */
+		if (since_us > h->period_us + 2 * h->dev_us)
+			continue;
+
+		if (since_us + h->dev_us >= h->period_us)
+			due_us = 0;
+		else
+			due_us = h->period_us - h->dev_us - since_us;
+
+		if (due_us < next_us) {
+			next_us = due_us;
+			*irq = i;
+		}
+	}
+
+	return next_us;
+}
+
+/**
+ * irqpredict_select - selects the next idle state to enter
+ * @dev: the CPU
+ */
+static int irqpredict_select(struct cpuidle_device *dev)
+{
+	struct irqpredict_device *data = &__get_cpu_var(irqpredict_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	struct timespec t;
+	int i;
+
+	if (data->needs_update) {
+		irqpredict_update(dev);
+		data->needs_update = 0;
+	}
+
+	data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
+	data->predicted_irq = -1;
+	data->deeper_residency = 0;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0)) {
+		data->last_state_idx = 0;
+		return 0;
+	}
+
+	t = ktime_to_timespec(tick_nohz_get_sleep_length());
+	data->expected_us =
+		t.tv_sec * USEC_PER_SEC + t.tv_nsec / NSEC_PER_USEC;
+
+	data->predicted_us = irqpredict_next_irq(data->expected_us,
+						 &data->predicted_irq);
+
+	/* the states are ordered from the shallowest to the deepest */
+	for (i = CPUIDLE_DRIVER_STATE_START; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->target_residency > data->predicted_us) {
+			if (!data->deeper_residency)
+				data->deeper_residency = s->target_residency;
+			continue;
+		}
+		data->last_state_idx = i;
+	}
+
+	data->wake_irq = -1;
+	data->waiting = 1;
+
+	return data->last_state_idx;
+}
+
+/**
+ * irqpredict_reflect - records that data structures need update
+ * @dev: the CPU
+ */
+static void irqpredict_reflect(struct cpuidle_device *dev)
+{
+	struct irqpredict_device *data = &__get_cpu_var(irqpredict_devices);
+
+	data->waiting = 0;
+	data->needs_update = 1;
+}
+
+/**
+ * irqpredict_update - checks the outcome of the last idle period
+ * @dev: the CPU
+ */
+static void irqpredict_update(struct cpuidle_device *dev)
+{
+	struct irqpredict_device *data = &__get_cpu_var(irqpredict_devices);
+	struct cpuidle_state *target = &dev->states[data->last_state_idx];
+	struct irqpredict_stats *stats = &data->stats;
+	unsigned int measured_us = cpuidle_get_last_residency(dev);
+
+	stats->entries++;
+
+	if (data->predicted_irq >= 0) {
+		if (data->wake_irq == data->predicted_irq)
+			stats->irq_hits++;
+		else
+			stats->irq_misses++;
+	}
+
+	/* the driver fell back to a safer state, e.g. for bus activity */
+	if (dev->last_state && dev->last_state != target) {
+		stats->demoted++;
+		return;
+	}
+
+	if (!(target->flags & CPUIDLE_FLAG_TIME_VALID))
+		return;
+
+	if (measured_us < target->target_residency)
+		stats->too_deep++;
+	else if (data->deeper_residency &&
+		 measured_us >= data->deeper_residency)
+		stats->too_shallow++;
+	else
+		stats->hits++;
+}
+
+/**
+ * irqpredict_enable_device - scans a CPU's states and does setup
+ * @dev: the CPU
+ */
+static int irqpredict_enable_device(struct cpuidle_device *dev)
+{
+	struct irqpredict_device *data =
+		&per_cpu(irqpredict_devices, dev->cpu);
+
+	memset(data, 0, sizeof(struct irqpredict_device));
+	irqpredict_enabled = 1;
+
+	return 0;
+}
+
+static void irqpredict_disable_device(struct cpuidle_device *dev)
+{
+	irqpredict_enabled = 0;
+}
+
+static struct cpuidle_governor irqpredict_governor = {
+	.name =		"irqpredict",
+	.rating =	30,
+	.enable =	irqpredict_enable_device,
+	.disable =	irqpredict_disable_device,
+	.select =	irqpredict_select,
+	.reflect =	irqpredict_reflect,
+	.owner =	THIS_MODULE,
+};
+
+#define define_show_stat(_name)						\
+static ssize_t show_##_name(struct sysdev_class *class,			\
+			    struct sysdev_class_attribute *attr,	\
+			    char *buf)					\
+{									\
+	unsigned long sum = 0;						\
+	int cpu;							\
+									\
+	for_each_possible_cpu(cpu)					\
+		sum += per_cpu(irqpredict_devices, cpu).stats._name;	\
+	return sprintf(buf, "%lu\n", sum);				\
+}									\
+static SYSDEV_CLASS_ATTR(_name, 0444, show_##_name, NULL)
+
+define_show_stat(entries);
+define_show_stat(hits);
+define_show_stat(too_deep);
+define_show_stat(too_shallow);
+define_show_stat(demoted);
+define_show_stat(irq_hits);
+define_show_stat(irq_misses);
+
+static ssize_t show_irq_history(struct sysdev_class *class,
+				struct sysdev_class_attribute *attr,
+				char *buf)
+{
+	ssize_t len;
+	int i;
+
+	len = sprintf(buf, "irq period_us dev_us samples periodic\n");
+	for (i = 0; i < NR_IRQS; i++) {
+		struct irq_history *h = &irq_history[i];
+
+		if (h->samples < MIN_SAMPLES)
+			continue;
+		if (len >= PAGE_SIZE - 64)
+			break;
+		len += sprintf(buf + len, "%d %u %u %u %d\n", i, h->period_us,
+			       h->dev_us, h->samples,
+			       test_bit(i, irq_regular) ? 1 : 0);
+	}
+
+	return len;
+}
+static SYSDEV_CLASS_ATTR(irq_history, 0444, show_irq_history, NULL);
+
+static struct attribute *irqpredict_attrs[] = {
+	&attr_entries.attr,
+	&attr_hits.attr,
+	&attr_too_deep.attr,
+	&attr_too_shallow.attr,
+	&attr_demoted.attr,
+	&attr_irq_hits.attr,
+	&attr_irq_misses.attr,
+	&attr_irq_history.attr,
+	NULL
+};
+
+static struct attribute_group irqpredict_attr_group = {
+	.attrs = irqpredict_attrs,
+	.name = "irqpredict",
+};
+
+/**
+ * init_irqpredict - initializes the governor
+ */
+static int __init init_irqpredict(void)
+{
+	int ret;
+
+	ret = sysfs_create_group(&cpu_sysdev_class.kset.kobj,
+				 &irqpredict_attr_group);
+	if (ret)
+		return ret;
+
+	return cpuidle_register_governor(&irqpredict_governor);
+}
+
+/**
+ * exit_irqpredict - exits the governor
+ */
+static void __exit exit_irqpredict(void)
+{
+	cpuidle_unregister_governor(&irqpredict_governor);
+	sysfs_remove_group(&cpu_sysdev_class.kset.kobj,
+			   &irqpredict_attr_group);
+}
+
+MODULE_LICENSE("GPL");
+module_init(init_irqpredict);
+module_exit(exit_irqpredict);
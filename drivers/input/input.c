@@ -28,6 +28,11 @@
 #include <linux/rcupdate.h>
 #include "input-compat.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/input.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(input_touch_irq);
+
 MODULE_AUTHOR("Vojtech Pavlik <vojtech@suse.cz>");
 MODULE_DESCRIPTION("Input core");
 MODULE_LICENSE("GPL");
@@ -230,6 +235,7 @@ static void input_handle_event(struct input_dev *dev,
 			if (!dev->sync) {
 				dev->sync = true;
 				disposition = INPUT_PASS_TO_HANDLERS;
+				trace_input_sync(dev);
 			}
 			break;
 		case SYN_MT_REPORT:
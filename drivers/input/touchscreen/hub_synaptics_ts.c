@@ -24,6 +24,7 @@
 #include <linux/hrtimer.h>
 #include <linux/i2c.h>
 #include <linux/input.h>
+#include <linux/input/mt.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/platform_device.h>
@@ -36,6 +37,11 @@
 #include <linux/wakelock.h>
 
 #include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/math64.h>
+#include <trace/events/input.h>
 
 #include <../../../arch/arm/mach-omap2/mux.h>
 
@@ -61,7 +67,6 @@
 #define FEATURE_LGE_TOUCH_GHOST_FINGER_IMPROVE
 #define FEATURE_LGE_TOUCH_GRIP_SUPPRESSION
 
-#define FEATURE_LGE_TOUCH_REAL_TIME_WORK_QUEUE
 #define FEATURE_LGE_TOUCH_ESD_DETECT
 
 #define TS_DEBUG	0
@@ -73,7 +78,6 @@ This section contains definitions for constants, macros, types, variables
 and other items needed by this module.
 ===========================================================================*/
 
-static struct workqueue_struct *synaptics_wq;
 static struct i2c_client *hub_ts_client = NULL;
 
 struct synaptics_ts_priv {
@@ -83,7 +87,9 @@ struct synaptics_ts_priv {
 	int use_irq;
 	bool has_relative_report;
 	struct hrtimer timer;
-	struct work_struct  work;
+	struct work_struct  work;	/* polling mode only */
+	ktime_t irq_time;		/* set by the hard irq handler */
+	struct dentry *debugfs;
 	uint16_t max[2];
 
 	uint32_t flags;
@@ -487,7 +493,6 @@ static void synaptics_ts_initialize(struct work_struct *work)
 	return;
 }
 
-static u8 dummy;
 static u8 ts_esd_detect_flag=0;
 static u8 ts_esd_reset=0;
 static u8 ts_recovery_count=0;
@@ -565,7 +570,6 @@ DEVICE_ATTR(gripsuppression, 0666, touch_gripsuppression_show, touch_gripsuppres
 
 static u8 ts_i=0;
 static u8 finger_count=0;
-static u8 ts_ret=0;
 static u8 ts_finger=0;
 static u8 ghost_count=0;
 static int ts_check=0;
@@ -604,13 +608,83 @@ static void synaptics_work_debug(unsigned int x_pos, unsigned int y_pos, int typ
 }
 #endif	//#if TS_DEBUG
 
+/*
+ * IRQ to input_sync latency histogram, in TS_LATENCY_BUCKET_US wide
+ * buckets, the last one counting everything slower.
+ */
+#define TS_LATENCY_BUCKET_US	500
+#define TS_LATENCY_BUCKETS		21
+
+static struct {
+	spinlock_t lock;
+	unsigned long bucket[TS_LATENCY_BUCKETS];
+	unsigned long frames;
+	u64 total_us;
+	u32 max_us;
+} ts_latency = {
+	.lock = __SPIN_LOCK_UNLOCKED(ts_latency.lock),
+};
+
+static void synaptics_ts_latency_record(ktime_t irq_time)
+{
+	u32 us = ktime_us_delta(ktime_get(), irq_time);
+	unsigned long flags;
+
+	spin_lock_irqsave(&ts_latency.lock, flags);
+	ts_latency.bucket[min_t(u32, us / TS_LATENCY_BUCKET_US,
+				TS_LATENCY_BUCKETS - 1)]++;
+	ts_latency.frames++;
+	ts_latency.total_us += us;
+	if (us > ts_latency.max_us)
+		ts_latency.max_us = us;
+	spin_unlock_irqrestore(&ts_latency.lock, flags);
+}
+
+/* Reads the status and all finger registers in one burst */
+static int synaptics_ts_read_data(struct i2c_client *client)
+{
+	u8 reg = SYNAPTICS_DATA_BASE_REG;
+	struct i2c_msg msg[2] = {
+		{
+			.addr	= client->addr,
+			.flags	= 0,
+			.len	= 1,
+			.buf	= &reg,
+		},
+		{
+			.addr	= client->addr,
+			.flags	= I2C_M_RD,
+			.len	= sizeof(ts_reg_data),
+			.buf	= (u8 *)&ts_reg_data,
+		},
+	};
+	int ret;
+
+	ret = i2c_transfer(client->adapter, msg, ARRAY_SIZE(msg));
+	if (ret != ARRAY_SIZE(msg))
+		return ret < 0 ? ret : -EIO;
+
+	return 0;
+}
+
+/* Reports finger @i in its own slot, and marks it as seen in @active */
+static void synaptics_ts_report_finger(int i, unsigned long *active)
+{
+	input_mt_slot(p_ts->input_dev, i);
+	input_mt_report_slot_state(p_ts->input_dev, MT_TOOL_FINGER, true);
+	input_report_abs(p_ts->input_dev, ABS_MT_POSITION_X, curr_ts_data.X_position[i]);
+	input_report_abs(p_ts->input_dev, ABS_MT_POSITION_Y, curr_ts_data.Y_position[i]);
+	input_report_abs(p_ts->input_dev, ABS_MT_TOUCH_MAJOR, curr_ts_data.pressure[i]);
+	input_report_abs(p_ts->input_dev, ABS_MT_WIDTH_MAJOR, curr_ts_data.width[i]);
+	__set_bit(i, active);
+}
+
 static void touch_reinitialize(void);
-static void synaptics_ts_work_func(struct work_struct *work)
+static void synaptics_ts_report(void)
 {
 	static bool press_flag = false;
-	int touch_cnt = 0;
-	int ret = -1;
-	p_ts = container_of(work, struct synaptics_ts_priv, work);
+	unsigned long active = 0;
+	int ret;
 
 
 //--[[ LGE_UBIQUIX_MODIFIED_START : shyun@ubiquix.com [2011.09.09] - Merge from Black_Froyo MR Ver.
@@ -619,9 +693,11 @@ do
 {
 #endif
 //--]] LGE_UBIQUIX_MODIFIED_END : shyun@ubiquix.com [2011.09.09]- Merge from Black_Froyo MR Ver.
-	ts_ret = i2c_smbus_read_i2c_block_data(p_ts->client, SYNAPTICS_DATA_BASE_REG, sizeof(ts_reg_data), (u8 *)&ts_reg_data);
-	if(ts_ret < 0)
-		printk("[SHYUN] [%s-%d] i2c_error [ret = %d]!\n",__func__, __LINE__, ts_ret);
+	ret = synaptics_ts_read_data(p_ts->client);
+	if(ret) {
+		printk("[SHYUN] [%s-%d] i2c_error [ret = %d]!\n",__func__, __LINE__, ret);
+		return;
+	}
 
 		for(ts_i = 0; ts_i < SYNAPTICS_FINGER_MAX; ts_i++)
 		{
@@ -691,12 +767,7 @@ do
 					{
 						if(curr_ts_data.Y_position[ts_i] < SYNAPTICS_PANEL_LCD_MAX_Y)
 						{
-							input_report_abs(p_ts->input_dev, ABS_MT_POSITION_X, curr_ts_data.X_position[ts_i]);
-							input_report_abs(p_ts->input_dev, ABS_MT_POSITION_Y, curr_ts_data.Y_position[ts_i]);
-							input_report_abs(p_ts->input_dev, ABS_MT_TOUCH_MAJOR, curr_ts_data.pressure[ts_i]);
-							input_report_abs(p_ts->input_dev, ABS_MT_WIDTH_MAJOR, curr_ts_data.width[ts_i]);
-							input_report_key(p_ts->input_dev, BTN_TOUCH, true);
-							input_mt_sync(p_ts->input_dev);
+							synaptics_ts_report_finger(ts_i, &active);
 #if TS_DEBUG
 							synaptics_work_debug(curr_ts_data.X_position[ts_i], curr_ts_data.Y_position[ts_i], TYPE_WORK_DEBUG);
 #endif
@@ -826,13 +897,7 @@ do
 								}
 							}
 
-								input_report_abs(p_ts->input_dev, ABS_MT_POSITION_X, curr_ts_data.X_position[ts_i]);
-								input_report_abs(p_ts->input_dev, ABS_MT_POSITION_Y, curr_ts_data.Y_position[ts_i]);
-								input_report_abs(p_ts->input_dev, ABS_MT_TOUCH_MAJOR, curr_ts_data.pressure[ts_i]);
-								input_report_abs(p_ts->input_dev, ABS_MT_WIDTH_MAJOR, curr_ts_data.width[ts_i]);
-								input_report_key(p_ts->input_dev, BTN_TOUCH, true);								
-
-								input_mt_sync(p_ts->input_dev);
+								synaptics_ts_report_finger(ts_i, &active);
 #if TS_DEBUG
 								synaptics_work_debug(curr_ts_data.X_position[ts_i], curr_ts_data.Y_position[ts_i], TYPE_WORK_DEBUG);
 #endif
@@ -864,13 +929,7 @@ do
 
 					if(curr_ts_data.Y_position[ts_i] < SYNAPTICS_PANEL_LCD_MAX_Y)
 					{
-						input_report_abs(p_ts->input_dev, ABS_MT_POSITION_X, curr_ts_data.X_position[ts_i]);
-						input_report_abs(p_ts->input_dev, ABS_MT_POSITION_Y, curr_ts_data.Y_position[ts_i]);
-						input_report_abs(p_ts->input_dev, ABS_MT_TOUCH_MAJOR, curr_ts_data.pressure[ts_i]);
-						input_report_abs(p_ts->input_dev, ABS_MT_WIDTH_MAJOR, curr_ts_data.width[ts_i]);
-						input_report_key(p_ts->input_dev, BTN_TOUCH, true);						
-
-						input_mt_sync(p_ts->input_dev);
+						synaptics_ts_report_finger(ts_i, &active);
 #if TS_DEBUG
 						synaptics_work_debug(curr_ts_data.X_position[ts_i], curr_ts_data.Y_position[ts_i], TYPE_WORK_DEBUG);
 #endif
@@ -984,9 +1043,20 @@ do
 		}
 #endif
 	finger_count=0;
-	input_mt_sync(p_ts->input_dev);
+	for (ts_i = 0; ts_i < SYNAPTICS_FINGER_MAX; ts_i++) {
+		if (test_bit(ts_i, &active))
+			continue;
+		input_mt_slot(p_ts->input_dev, ts_i);
+		input_mt_report_slot_state(p_ts->input_dev, MT_TOOL_FINGER, false);
+	}
+	input_mt_report_pointer_emulation(p_ts->input_dev, false);
 	input_sync(p_ts->input_dev);
 
+	if (p_ts->irq_time.tv64) {
+		synaptics_ts_latency_record(p_ts->irq_time);
+		p_ts->irq_time.tv64 = 0;
+	}
+
 	//printk("[touch](%d, %d),(%d, %d) melt_mode=%d, esd=%d\n", curr_ts_data.X_position[0], curr_ts_data.Y_position[0],curr_ts_data.X_position[1], curr_ts_data.Y_position[1],!melt_mode,ts_esd_reset);
 //--[[ LGE_UBIQUIX_MODIFIED_START : shyun@ubiquix.com [2011.09.09] - Merge from Black_Froyo MR Ver.
 #if 0
@@ -1012,48 +1082,6 @@ do
 //	if(init_stabled && !key_led_flag)	bd2802_touch_on();
 //--]] LGE_UBIQUIX_MODIFIED_END : shyun@ubiquix.com [2012.04.02]- Do not Turn on Keyled in Kernel.
 	
-//--[[ LGE_UBIQUIX_MODIFIED_START : shyun@ubiquix.com [2011.09.09] - Merge from Black_Froyo MR Ver.
-#if 0
-	for(ts_ret=0;ts_ret<100;ts_ret++)
-	{
-		if(!gpio_get_value(TOUCH_INT_N_GPIO))	 i2c_smbus_read_i2c_block_data(p_ts->client, 0x14, 1, &dummy);
-		else									 break;
-	}
-	if(ts_ret>=100)	
-	{ 
-		printk("[touch] TOUCH_INT_N_GPIO is LOW. touch lock up!!\n");
-		touch_reinitialize();
-		printk("[touch] TOUCH LockUP Fixed!!\n");
-	}
-#else
-//--[[ LGE_UBIQUIX_MODIFIED_START : shyun@ubiquix.com [2012.08.21] - Touch lock-up fix process.
-	for(touch_cnt = 0;touch_cnt <= 100;touch_cnt++)
-	{
-		if(touch_cnt == 100) {
-			printk("[touch] TOUCH_INT_N_GPIO is LOW. touch lock up!!\n");
-			touch_reinitialize();
-			printk("[touch] TOUCH LockUP Fixed!!\n");
-
-			touch_cnt = 0;
-
-			break;
-		}
-
-		if(!gpio_get_value(TOUCH_INT_N_GPIO)) {
-			ret = i2c_smbus_read_i2c_block_data(p_ts->client, 0x14, 1, &dummy);
-			if(ret < 0)
-				printk("[SHYUN] [%s-%d] i2c_error! [ret = %d]\n",__func__, __LINE__, ret);
-
-			touch_cnt++;
-		}
-		else {
-			break;
-		}
-	}
-//--]] LGE_UBIQUIX_MODIFIED_END : shyun@ubiquix.com [2012.08.21]- Touch lock-up fix process.
-#endif
-//--]] LGE_UBIQUIX_MODIFIED_END : shyun@ubiquix.com [2011.09.09]- Merge from Black_Froyo MR Ver.
-
 	memset(&curr_ts_data, 0x0, sizeof(ts_finger_data));
 //--[[ LGE_UBIQUIX_MODIFIED_START : shyun@ubiquix.com [2011.09.09] - Merge from Black_Froyo MR Ver.
 #if 0
@@ -1061,18 +1089,18 @@ do
 while(!gpio_get_value(TOUCH_INT_N_GPIO));
 #endif
 //--]] LGE_UBIQUIX_MODIFIED_END : shyun@ubiquix.com [2011.09.09]- Merge from Black_Froyo MR Ver.
+}
 
-SYNAPTICS_TS_IDLE:
-	if (p_ts->use_irq) {
-		enable_irq(p_ts->client->irq);
-	}
+static void synaptics_ts_work_func(struct work_struct *work)
+{
+	synaptics_ts_report();
 }
 
 static enum hrtimer_restart synaptics_ts_timer_func(struct hrtimer *timer)
 {
 	struct synaptics_ts_priv *ts = container_of(timer, struct synaptics_ts_priv, timer);
 
-	queue_work(synaptics_wq, &ts->work);
+	schedule_work(&ts->work);
 	hrtimer_start(&ts->timer, ktime_set(0, 12500000), HRTIMER_MODE_REL); /* 12.5 msec */
 
 	return HRTIMER_NORESTART;
@@ -1080,8 +1108,11 @@ static enum hrtimer_restart synaptics_ts_timer_func(struct hrtimer *timer)
 
 static irqreturn_t synaptics_ts_irq_handler(int irq, void *dev_id)
 {
+	struct synaptics_ts_priv *ts = dev_id;
+
 	//pr_info("LGE: synaptics_ts_irq_handler\n");
-	disable_irq_nosync(p_ts->client->irq);
+	ts->irq_time = ktime_get();
+	trace_input_touch_irq(ts->input_dev);
 
 /* 20110331 sookyoung.kim@lge.com LG-DVFS [START_LGE] */
 /* Move this code later to somewhere common, such as the irq entry point.
@@ -1109,10 +1140,106 @@ static irqreturn_t synaptics_ts_irq_handler(int irq, void *dev_id)
 	synaptics_work_debug(DUMMY_X_POS, DUMMY_X_POS, TYPE_IRQ_DEBUG);
 #endif	
 
-	queue_work(synaptics_wq, &p_ts->work);
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * The interrupt is edge triggered, so the line going low again while a
+ * frame is being read would be missed. Keep reading frames for as long as
+ * it stays low, the read clears the interrupt status. A line stuck low
+ * means the controller locked up.
+ */
+static irqreturn_t synaptics_ts_irq_thread(int irq, void *dev_id)
+{
+	int frames = 0;
+
+	do {
+		synaptics_ts_report();
+		if (gpio_get_value(TOUCH_INT_N_GPIO))
+			return IRQ_HANDLED;
+	} while (++frames < 100);
+
+	printk("[touch] TOUCH_INT_N_GPIO is LOW. touch lock up!!\n");
+	touch_reinitialize();
+	printk("[touch] TOUCH LockUP Fixed!!\n");
+
 	return IRQ_HANDLED;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int synaptics_ts_latency_show(struct seq_file *s, void *unused)
+{
+	unsigned long bucket[TS_LATENCY_BUCKETS];
+	unsigned long frames, flags;
+	u64 total_us;
+	u32 max_us;
+	int i;
+
+	spin_lock_irqsave(&ts_latency.lock, flags);
+	memcpy(bucket, ts_latency.bucket, sizeof(bucket));
+	frames = ts_latency.frames;
+	total_us = ts_latency.total_us;
+	max_us = ts_latency.max_us;
+	spin_unlock_irqrestore(&ts_latency.lock, flags);
+
+	seq_printf(s, "frames: %lu\n", frames);
+	seq_printf(s, "avg_us: %llu\n",
+		   frames ? div_u64(total_us, frames) : 0);
+	seq_printf(s, "max_us: %u\n", max_us);
+	for (i = 0; i < TS_LATENCY_BUCKETS - 1; i++)
+		seq_printf(s, "%5u-%5u us: %lu\n", i * TS_LATENCY_BUCKET_US,
+			   (i + 1) * TS_LATENCY_BUCKET_US - 1, bucket[i]);
+	seq_printf(s, "%5u+       us: %lu\n", i * TS_LATENCY_BUCKET_US,
+		   bucket[i]);
+
+	return 0;
+}
+
+static int synaptics_ts_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, synaptics_ts_latency_show, inode->i_private);
+}
+
+/* any write clears the histogram */
+static ssize_t synaptics_ts_latency_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ts_latency.lock, flags);
+	memset(ts_latency.bucket, 0, sizeof(ts_latency.bucket));
+	ts_latency.frames = 0;
+	ts_latency.total_us = 0;
+	ts_latency.max_us = 0;
+	spin_unlock_irqrestore(&ts_latency.lock, flags);
+
+	return count;
+}
+
+static const struct file_operations synaptics_ts_latency_fops = {
+	.open		= synaptics_ts_latency_open,
+	.read		= seq_read,
+	.write		= synaptics_ts_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void synaptics_ts_debugfs_init(struct synaptics_ts_priv *ts)
+{
+	ts->debugfs = debugfs_create_dir("hub_synaptics_ts", NULL);
+	if (IS_ERR_OR_NULL(ts->debugfs)) {
+		ts->debugfs = NULL;
+		return;
+	}
+	debugfs_create_file("latency", S_IRUGO | S_IWUSR, ts->debugfs, ts,
+			    &synaptics_ts_latency_fops);
+}
+#else
+static inline void synaptics_ts_debugfs_init(struct synaptics_ts_priv *ts)
+{
+}
+#endif
+
 
 static unsigned char synaptics_ts_check_fwver(struct i2c_client *client)
 {
@@ -1972,6 +2099,7 @@ static int synaptics_ts_probe(struct i2c_client *client, const struct i2c_device
 	input_set_abs_params(p_ts->input_dev, ABS_MT_POSITION_Y, 0, max_y, 0, 0);
 	input_set_abs_params(p_ts->input_dev, ABS_MT_TOUCH_MAJOR, 0, max_pressure, 0, 0);
 	input_set_abs_params(p_ts->input_dev, ABS_MT_WIDTH_MAJOR, 0, max_width, 0, 0);
+	input_mt_init_slots(p_ts->input_dev, SYNAPTICS_FINGER_MAX);
 
 	pr_info("synaptics_ts_probe: max_x %d, max_y %d\n", max_x, max_y);
 
@@ -1986,14 +2114,17 @@ static int synaptics_ts_probe(struct i2c_client *client, const struct i2c_device
 	i2c_smbus_write_byte_data(hub_ts_client, SYNAPTICS_RIM_CONTROL_INTERRUPT_ENABLE, 0x00); //interrupt disable
 
 	if (client->irq) {
-		ret = request_irq(client->irq, synaptics_ts_irq_handler, IRQF_TRIGGER_FALLING, client->name, p_ts);
+		ret = request_threaded_irq(client->irq, synaptics_ts_irq_handler,
+					   synaptics_ts_irq_thread,
+					   IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
+					   client->name, p_ts);
 
 		if (ret == 0) {
 			p_ts->use_irq = 1;
-			pr_warning("request_irq\n");
+			pr_warning("request_threaded_irq\n");
 			}
 		else
-			dev_err(&client->dev, "request_irq failed\n");
+			dev_err(&client->dev, "request_threaded_irq failed\n");
 	}
 	if (!p_ts->use_irq) {
 		hrtimer_init(&p_ts->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
@@ -2008,6 +2139,8 @@ static int synaptics_ts_probe(struct i2c_client *client, const struct i2c_device
 		return ret;
 	}
 
+	synaptics_ts_debugfs_init(p_ts);
+
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	p_ts->early_suspend.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN - 1;
 	p_ts->early_suspend.suspend = synaptics_ts_early_suspend;
@@ -2056,11 +2189,14 @@ static int synaptics_ts_remove(struct i2c_client *client)
 	device_remove_file(&client->dev, &dev_attr_gripsuppression);
 #endif
 
+	debugfs_remove_recursive(p_ts->debugfs);
 	unregister_early_suspend(&p_ts->early_suspend);
 	if (p_ts->use_irq)
 		free_irq(client->irq, p_ts);
-	else
+	else {
 		hrtimer_cancel(&p_ts->timer);
+		cancel_work_sync(&p_ts->work);
+	}
 	input_unregister_device(p_ts->input_dev);
 	kfree(p_ts);
 	return 0;
@@ -2068,23 +2204,20 @@ static int synaptics_ts_remove(struct i2c_client *client)
 
 static int synaptics_ts_suspend(struct i2c_client *client, pm_message_t mesg)
 {
-	int ret;
-
 	printk("[SHYUN] [%s] - [%d] [Cancel delayed work]\n", __func__, __LINE__);
 
 	init_stabled = 0;
 
+	/* disable_irq() also waits for the irq thread to finish */
 	if (p_ts->use_irq)
 		disable_irq(client->irq);
-	else
+	else {
 		hrtimer_cancel(&p_ts->timer);
+		cancel_work_sync(&p_ts->work);
+	}
 
-	ret = cancel_work_sync(&p_ts->work);
 	cancel_delayed_work_sync(&p_ts->init_delayed_work);
 
-	//if (ret && p_ts->use_irq) /* if work was pending disable-count is now 2 */
-	//	enable_irq(client->irq);
-
 #ifdef FEATURE_LGE_TOUCH_GHOST_FINGER_IMPROVE
 	melt_mode = 0;
 	ghost_finger_1 = 0;
@@ -2188,25 +2321,13 @@ static struct i2c_driver synaptics_ts_driver = {
 
 static int __devinit synaptics_ts_init(void)
 {
-#ifdef FEATURE_LGE_TOUCH_REAL_TIME_WORK_QUEUE
-//	synaptics_wq = create_rt_workqueue("synaptics_wq");
-	synaptics_wq = alloc_workqueue("synaptics_wq", WQ_MEM_RECLAIM | WQ_HIGHPRI | WQ_CPU_INTENSIVE, 1);
-#else
-	synaptics_wq = create_singlethread_workqueue("synaptics_wq");
-#endif
-
    	pr_warning("LGE: Synaptics ts_init\n");
-	if (!synaptics_wq)
-		return -ENOMEM;
 	return i2c_add_driver(&synaptics_ts_driver);
 }
 
 static void __exit synaptics_ts_exit(void)
 {
 	i2c_del_driver(&synaptics_ts_driver);
-
-	if (synaptics_wq)
-		destroy_workqueue(synaptics_wq);
 }
 
 module_init(synaptics_ts_init);
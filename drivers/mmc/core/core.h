@@ -73,5 +73,7 @@ void mmc_remove_host_debugfs(struct mmc_host *host);
 void mmc_add_card_debugfs(struct mmc_card *card);
 void mmc_remove_card_debugfs(struct mmc_card *card);
 
+void mmc_lat_stats_account(struct mmc_host *host, struct mmc_request *mrq);
+
 #endif
 
@@ -12,6 +12,7 @@
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/stat.h>
+#include <linux/uaccess.h>
 
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
@@ -161,6 +162,178 @@ static int mmc_clock_opt_set(void *data, u64 val)
 DEFINE_SIMPLE_ATTRIBUTE(mmc_clock_fops, mmc_clock_opt_get, mmc_clock_opt_set,
 	"%llu\n");
 
+/*
+ * Request latency, from mmc_start_request() to mmc_request_done(), in
+ * log2 buckets of microseconds: bucket i counts latencies below 2^i us
+ * and at least 2^(i-1) us, the last one everything slower. Kept by
+ * opcode, and for data requests by direction and log2 of the size.
+ */
+#define MMC_LAT_BUCKETS		20
+#define MMC_LAT_SIZES		12	/* <512 bytes .. >= 512K */
+
+struct mmc_lat_stats {
+	spinlock_t	lock;
+	bool		enabled;
+	u32		by_opcode[64][MMC_LAT_BUCKETS];
+	u32		by_size[2][MMC_LAT_SIZES][MMC_LAT_BUCKETS];
+	u64		bytes[2];
+	u64		time_us[2];
+};
+
+void mmc_lat_stats_account(struct mmc_host *host, struct mmc_request *mrq)
+{
+	struct mmc_lat_stats *stats = host->lat_stats;
+	struct mmc_data *data = mrq->data;
+	unsigned long flags;
+	unsigned int us;
+	int lat, size, dir;
+
+	us = ktime_us_delta(ktime_get(), mrq->io_start);
+	lat = min(fls(us), MMC_LAT_BUCKETS - 1);
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (!stats->enabled)
+		goto out;
+
+	stats->by_opcode[mrq->cmd->opcode & 63][lat]++;
+	if (data) {
+		dir = !!(data->flags & MMC_DATA_WRITE);
+		size = min(fls((data->blocks * data->blksz) >> 9),
+			   MMC_LAT_SIZES - 1);
+		stats->by_size[dir][size][lat]++;
+		stats->bytes[dir] += data->bytes_xfered;
+		stats->time_us[dir] += us;
+	}
+ out:
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
+static void mmc_lat_print_row(struct seq_file *s, const char *label,
+			      const u32 *row)
+{
+	int i;
+
+	for (i = 0; i < MMC_LAT_BUCKETS; i++)
+		if (row[i])
+			break;
+	if (i == MMC_LAT_BUCKETS)
+		return;
+
+	seq_printf(s, "%-10s", label);
+	for (i = 0; i < MMC_LAT_BUCKETS; i++)
+		seq_printf(s, " %6u", row[i]);
+	seq_printf(s, "\n");
+}
+
+static int mmc_lat_stats_show(struct seq_file *s, void *data)
+{
+	static const char *dir_str[2] = { "read", "write" };
+	struct mmc_host *host = s->private;
+	struct mmc_lat_stats *stats;
+	unsigned long flags;
+	char label[16];
+	int i, j;
+
+	/* work on a copy, the counters are updated from interrupts */
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+	spin_lock_irqsave(&host->lat_stats->lock, flags);
+	memcpy(stats, host->lat_stats, sizeof(*stats));
+	spin_unlock_irqrestore(&host->lat_stats->lock, flags);
+
+	seq_printf(s, "enabled: %d\n\n", stats->enabled);
+
+	seq_printf(s, "%-10s", "< us");
+	for (i = 0; i < MMC_LAT_BUCKETS - 1; i++)
+		seq_printf(s, " %6u", 1 << i);
+	seq_printf(s, " %6s\n", "more");
+
+	for (i = 0; i < 64; i++) {
+		snprintf(label, sizeof(label), "CMD%d", i);
+		mmc_lat_print_row(s, label, stats->by_opcode[i]);
+	}
+
+	seq_printf(s, "\n");
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < MMC_LAT_SIZES; j++) {
+			/* lower bound of the size bucket */
+			if (j == 0)
+				snprintf(label, sizeof(label), "%s <512",
+					 dir_str[i]);
+			else if (j == 1)
+				snprintf(label, sizeof(label), "%s 512",
+					 dir_str[i]);
+			else
+				snprintf(label, sizeof(label), "%s %uK",
+					 dir_str[i], 1 << (j - 2));
+			mmc_lat_print_row(s, label, stats->by_size[i][j]);
+		}
+	}
+
+	seq_printf(s, "\n");
+	for (i = 0; i < 2; i++) {
+		u64 kbps = stats->bytes[i] * 1000;
+
+		if (stats->time_us[i])
+			do_div(kbps, stats->time_us[i]);
+		else
+			kbps = 0;
+		seq_printf(s, "%-5s %llu bytes in %llu us, %llu KB/s\n",
+			   dir_str[i], (unsigned long long)stats->bytes[i],
+			   (unsigned long long)stats->time_us[i],
+			   (unsigned long long)kbps);
+	}
+
+	kfree(stats);
+	return 0;
+}
+
+static int mmc_lat_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_lat_stats_show, inode->i_private);
+}
+
+/* Writing 1 clears the histograms and starts collecting, 0 stops. */
+static ssize_t mmc_lat_stats_write(struct file *filp, const char __user *ubuf,
+				   size_t cnt, loff_t *ppos)
+{
+	struct seq_file *s = filp->private_data;
+	struct mmc_host *host = s->private;
+	struct mmc_lat_stats *stats = host->lat_stats;
+	unsigned long flags, val;
+	char buf[8];
+
+	if (cnt >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, cnt))
+		return -EFAULT;
+	buf[cnt] = '\0';
+
+	if (strict_strtoul(strstrip(buf), 10, &val))
+		return -EINVAL;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (val) {
+		memset(stats->by_opcode, 0, sizeof(stats->by_opcode));
+		memset(stats->by_size, 0, sizeof(stats->by_size));
+		memset(stats->bytes, 0, sizeof(stats->bytes));
+		memset(stats->time_us, 0, sizeof(stats->time_us));
+	}
+	stats->enabled = !!val;
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_lat_stats_fops = {
+	.open		= mmc_lat_stats_open,
+	.read		= seq_read,
+	.write		= mmc_lat_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_host_debugfs(struct mmc_host *host)
 {
 	struct dentry *root;
@@ -188,9 +361,21 @@ void mmc_add_host_debugfs(struct mmc_host *host)
 				root, &host->clk_delay))
 		goto err_node;
 #endif
+
+	/* stays around, disabled, until enabled through the file */
+	host->lat_stats = kzalloc(sizeof(*host->lat_stats), GFP_KERNEL);
+	if (!host->lat_stats)
+		goto err_node;
+	spin_lock_init(&host->lat_stats->lock);
+
+	if (!debugfs_create_file("latency", S_IRUSR | S_IWUSR, root, host,
+			&mmc_lat_stats_fops))
+		goto err_node;
 	return;
 
 err_node:
+	kfree(host->lat_stats);
+	host->lat_stats = NULL;
 	debugfs_remove_recursive(root);
 	host->debugfs_root = NULL;
 err_root:
@@ -200,6 +385,8 @@ err_root:
 void mmc_remove_host_debugfs(struct mmc_host *host)
 {
 	debugfs_remove_recursive(host->debugfs_root);
+	kfree(host->lat_stats);
+	host->lat_stats = NULL;
 }
 
 static int mmc_dbg_card_status_get(void *data, u64 *val)
@@ -284,6 +471,94 @@ static const struct file_operations mmc_dbg_ext_csd_fops = {
 	.llseek		= default_llseek,
 };
 
+static const char *mmc_pack_stop_str[MMC_PACK_STOP_REASONS] = {
+	[MMC_PACK_STOP_SEGMENTS]	= "exceeds max segments",
+	[MMC_PACK_STOP_SECTORS]		= "exceeds max sectors",
+	[MMC_PACK_STOP_DATA_DIR]	= "read request",
+	[MMC_PACK_STOP_FLUSH_DISCARD]	= "flush or discard",
+	[MMC_PACK_STOP_EMPTY_QUEUE]	= "empty queue",
+	[MMC_PACK_STOP_REL_WRITE]	= "legacy reliable write",
+	[MMC_PACK_STOP_MAX_COUNT]	= "max packed count",
+};
+
+static int mmc_wr_pack_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_card *card = s->private;
+	struct mmc_wr_pack_stats *stats = &card->wr_pack_stats;
+	u32 events[MMC_PACKED_NR_MAX + 1];
+	u32 reasons[MMC_PACK_STOP_REASONS];
+	bool enabled;
+	int i;
+
+	spin_lock(&stats->lock);
+	memcpy(events, stats->packing_events, sizeof(events));
+	memcpy(reasons, stats->pack_stop_reason, sizeof(reasons));
+	enabled = stats->enabled;
+	spin_unlock(&stats->lock);
+
+	seq_printf(s, "enabled:\t%d\n", enabled);
+	seq_printf(s, "max packed:\t%u\n",
+		   min_t(unsigned int, card->ext_csd.max_packed_writes,
+			 MMC_PACKED_NR_MAX));
+
+	seq_printf(s, "\nwrites issued as a group of N requests:\n");
+	for (i = 1; i <= MMC_PACKED_NR_MAX; i++)
+		if (events[i])
+			seq_printf(s, "%2d:\t%u\n", i, events[i]);
+
+	seq_printf(s, "\npacking stopped by:\n");
+	for (i = 0; i < MMC_PACK_STOP_REASONS; i++)
+		seq_printf(s, "%-24s%u\n", mmc_pack_stop_str[i], reasons[i]);
+
+	return 0;
+}
+
+static int mmc_wr_pack_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_wr_pack_stats_show, inode->i_private);
+}
+
+/* Writing 1 clears the counters and starts counting, 0 stops counting. */
+static ssize_t mmc_wr_pack_stats_write(struct file *filp,
+				       const char __user *ubuf, size_t cnt,
+				       loff_t *ppos)
+{
+	struct seq_file *s = filp->private_data;
+	struct mmc_card *card = s->private;
+	struct mmc_wr_pack_stats *stats = &card->wr_pack_stats;
+	unsigned long val;
+	char buf[8];
+
+	if (cnt >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, cnt))
+		return -EFAULT;
+	buf[cnt] = '\0';
+
+	if (strict_strtoul(strstrip(buf), 10, &val))
+		return -EINVAL;
+
+	spin_lock(&stats->lock);
+	if (val) {
+		memset(stats->packing_events, 0,
+		       sizeof(stats->packing_events));
+		memset(stats->pack_stop_reason, 0,
+		       sizeof(stats->pack_stop_reason));
+	}
+	stats->enabled = !!val;
+	spin_unlock(&stats->lock);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_wr_pack_stats_fops = {
+	.open		= mmc_wr_pack_stats_open,
+	.read		= seq_read,
+	.write		= mmc_wr_pack_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_card_debugfs(struct mmc_card *card)
 {
 	struct mmc_host	*host = card->host;
@@ -316,6 +591,12 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					&mmc_dbg_ext_csd_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) && card->ext_csd.packed_event_en)
+		if (!debugfs_create_file("wr_pack_stats", S_IRUSR | S_IWUSR,
+					root, card,
+					&mmc_dbg_wr_pack_stats_fops))
+			goto err;
+
 	return;
 
 err:
@@ -128,6 +128,8 @@
 #define ADMA_TABLE_SZ (PAGE_SIZE)
 #define ADMA_TABLE_NUM_ENTRIES \
 	(ADMA_TABLE_SZ / sizeof(struct adma_desc_table))
+/* One table for the request in flight, one for the next, prepared one */
+#define ADMA_TABLE_COUNT	2
 
 #define SDMA_XFER	1
 #define ADMA_XFER	2
@@ -184,6 +186,25 @@ struct adma_desc_table {
 	dma_addr_t addr;
 };
 
+/*
+ * A data request mapped (and for ADMA, described) by pre_req ahead of
+ * time. data->host_cookie matches 'cookie' while it is still valid.
+ */
+struct omap_hsmmc_next {
+	unsigned int	dma_len;
+	s32		cookie;
+	int		adma_idx;	/* ADMA table built for it */
+};
+
+/* Cost of the power state transitions of one kind, see omap_hsmmc_pm_account */
+struct omap_hsmmc_pm_stat {
+	unsigned int	count;
+	unsigned int	max_us;
+	u64		total_us;
+};
+
+#define OMAP_HSMMC_PM_STATES	5
+
 struct omap_hsmmc_host {
 	struct	device		*dev;
 	struct	mmc_host	*mmc;
@@ -230,6 +251,11 @@ struct omap_hsmmc_host {
 	int			use_reg;
 	int			req_in_progress;
 	unsigned int		flags;
+	struct omap_hsmmc_next	next_data;
+	int			adma_cur;	/* ADMA table being run */
+	/* [from][to] dpm_state */
+	struct omap_hsmmc_pm_stat pm_stats[OMAP_HSMMC_PM_STATES]
+					  [OMAP_HSMMC_PM_STATES];
 
 	struct	omap_mmc_platform_data	*pdata;
 };
@@ -260,6 +286,9 @@ static void omap_hsmmc_status_notify_cb(int card_present, void *dev_id)
 
 static int
 omap_hsmmc_prepare_data(struct omap_hsmmc_host *host, struct mmc_request *req);
+static int omap_hsmmc_pre_dma_transfer(struct omap_hsmmc_host *host,
+				       struct mmc_data *data,
+				       struct omap_hsmmc_next *next);
 
 static int omap_hsmmc_card_detect(struct device *dev, int slot)
 {
@@ -988,8 +1017,9 @@ omap_hsmmc_xfer_done(struct omap_hsmmc_host *host, struct mmc_data *data)
 
 	host->data = NULL;
 
-	if (host->dma_type == ADMA_XFER)
-		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
+	/* prepared requests are unmapped by post_req */
+	if (host->dma_type == ADMA_XFER && !data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
 					omap_hsmmc_get_dma_dir(host, data));
 
 	if (!data->error)
@@ -1068,9 +1098,10 @@ static void omap_hsmmc_dma_cleanup(struct omap_hsmmc_host *host, int errno)
 	spin_unlock(&host->irq_lock);
 
 	if ((host->dma_type == SDMA_XFER) && (dma_ch != -1)) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
-			host->data->sg_len,
-			omap_hsmmc_get_dma_dir(host, host->data));
+		if (!host->data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
+				host->data->sg_len,
+				omap_hsmmc_get_dma_dir(host, host->data));
 		omap_free_dma(dma_ch);
 	}
 	host->data = NULL;
@@ -1484,8 +1515,9 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *cb_data)
 		return;
 	}
 
-	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-		omap_hsmmc_get_dma_dir(host, data));
+	if (!data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+			omap_hsmmc_get_dma_dir(host, data));
 
 	req_in_progress = host->req_in_progress;
 	dma_ch = host->dma_ch;
@@ -1537,8 +1569,11 @@ static int omap_hsmmc_start_sdma_transfer(struct omap_hsmmc_host *host,
 		return ret;
 	}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
+	ret = omap_hsmmc_pre_dma_transfer(host, data, NULL);
+	if (ret) {
+		omap_free_dma(dma_ch);
+		return ret;
+	}
 	host->dma_ch = dma_ch;
 	host->dma_sg_idx = 0;
 
@@ -1548,17 +1583,15 @@ static int omap_hsmmc_start_sdma_transfer(struct omap_hsmmc_host *host,
 }
 
 static int mmc_populate_adma_desc_table(struct omap_hsmmc_host *host,
-		struct mmc_request *req, struct adma_desc_table *pdesc)
+		struct mmc_data *data, unsigned int dma_len,
+		struct adma_desc_table *pdesc)
 {
 	int i, j, dmalen;
 	int splitseg, xferaddr;
 	int numblocks = 0;
 	dma_addr_t dmaaddr;
-	struct mmc_data *data = req->data;
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
-	for (i = 0, j = 0; i < host->dma_len; i++) {
+	for (i = 0, j = 0; i < dma_len; i++) {
 		dmaaddr = sg_dma_address(data->sg + i);
 		dmalen = sg_dma_len(data->sg + i);
 		numblocks += dmalen / data->blksz;
@@ -1596,14 +1629,79 @@ static int mmc_populate_adma_desc_table(struct omap_hsmmc_host *host,
 	WARN_ON((i + j - 1) > ADMA_TABLE_NUM_ENTRIES);
 	dev_dbg(mmc_dev(host->mmc),
 		"ADMA table has %d entries from %d sglist\n",
-		i + j, host->dma_len);
+		i + j, dma_len);
 	return numblocks;
 }
 
+/*
+ * Map the data for DMA and, with ADMA, build its descriptor table. With
+ * 'next' set this is pre_req working ahead on the next request while the
+ * current one may still be transferring; otherwise it is the request
+ * being started, which reuses the work done by pre_req if there was any.
+ *
+ * Two ADMA tables are used. pre_req alternates between them, so the table
+ * of the request in flight is never rewritten. A request that was not
+ * prepared takes the table not reserved by a pending prepared one.
+ */
+static int omap_hsmmc_pre_dma_transfer(struct omap_hsmmc_host *host,
+				       struct mmc_data *data,
+				       struct omap_hsmmc_next *next)
+{
+	unsigned int dma_len;
+	bool prepared;
+	int idx, numblks;
+
+	if (!next && data->host_cookie &&
+	    data->host_cookie != host->next_data.cookie) {
+		dev_warn(mmc_dev(host->mmc), "[%s] invalid cookie: "
+			 "data->host_cookie %d host->next_data.cookie %d\n",
+			 __func__, data->host_cookie, host->next_data.cookie);
+		data->host_cookie = 0;
+	}
+
+	prepared = !next && data->host_cookie;
+	if (prepared) {
+		dma_len = host->next_data.dma_len;
+		idx = host->next_data.adma_idx;
+		host->next_data.dma_len = 0;
+	} else {
+		dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len,
+				     omap_hsmmc_get_dma_dir(host, data));
+		if (next || host->next_data.dma_len)
+			idx = !host->next_data.adma_idx;
+		else
+			idx = host->next_data.adma_idx;
+	}
+
+	if (dma_len == 0)
+		return -EINVAL;
+
+	if (host->dma_type == ADMA_XFER && !prepared) {
+		numblks = mmc_populate_adma_desc_table(host, data, dma_len,
+				host->adma_table + idx * ADMA_TABLE_NUM_ENTRIES);
+		WARN_ON(numblks != data->blocks);
+	}
+
+	if (next) {
+		next->dma_len = dma_len;
+		next->adma_idx = idx;
+		if (++next->cookie <= 0)
+			next->cookie = 1;
+		data->host_cookie = next->cookie;
+	} else {
+		host->dma_len = dma_len;
+		host->adma_cur = idx;
+	}
+
+	return 0;
+}
+
 static void omap_hsmmc_start_adma_transfer(struct omap_hsmmc_host *host)
 {
 	wmb();
-	OMAP_HSMMC_WRITE(host->base, ADMA_SAL, host->phy_adma_table);
+	OMAP_HSMMC_WRITE(host->base, ADMA_SAL, host->phy_adma_table +
+			 host->adma_cur * ADMA_TABLE_SZ);
 }
 
 static void set_data_timeout(struct omap_hsmmc_host *host,
@@ -1650,7 +1748,6 @@ static int
 omap_hsmmc_prepare_data(struct omap_hsmmc_host *host, struct mmc_request *req)
 {
 	int ret;
-	int numblks;
 
 	host->data = req->data;
 
@@ -1676,14 +1773,51 @@ omap_hsmmc_prepare_data(struct omap_hsmmc_host *host, struct mmc_request *req)
 			return ret;
 		}
 	} else if (host->dma_type == ADMA_XFER) {
-		numblks = mmc_populate_adma_desc_table(host,
-				req, host->adma_table);
-		WARN_ON(numblks != req->data->blocks);
+		ret = omap_hsmmc_pre_dma_transfer(host, req->data, NULL);
+		if (ret != 0) {
+			dev_dbg(mmc_dev(host->mmc), "MMC adma map failure\n");
+			return ret;
+		}
 		omap_hsmmc_start_adma_transfer(host);
 	}
 	return 0;
 }
 
+static void omap_hsmmc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				int err)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (host->dma_type && data && data->host_cookie) {
+		/* prepared but never started */
+		if (data->host_cookie == host->next_data.cookie)
+			host->next_data.dma_len = 0;
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+			     omap_hsmmc_get_dma_dir(host, data));
+		data->host_cookie = 0;
+	}
+}
+
+static void omap_hsmmc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			       bool is_first_req)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+
+	if (!mrq->data)
+		return;
+
+	if (mrq->data->host_cookie) {
+		mrq->data->host_cookie = 0;
+		return;
+	}
+
+	if (host->dma_type)
+		if (omap_hsmmc_pre_dma_transfer(host, mrq->data,
+						&host->next_data))
+			mrq->data->host_cookie = 0;
+}
+
 /*
  * Request function. for read/write operation
  */
@@ -1951,6 +2085,28 @@ static void omap_hsmmc_conf_bus_power(struct omap_hsmmc_host *host)
 
 enum {ENABLED = 0, DISABLED, CARDSLEEP, REGSLEEP, OFF};
 
+/*
+ * Account the time taken by a transition handler that started at 'start'
+ * in state 'from'. Waking up from sleep or off is paid by the request
+ * that triggered it, so these are the stalls to look for.
+ */
+static void omap_hsmmc_pm_account(struct omap_hsmmc_host *host, int from,
+				  ktime_t start)
+{
+	struct omap_hsmmc_pm_stat *stat;
+	unsigned int us;
+
+	if (from == host->dpm_state)
+		return;
+
+	us = ktime_us_delta(ktime_get(), start);
+	stat = &host->pm_stats[from][host->dpm_state];
+	stat->count++;
+	stat->total_us += us;
+	if (us > stat->max_us)
+		stat->max_us = us;
+}
+
 /* Handler for [ENABLED -> DISABLED] transition */
 static int omap_hsmmc_enabled_to_disabled(struct omap_hsmmc_host *host)
 {
@@ -2099,19 +2255,28 @@ static int omap_hsmmc_off_to_enabled(struct omap_hsmmc_host *host)
 static int omap_hsmmc_enable(struct mmc_host *mmc)
 {
 	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	int from = host->dpm_state;
+	ktime_t start = ktime_get();
+	int ret;
 
-	switch (host->dpm_state) {
+	switch (from) {
 	case DISABLED:
-		return omap_hsmmc_disabled_to_enabled(host);
+		ret = omap_hsmmc_disabled_to_enabled(host);
+		break;
 	case CARDSLEEP:
 	case REGSLEEP:
-		return omap_hsmmc_sleep_to_enabled(host);
+		ret = omap_hsmmc_sleep_to_enabled(host);
+		break;
 	case OFF:
-		return omap_hsmmc_off_to_enabled(host);
+		ret = omap_hsmmc_off_to_enabled(host);
+		break;
 	default:
 		dev_dbg(mmc_dev(host->mmc), "UNKNOWN state\n");
 		return -EINVAL;
 	}
+
+	omap_hsmmc_pm_account(host, from, start);
+	return ret;
 }
 
 /*
@@ -2120,25 +2285,32 @@ static int omap_hsmmc_enable(struct mmc_host *mmc)
 static int omap_hsmmc_disable(struct mmc_host *mmc, int lazy)
 {
 	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	int from = host->dpm_state;
+	ktime_t start = ktime_get();
+	int ret;
 
-	switch (host->dpm_state) {
+	switch (from) {
 	case ENABLED: {
 		int delay;
 
 		delay = omap_hsmmc_enabled_to_disabled(host);
-		if (lazy || delay < 0)
-			return delay;
-		return 0;
+		ret = (lazy || delay < 0) ? delay : 0;
+		break;
 	}
 	case DISABLED:
-		return omap_hsmmc_disabled_to_sleep(host);
+		ret = omap_hsmmc_disabled_to_sleep(host);
+		break;
 	case CARDSLEEP:
 	case REGSLEEP:
-		return omap_hsmmc_sleep_to_off(host);
+		ret = omap_hsmmc_sleep_to_off(host);
+		break;
 	default:
 		dev_dbg(mmc_dev(host->mmc), "UNKNOWN state\n");
 		return -EINVAL;
 	}
+
+	omap_hsmmc_pm_account(host, from, start);
+	return ret;
 }
 
 static int omap_hsmmc_enable_simple(struct mmc_host *mmc)
@@ -2164,6 +2336,8 @@ static int omap_hsmmc_disable_simple(struct mmc_host *mmc, int lazy)
 static const struct mmc_host_ops omap_hsmmc_ops = {
 	.enable = omap_hsmmc_enable_simple,
 	.disable = omap_hsmmc_disable_simple,
+	.post_req = omap_hsmmc_post_req,
+	.pre_req = omap_hsmmc_pre_req,
 	.request = omap_hsmmc_request,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
@@ -2175,6 +2349,8 @@ static const struct mmc_host_ops omap_hsmmc_ops = {
 static const struct mmc_host_ops omap_hsmmc_ps_ops = {
 	.enable = omap_hsmmc_enable,
 	.disable = omap_hsmmc_disable,
+	.post_req = omap_hsmmc_post_req,
+	.pre_req = omap_hsmmc_pre_req,
 	.request = omap_hsmmc_request,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
@@ -2238,11 +2414,59 @@ static const struct file_operations mmc_regs_fops = {
 	.release        = single_release,
 };
 
+static const char *omap_hsmmc_pm_state_str[OMAP_HSMMC_PM_STATES] = {
+	"ENABLED", "DISABLED", "CARDSLEEP", "REGSLEEP", "OFF",
+};
+
+static int omap_hsmmc_pm_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_host *mmc = s->private;
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct omap_hsmmc_pm_stat *stat;
+	int from, to;
+
+	seq_printf(s, "%-22s %8s %12s %8s %8s\n", "transition", "count",
+		   "total_us", "avg_us", "max_us");
+	for (from = 0; from < OMAP_HSMMC_PM_STATES; from++) {
+		for (to = 0; to < OMAP_HSMMC_PM_STATES; to++) {
+			u64 avg;
+
+			stat = &host->pm_stats[from][to];
+			if (!stat->count)
+				continue;
+			avg = stat->total_us;
+			do_div(avg, stat->count);
+			seq_printf(s, "%9s -> %-9s %8u %12llu %8llu %8u\n",
+				   omap_hsmmc_pm_state_str[from],
+				   omap_hsmmc_pm_state_str[to], stat->count,
+				   (unsigned long long)stat->total_us,
+				   (unsigned long long)avg, stat->max_us);
+		}
+	}
+
+	return 0;
+}
+
+static int omap_hsmmc_pm_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap_hsmmc_pm_stats_show, inode->i_private);
+}
+
+static const struct file_operations mmc_pm_stats_fops = {
+	.open           = omap_hsmmc_pm_stats_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static void omap_hsmmc_debugfs(struct mmc_host *mmc)
 {
-	if (mmc->debugfs_root)
+	if (mmc->debugfs_root) {
 		debugfs_create_file("regs", S_IRUSR, mmc->debugfs_root,
 			mmc, &mmc_regs_fops);
+		debugfs_create_file("pm_stats", S_IRUSR, mmc->debugfs_root,
+			mmc, &mmc_pm_stats_fops);
+	}
 }
 
 #else
@@ -2303,6 +2527,7 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 	host->irq	= irq;
 	host->id	= pdev->id;
 	host->slot_id	= 0;
+	host->next_data.cookie = 1;
 	host->mapbase	= res->start;
 	host->base	= ioremap(host->mapbase, SZ_4K);
 	if (!host->base) {
@@ -2408,7 +2633,8 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 		 * due to unset conherency mask
 		 */
 		host->adma_table = dma_alloc_coherent(NULL,
-			ADMA_TABLE_SZ, &host->phy_adma_table, 0);
+			ADMA_TABLE_SZ * ADMA_TABLE_COUNT,
+			&host->phy_adma_table, 0);
 		if (host->adma_table != NULL)
 			host->dma_type = ADMA_XFER;
 	}
@@ -2425,6 +2651,7 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 
 	mmc->caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED |
 		     MMC_CAP_WAIT_WHILE_BUSY | MMC_CAP_ERASE | MMC_CAP_CMD23;
+	mmc->caps2 |= MMC_CAP2_PACKED_WR;
 
 	mmc->caps |= mmc_slot(host).caps;
 	if (mmc->caps & MMC_CAP_8_BIT_DATA)
@@ -2545,7 +2772,7 @@ err_irq:
 	}
 err1:
 	if (host->adma_table != NULL)
-		dma_free_coherent(NULL, ADMA_TABLE_SZ,
+		dma_free_coherent(NULL, ADMA_TABLE_SZ * ADMA_TABLE_COUNT,
 			host->adma_table, host->phy_adma_table);
 	iounmap(host->base);
 err_ioremap:
@@ -2576,7 +2803,8 @@ static int omap_hsmmc_remove(struct platform_device *pdev)
 		flush_work_sync(&host->mmc_carddetect_work);
 
 		if (host->adma_table != NULL)
-			dma_free_coherent(NULL, ADMA_TABLE_SZ,
+			dma_free_coherent(NULL,
+				ADMA_TABLE_SZ * ADMA_TABLE_COUNT,
 				host->adma_table, host->phy_adma_table);
 
 		mmc_host_disable(host->mmc);
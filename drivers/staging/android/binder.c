@@ -20,6 +20,7 @@
 #include <linux/file.h>
 #include <linux/freezer.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -38,7 +39,43 @@
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+/*
+ * Locking
+ *
+ * binder_main_lock protects the object graph: nodes, refs, threads,
+ * transactions, the todo lists they are queued on, and the context
+ * manager. It is no longer held for the whole ioctl. A transaction
+ * drops it while the target buffer is allocated and the payload is
+ * copied in from user space, which is where most of the time under the
+ * old global lock went.
+ *
+ * proc->alloc_lock protects the buffer allocator of one process: the
+ * buffer list, the free and allocated trees, the page array, the page
+ * cache and free_async_space. Buffer fields used by transactions
+ * (transaction, target_node, allow_user_free) stay under
+ * binder_main_lock.
+ *
+ * binder_procs_lock protects the binder_procs list. Adding or removing
+ * a proc takes both binder_main_lock and binder_procs_lock, so holding
+ * either one is enough to walk the list.
+ *
+ * While binder_main_lock is dropped, proc->tmp_ref and node->tmp_refs
+ * keep the target alive. A released proc is torn down by
+ * binder_deferred_release(), but its buffers and pages are freed only
+ * once the last tmp_ref is gone.
+ *
+ * Lock order:
+ *   binder_main_lock
+ *     binder_procs_lock
+ *     proc->alloc_lock
+ *       mm->mmap_sem
+ *
+ * binder_deferred_lock and binder_mmap_lock are leaf locks. The
+ * shrinker only trylocks binder_procs_lock, proc->alloc_lock and
+ * mmap_sem, so it may run from reclaim under any of them.
+ */
+static DEFINE_MUTEX(binder_main_lock);
+static DEFINE_MUTEX(binder_procs_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 static DEFINE_MUTEX(binder_mmap_lock);
 
@@ -52,6 +89,7 @@ static struct binder_node *binder_context_mgr_node;
 static uid_t binder_context_mgr_uid = -1;
 static int binder_last_id;
 static struct workqueue_struct *binder_deferred_workqueue;
+static atomic_t binder_pages_cached = ATOMIC_INIT(0);
 
 #define BINDER_DEBUG_ENTRY(name) \
 static int binder_##name##_open(struct inode *inode, struct file *file) \
@@ -108,6 +146,13 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+/*
+ * Let synchronous transactions carry SCHED_FIFO/SCHED_RR to the target
+ * thread. When clear, real-time callers are treated as nice 0.
+ */
+static int binder_inherit_rt = 1;
+module_param_named(inherit_rt, binder_inherit_rt, bool, S_IWUSR | S_IRUGO);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -201,6 +246,16 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 	return e;
 }
 
+/*
+ * A scheduling policy together with a kernel priority (0..MAX_PRIO-1,
+ * lower is more important), so real-time and nice levels compare on a
+ * single scale.
+ */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
 struct binder_work {
 	struct list_head entry;
 	enum {
@@ -234,6 +289,7 @@ struct binder_node {
 	unsigned has_async_transaction:1;
 	unsigned accept_fds:1;
 	unsigned min_priority:8;
+	int tmp_refs;
 	struct list_head async_todo;
 };
 
@@ -276,6 +332,25 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+/*
+ * Buffer allocator statistics, protected by proc->alloc_lock. Pages that are
+ * no longer covered by an allocated buffer stay mapped in the page cache
+ * until they are reused or reclaimed by binder_shrink().
+ */
+struct binder_alloc_stats {
+	size_t allocated;
+	size_t allocated_max;
+	int pages_cached;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long pages_mapped;
+	unsigned long pages_unmapped;
+	unsigned long pages_reused;
+	u64 alloc_ns;
+	u64 alloc_ns_max;
+	u64 free_ns;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -295,6 +370,9 @@ struct binder_proc {
 	struct files_struct *files;
 	struct hlist_node deferred_work_node;
 	int deferred_work;
+	int tmp_ref;
+	bool is_dead;
+	struct mutex alloc_lock;
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
@@ -304,6 +382,8 @@ struct binder_proc {
 	size_t free_async_space;
 
 	struct page **pages;
+	unsigned long *pages_cached;
+	struct binder_alloc_stats alloc_stats;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -314,7 +394,7 @@ struct binder_proc {
 	int requested_threads;
 	int requested_threads_started;
 	int ready_threads;
-	long default_priority;
+	struct binder_priority default_priority;
 	struct dentry *debugfs_entry;
 };
 
@@ -356,14 +436,30 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
 	uid_t	sender_euid;
 };
 
+#define CREATE_TRACE_POINTS
+#include "trace/binder.h"
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
+static inline void binder_lock(const char *tag)
+{
+	trace_binder_lock(tag);
+	mutex_lock(&binder_main_lock);
+	trace_binder_locked(tag);
+}
+
+static inline void binder_unlock(const char *tag)
+{
+	trace_binder_unlock(tag);
+	mutex_unlock(&binder_main_lock);
+}
+
 /*
  * copied from get_unused_fd_flags
  */
@@ -502,21 +598,155 @@ out_unlock:
 	return -EBADF;
 }
 
-static void binder_set_nice(long nice)
+#define BINDER_NICE_TO_PRIO(nice)	(MAX_RT_PRIO + (nice) + 20)
+#define BINDER_PRIO_TO_NICE(prio)	((prio) - MAX_RT_PRIO - 20)
+
+static bool binder_is_rt_policy(unsigned int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static bool binder_is_fair_policy(unsigned int policy)
+{
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
+}
+
+/* kernel priority <-> rt_priority or nice, depending on the policy */
+static int binder_to_userspace_prio(unsigned int policy, int prio)
+{
+	if (binder_is_rt_policy(policy))
+		return MAX_USER_RT_PRIO - 1 - prio;
+	return BINDER_PRIO_TO_NICE(prio);
+}
+
+static int binder_to_kernel_prio(unsigned int policy, int user_prio)
+{
+	if (binder_is_rt_policy(policy))
+		return MAX_USER_RT_PRIO - 1 - user_prio;
+	return BINDER_NICE_TO_PRIO(user_prio);
+}
+
+static struct binder_priority binder_current_priority(void)
+{
+	struct binder_priority p;
+
+	p.sched_policy = current->policy;
+	p.prio = current->normal_prio;
+	return p;
+}
+
+/*
+ * Switch current to 'desired'. When 'verify' is set the request is
+ * capped to what current could have set itself: without CAP_SYS_NICE a
+ * real-time priority is limited by RLIMIT_RTPRIO and a nice level by
+ * RLIMIT_NICE. Restoring a priority the thread held before is never
+ * capped.
+ */
+static void binder_do_set_priority(struct binder_priority desired, bool verify)
 {
-	long min_nice;
-	if (can_nice(current, nice)) {
-		set_user_nice(current, nice);
+	struct task_struct *task = current;
+	unsigned int policy = desired.sched_policy;
+	int priority;
+	bool has_cap_nice;
+
+	if (task->policy == policy && task->normal_prio == desired.prio)
 		return;
+
+	has_cap_nice = has_capability_noaudit(task, CAP_SYS_NICE);
+	priority = binder_to_userspace_prio(policy, desired.prio);
+
+	if (verify && binder_is_rt_policy(policy) && !has_cap_nice) {
+		long max_rtprio = task_rlimit(task, RLIMIT_RTPRIO);
+
+		if (max_rtprio == 0) {
+			policy = SCHED_NORMAL;
+			priority = -20;
+		} else if (priority > max_rtprio) {
+			priority = max_rtprio;
+		}
 	}
-	min_nice = 20 - current->signal->rlim[RLIMIT_NICE].rlim_cur;
-	binder_debug(BINDER_DEBUG_PRIORITY_CAP,
-		     "binder: %d: nice value %ld not allowed use "
-		     "%ld instead\n", current->pid, nice, min_nice);
-	set_user_nice(current, min_nice);
-	if (min_nice < 20)
-		return;
-	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
+
+	if (verify && binder_is_fair_policy(policy) && !has_cap_nice) {
+		long min_nice = 20 - task_rlimit(task, RLIMIT_NICE);
+
+		if (priority < min_nice) {
+			if (min_nice >= 20) {
+				binder_user_error("binder: %d RLIMIT_NICE not "
+						  "set\n", task->pid);
+				min_nice = 19;
+			}
+			priority = min_nice;
+		}
+	}
+
+	if (policy != desired.sched_policy ||
+	    binder_to_kernel_prio(policy, priority) != desired.prio)
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: priority %u:%d not allowed, "
+			     "using %u:%d instead\n", task->pid,
+			     desired.sched_policy, desired.prio, policy,
+			     binder_to_kernel_prio(policy, priority));
+
+	trace_binder_set_priority(task->tgid, task->pid, task->policy,
+				  task->normal_prio, policy,
+				  binder_to_kernel_prio(policy, priority),
+				  desired.prio);
+
+	if (task->policy != policy || binder_is_rt_policy(policy)) {
+		struct sched_param params;
+
+		params.sched_priority = binder_is_rt_policy(policy) ?
+					priority : 0;
+		sched_setscheduler_nocheck(task, policy | SCHED_RESET_ON_FORK,
+					   &params);
+	}
+	if (binder_is_fair_policy(policy))
+		set_user_nice(task, priority);
+}
+
+static void binder_set_priority(struct binder_priority desired)
+{
+	binder_do_set_priority(desired, true);
+}
+
+static void binder_restore_priority(struct binder_priority desired)
+{
+	binder_do_set_priority(desired, false);
+}
+
+/*
+ * Pick the priority a thread runs a transaction at. A synchronous call
+ * runs at the caller's priority, real-time included, so a foreground
+ * caller is not left waiting behind a background service thread. A
+ * one-way call keeps the thread's own priority. Either way the node's
+ * min_priority (a nice level) is a floor.
+ */
+static void binder_transaction_priority(struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority desired;
+
+	t->saved_priority = binder_current_priority();
+
+	if (!(t->flags & TF_ONE_WAY)) {
+		desired = t->priority;
+		if (binder_is_rt_policy(desired.sched_policy) &&
+		    !binder_inherit_rt) {
+			desired.sched_policy = SCHED_NORMAL;
+			desired.prio = BINDER_NICE_TO_PRIO(0);
+		}
+	} else {
+		desired = t->saved_priority;
+	}
+
+	/* min_priority comes from userspace; values past 19 mean "none" */
+	if (node->min_priority < 20 &&
+	    BINDER_NICE_TO_PRIO(node->min_priority) < desired.prio) {
+		desired.sched_policy = SCHED_NORMAL;
+		desired.prio = BINDER_NICE_TO_PRIO(node->min_priority);
+	}
+
+	binder_set_priority(desired);
 }
 
 static size_t binder_buffer_size(struct binder_proc *proc,
@@ -590,13 +820,15 @@ static void binder_insert_allocated_buffer(struct binder_proc *proc,
 static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 						  void __user *user_ptr)
 {
-	struct rb_node *n = proc->allocated_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	struct binder_buffer *kern_ptr;
 
 	kern_ptr = user_ptr - proc->user_buffer_offset
 		- offsetof(struct binder_buffer, data);
 
+	mutex_lock(&proc->alloc_lock);
+	n = proc->allocated_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(buffer->free);
@@ -606,20 +838,132 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 		else if (kern_ptr > buffer)
 			n = n->rb_right;
 		else
-			return buffer;
+			break;
 	}
-	return NULL;
+	mutex_unlock(&proc->alloc_lock);
+	return n ? buffer : NULL;
+}
+
+static void binder_cache_page_range(struct binder_proc *proc,
+				    int first, int last)
+{
+	int i;
+
+	for (i = first; i < last; i++) {
+		BUG_ON(!proc->pages[i]);
+		BUG_ON(test_bit(i, proc->pages_cached));
+		__set_bit(i, proc->pages_cached);
+	}
+	proc->alloc_stats.pages_cached += last - first;
+	atomic_add(last - first, &binder_pages_cached);
+}
+
+static void binder_unmap_page_run(struct binder_proc *proc,
+				  struct vm_area_struct *vma,
+				  int first, int last)
+{
+	void *start = proc->buffer + first * PAGE_SIZE;
+	size_t size = (last - first) * PAGE_SIZE;
+	int i;
+
+	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "binder: %d: unmap cached pages %p-%p\n", proc->pid,
+		     start, start + size);
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)start + proc->user_buffer_offset,
+			       size, NULL);
+	unmap_kernel_range((unsigned long)start, size);
+	for (i = first; i < last; i++) {
+		__clear_bit(i, proc->pages_cached);
+		__free_page(proc->pages[i]);
+		proc->pages[i] = NULL;
+	}
+	proc->alloc_stats.pages_cached -= last - first;
+	proc->alloc_stats.pages_unmapped += last - first;
+	atomic_sub(last - first, &binder_pages_cached);
+}
+
+/*
+ * Allocate the pages [first, last), map them into the kernel with a
+ * single map_vm_area() call and insert them into the user vma.
+ */
+static int binder_map_page_run(struct binder_proc *proc,
+			       int first, int last,
+			       struct vm_area_struct *vma)
+{
+	void *start = proc->buffer + first * PAGE_SIZE;
+	unsigned long user_start;
+	struct vm_struct tmp_area;
+	struct page **page_array_ptr;
+	int i;
+	int ret;
+
+	for (i = first; i < last; i++) {
+		BUG_ON(proc->pages[i]);
+		proc->pages[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM |
+					    __GFP_ZERO);
+		if (proc->pages[i] == NULL) {
+			pr_err("binder: %d: binder_alloc_buf failed "
+			       "for page at %p\n", proc->pid,
+			       proc->buffer + i * PAGE_SIZE);
+			last = i;
+			goto err_alloc_page_failed;
+		}
+	}
+	tmp_area.addr = start;
+	tmp_area.size = (last - first) * PAGE_SIZE + PAGE_SIZE /* guard page? */;
+	page_array_ptr = &proc->pages[first];
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		pr_err("binder: %d: binder_alloc_buf failed "
+		       "to map pages at %p in kernel\n", proc->pid, start);
+		goto err_map_kernel_failed;
+	}
+	user_start = (uintptr_t)start + proc->user_buffer_offset;
+	for (i = first; i < last; i++) {
+		ret = vm_insert_page(vma, user_start +
+				     (i - first) * PAGE_SIZE, proc->pages[i]);
+		if (ret) {
+			pr_err("binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_start + (i - first) * PAGE_SIZE);
+			goto err_vm_insert_page_failed;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+	proc->alloc_stats.pages_mapped += last - first;
+	return 0;
+
+err_vm_insert_page_failed:
+	if (i > first)
+		zap_page_range(vma, user_start, (i - first) * PAGE_SIZE, NULL);
+err_map_kernel_failed:
+	unmap_kernel_range((unsigned long)start, (last - first) * PAGE_SIZE);
+err_alloc_page_failed:
+	for (i = first; i < last; i++) {
+		__free_page(proc->pages[i]);
+		proc->pages[i] = NULL;
+	}
+	return -ENOMEM;
 }
 
+/*
+ * Pages released by a buffer are not unmapped. They are moved to the
+ * per-proc page cache and stay mapped both in the kernel and in user
+ * space, so the next buffer that covers them needs no mapping work at
+ * all. Missing pages are allocated and mapped in runs, one map_vm_area()
+ * and one mmap_sem acquisition per request. binder_shrink() gives cached
+ * pages back under memory pressure.
+ */
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
-	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
 	struct mm_struct *mm;
+	int first, last;
+	int i, j;
+	int reused;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -628,6 +972,19 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	first = (start - proc->buffer) / PAGE_SIZE;
+	last = (end - proc->buffer) / PAGE_SIZE;
+
+	if (allocate == 0) {
+		binder_cache_page_range(proc, first, last);
+		return 0;
+	}
+
+	for (i = first; i < last && proc->pages[i]; i++)
+		;
+	if (i == last)
+		goto done;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -643,76 +1000,40 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 	}
 
-	if (allocate == 0)
-		goto free_range;
-
 	if (vma == NULL) {
 		pr_err("binder: %d: binder_alloc_buf failed to "
 		       "map pages in userspace, no vma\n", proc->pid);
 		goto err_no_vma;
 	}
 
-	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
-		if (*page == NULL) {
-			pr_err("binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			pr_err("binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
-		if (ret) {
-			pr_err("binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
-		}
-		/* vm_insert_page does not seem to increment the refcount */
+	while (i < last) {
+		for (j = i + 1; j < last && !proc->pages[j]; j++)
+			;
+		if (binder_map_page_run(proc, i, j, vma))
+			goto err_map_failed;
+		for (i = j; i < last && proc->pages[i]; i++)
+			;
 	}
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
+done:
+	reused = 0;
+	for (i = first; i < last; i++) {
+		if (__test_and_clear_bit(i, proc->pages_cached))
+			reused++;
+	}
+	proc->alloc_stats.pages_cached -= reused;
+	proc->alloc_stats.pages_reused += reused;
+	atomic_sub(reused, &binder_pages_cached);
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		/* LGE_CHANGE_S [jugwan.eom@lge.com] 2011-10-22, workaround for *page has been already NULL */
-#if 1
-		if (*page) {
-			__free_page(*page);
-		}
-#else /* Original */
-		__free_page(*page);
-#endif
-		/* LGE_CHANGE_E [jugwan.eom@lge.com] 2011-10-22, workaround for *page has been already NULL */
-		*page = NULL;
-err_alloc_page_failed:
-		;
+err_map_failed:
+	/* Runs mapped before the failure are kept in the page cache */
+	for (j = first; j < i; j++) {
+		if (proc->pages[j] && !test_bit(j, proc->pages_cached))
+			binder_cache_page_range(proc, j, j + 1);
 	}
 err_no_vma:
 	if (mm) {
@@ -722,9 +1043,80 @@ err_no_vma:
 	return -ENOMEM;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
-					      size_t data_size,
-					      size_t offsets_size, int is_async)
+/*
+ * Unmap up to nr_to_scan cached pages of proc. Called from reclaim with
+ * proc->alloc_lock held, so the mmap_sem of the target is only trylocked.
+ */
+static int binder_shrink_proc(struct binder_proc *proc, int nr_to_scan)
+{
+	struct mm_struct *mm;
+	struct vm_area_struct *vma = NULL;
+	int npages = proc->buffer_size / PAGE_SIZE;
+	int freed = 0;
+	int i, j;
+
+	mm = get_task_mm(proc->tsk);
+	if (mm) {
+		if (!down_write_trylock(&mm->mmap_sem)) {
+			mmput(mm);
+			return 0;
+		}
+		vma = proc->vma;
+		if (vma && mm != proc->vma_vm_mm)
+			vma = NULL;
+	}
+
+	i = find_first_bit(proc->pages_cached, npages);
+	while (i < npages && freed < nr_to_scan) {
+		j = find_next_zero_bit(proc->pages_cached, npages, i);
+		if (j - i > nr_to_scan - freed)
+			j = i + nr_to_scan - freed;
+		binder_unmap_page_run(proc, vma, i, j);
+		freed += j - i;
+		i = find_next_bit(proc->pages_cached, npages, j);
+	}
+
+	if (mm) {
+		up_write(&mm->mmap_sem);
+		mmput(mm);
+	}
+	return freed;
+}
+
+static int binder_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int nr_to_scan = sc->nr_to_scan;
+
+	if (nr_to_scan) {
+		if (!mutex_trylock(&binder_procs_lock))
+			return -1;
+		hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+			if (!proc->alloc_stats.pages_cached)
+				continue;
+			if (!mutex_trylock(&proc->alloc_lock))
+				continue;
+			nr_to_scan -= binder_shrink_proc(proc, nr_to_scan);
+			mutex_unlock(&proc->alloc_lock);
+			if (nr_to_scan <= 0)
+				break;
+		}
+		mutex_unlock(&binder_procs_lock);
+	}
+
+	return atomic_read(&binder_pages_cached);
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static struct binder_buffer *__binder_alloc_buf(struct binder_proc *proc,
+						size_t data_size,
+						size_t offsets_size,
+						int is_async)
 {
 	struct rb_node *n = proc->free_buffers.rb_node;
 	struct binder_buffer *buffer;
@@ -814,6 +1206,9 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got "
 		     "%p\n", proc->pid, size, buffer);
+	proc->alloc_stats.allocated += binder_buffer_size(proc, buffer);
+	if (proc->alloc_stats.allocated > proc->alloc_stats.allocated_max)
+		proc->alloc_stats.allocated_max = proc->alloc_stats.allocated;
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
 	buffer->async_transaction = is_async;
@@ -828,6 +1223,29 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	return buffer;
 }
 
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+					      size_t data_size,
+					      size_t offsets_size, int is_async)
+{
+	struct binder_alloc_stats *stats = &proc->alloc_stats;
+	struct binder_buffer *buffer;
+	ktime_t start;
+	u64 ns;
+
+	mutex_lock(&proc->alloc_lock);
+	start = ktime_get();
+	buffer = __binder_alloc_buf(proc, data_size, offsets_size, is_async);
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	stats->alloc_ns += ns;
+	if (ns > stats->alloc_ns_max)
+		stats->alloc_ns_max = ns;
+	if (buffer)
+		stats->allocs++;
+	mutex_unlock(&proc->alloc_lock);
+	return buffer;
+}
+
 static void *buffer_start_page(struct binder_buffer *buffer)
 {
 	return (void *)((uintptr_t)buffer & PAGE_MASK);
@@ -885,10 +1303,11 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
-static void binder_free_buf(struct binder_proc *proc,
-			    struct binder_buffer *buffer)
+static void __binder_free_buf(struct binder_proc *proc,
+			      struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
+	ktime_t start = ktime_get();
 
 	buffer_size = binder_buffer_size(proc, buffer);
 
@@ -920,6 +1339,8 @@ static void binder_free_buf(struct binder_proc *proc,
 		NULL);
 	rb_erase(&buffer->rb_node, &proc->allocated_buffers);
 	buffer->free = 1;
+	proc->alloc_stats.allocated -= buffer_size;
+	proc->alloc_stats.frees++;
 	if (!list_is_last(&buffer->entry, &proc->buffers)) {
 		struct binder_buffer *next = list_entry(buffer->entry.next,
 						struct binder_buffer, entry);
@@ -938,6 +1359,82 @@ static void binder_free_buf(struct binder_proc *proc,
 		}
 	}
 	binder_insert_free_buffer(proc, buffer);
+	proc->alloc_stats.free_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void binder_free_buf(struct binder_proc *proc,
+			    struct binder_buffer *buffer)
+{
+	mutex_lock(&proc->alloc_lock);
+	__binder_free_buf(proc, buffer);
+	mutex_unlock(&proc->alloc_lock);
+}
+
+/*
+ * Free the buffers, pages and the proc itself once it has been released
+ * and no transaction holds a temporary reference to it anymore.
+ */
+static void binder_free_proc(struct binder_proc *proc)
+{
+	struct rb_node *n;
+	int buffers, page_count;
+
+	BUG_ON(!proc->is_dead || proc->tmp_ref);
+
+	buffers = 0;
+	while ((n = rb_first(&proc->allocated_buffers))) {
+		struct binder_buffer *buffer;
+
+		buffer = rb_entry(n, struct binder_buffer, rb_node);
+		binder_free_buf(proc, buffer);
+		buffers++;
+	}
+
+	page_count = 0;
+	if (proc->pages) {
+		int i;
+
+		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+			void *page_addr;
+
+			if (!proc->pages[i])
+				continue;
+
+			page_addr = proc->buffer + i * PAGE_SIZE;
+			if (test_bit(i, proc->pages_cached)) {
+				unmap_kernel_range((unsigned long)page_addr,
+						   PAGE_SIZE);
+				__free_page(proc->pages[i]);
+				continue;
+			}
+			binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+				     "%s: %d: page %d at %p not freed\n",
+				     __func__, proc->pid, i, page_addr);
+			unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+			__free_page(proc->pages[i]);
+			page_count++;
+		}
+		atomic_sub(proc->alloc_stats.pages_cached,
+			   &binder_pages_cached);
+		kfree(proc->pages_cached);
+		kfree(proc->pages);
+		vfree(proc->buffer);
+	}
+
+	put_task_struct(proc->tsk);
+
+	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
+		     "%s: %d buffers %d, pages %d\n",
+		     __func__, proc->pid, buffers, page_count);
+
+	kfree(proc);
+}
+
+static void binder_put_proc_tmpref(struct binder_proc *proc)
+{
+	BUG_ON(proc->tmp_ref <= 0);
+	if (--proc->tmp_ref == 0 && proc->is_dead)
+		binder_free_proc(proc);
 }
 
 static struct binder_node *binder_get_node(struct binder_proc *proc,
@@ -1034,21 +1531,8 @@ static int binder_inc_node(struct binder_node *node, int strong, int internal,
 	return 0;
 }
 
-static int binder_dec_node(struct binder_node *node, int strong, int internal)
+static void binder_cleanup_node(struct binder_node *node)
 {
-	if (strong) {
-		if (internal)
-			node->internal_strong_refs--;
-		else
-			node->local_strong_refs--;
-		if (node->local_strong_refs || node->internal_strong_refs)
-			return 0;
-	} else {
-		if (!internal)
-			node->local_weak_refs--;
-		if (node->local_weak_refs || !hlist_empty(&node->refs))
-			return 0;
-	}
 	if (node->proc && (node->has_strong_ref || node->has_weak_ref)) {
 		if (list_empty(&node->work.entry)) {
 			list_add_tail(&node->work.entry, &node->proc->todo);
@@ -1056,7 +1540,7 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
-		    !node->local_weak_refs) {
+		    !node->local_weak_refs && !node->tmp_refs) {
 			list_del_init(&node->work.entry);
 			if (node->proc) {
 				rb_erase(&node->rb_node, &node->proc->nodes);
@@ -1073,10 +1557,42 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 			binder_stats_deleted(BINDER_STAT_NODE);
 		}
 	}
+}
+
+static int binder_dec_node(struct binder_node *node, int strong, int internal)
+{
+	if (strong) {
+		if (internal)
+			node->internal_strong_refs--;
+		else
+			node->local_strong_refs--;
+		if (node->local_strong_refs || node->internal_strong_refs)
+			return 0;
+	} else {
+		if (!internal)
+			node->local_weak_refs--;
+		if (node->local_weak_refs || !hlist_empty(&node->refs))
+			return 0;
+	}
+	binder_cleanup_node(node);
 
 	return 0;
 }
 
+/*
+ * A temporary reference only keeps the node allocated while
+ * binder_main_lock is dropped; it is not reported to user space.
+ */
+static void binder_put_node_tmpref(struct binder_node *node)
+{
+	BUG_ON(node->tmp_refs <= 0);
+	if (--node->tmp_refs || node->local_strong_refs ||
+	    node->internal_strong_refs || node->local_weak_refs ||
+	    !hlist_empty(&node->refs))
+		return;
+	binder_cleanup_node(node);
+}
+
 
 static struct binder_ref *binder_get_ref(struct binder_proc *proc,
 					 uint32_t desc)
@@ -1398,7 +1914,7 @@ static void binder_transaction(struct binder_proc *proc,
 {
 	struct binder_transaction *t;
 	struct binder_work *tcomplete;
-	size_t *offp, *off_end;
+	size_t *offp = NULL, *off_end;
 	struct binder_proc *target_proc;
 	struct binder_thread *target_thread = NULL;
 	struct binder_node *target_node = NULL;
@@ -1406,6 +1922,8 @@ static void binder_transaction(struct binder_proc *proc,
 	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
+	struct binder_buffer *buffer;
+	int copy_error;
 #if 0 //LGE_CHANGE [sunggyun.yu@lge.com] 2011-03-19, WBT
 	uint32_t return_error;
 #else
@@ -1429,7 +1947,7 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_restore_priority(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1492,34 +2010,6 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_invalid_target_handle;
 		}
-		if (!(tr->flags & TF_ONE_WAY) && thread->transaction_stack) {
-			struct binder_transaction *tmp;
-			tmp = thread->transaction_stack;
-			if (tmp->to_thread != thread) {
-				binder_user_error("binder: %d:%d got new "
-					"transaction with bad transaction stack"
-					", transaction %d has target %d:%d\n",
-					proc->pid, thread->pid, tmp->debug_id,
-					tmp->to_proc ? tmp->to_proc->pid : 0,
-					tmp->to_thread ?
-					tmp->to_thread->pid : 0);
-				return_error = BR_FAILED_REPLY;
-				goto err_bad_call_stack;
-			}
-			while (tmp) {
-				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
-				tmp = tmp->from_parent;
-			}
-		}
-	}
-	if (target_thread) {
-		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
 	}
 	e->to_proc = target_proc->pid;
 
@@ -1567,41 +2057,116 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
-	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
+	t->priority = binder_current_priority();
+
+	/*
+	 * Allocate the target buffer and copy the payload without
+	 * binder_main_lock. The temporary references keep target_proc and
+	 * target_node allocated; whether they are still alive is checked
+	 * once the lock is taken again.
+	 */
+	if (target_node)
+		target_node->tmp_refs++;
+	target_proc->tmp_ref++;
+	binder_unlock(__func__);
+
+	copy_error = 0;
+	buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
-	if (t->buffer == NULL) {
+	if (buffer) {
+		offp = (size_t *)(buffer->data +
+				  ALIGN(tr->data_size, sizeof(void *)));
+		if (copy_from_user(buffer->data, tr->data.ptr.buffer,
+				   tr->data_size)) {
+			binder_user_error("binder: %d:%d got transaction with "
+				"invalid data ptr\n", proc->pid, thread->pid);
+			copy_error = 1;
+		} else if (copy_from_user(offp, tr->data.ptr.offsets,
+					  tr->offsets_size)) {
+			binder_user_error("binder: %d:%d got transaction with "
+				"invalid offsets ptr\n", proc->pid, thread->pid);
+			copy_error = 1;
+		} else if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
+			binder_user_error("binder: %d:%d got transaction with "
+				"invalid offsets size, %zd\n",
+				proc->pid, thread->pid, tr->offsets_size);
+			copy_error = 1;
+		}
+	}
+
+	binder_lock(__func__);
+	if (buffer == NULL) {
+		if (target_node)
+			binder_put_node_tmpref(target_node);
 		return_error = BR_FAILED_REPLY;
 		goto err_binder_alloc_buf_failed;
 	}
+	t->buffer = buffer;
 	t->buffer->allow_user_free = 0;
 	t->buffer->debug_id = t->debug_id;
 	t->buffer->transaction = t;
+	t->buffer->target_node = NULL;
+	if (target_proc->is_dead ||
+	    (reply && in_reply_to->from != target_thread)) {
+		if (target_node)
+			binder_put_node_tmpref(target_node);
+		return_error = BR_DEAD_REPLY;
+		goto err_dead_target;
+	}
 	t->buffer->target_node = target_node;
-	if (target_node)
+	if (target_node) {
 		binder_inc_node(target_node, 1, 0, NULL);
-
-	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
-
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
+		binder_put_node_tmpref(target_node);
 	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
+	if (copy_error) {
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
-	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
-		binder_user_error("binder: %d:%d got transaction with "
-			"invalid offsets size, %zd\n",
-			proc->pid, thread->pid, tr->offsets_size);
-		return_error = BR_FAILED_REPLY;
-		goto err_bad_offset;
+
+	if (reply) {
+		if (target_thread->transaction_stack != in_reply_to) {
+			binder_user_error("binder: %d:%d got reply transaction "
+				"with bad target transaction stack %d, "
+				"expected %d\n",
+				proc->pid, thread->pid,
+				target_thread->transaction_stack ?
+				target_thread->transaction_stack->debug_id : 0,
+				in_reply_to->debug_id);
+			return_error = BR_FAILED_REPLY;
+			in_reply_to = NULL;
+			target_thread = NULL;
+			goto err_bad_target_stack;
+		}
+	} else if (!(tr->flags & TF_ONE_WAY) && thread->transaction_stack) {
+		struct binder_transaction *tmp;
+		tmp = thread->transaction_stack;
+		if (tmp->to_thread != thread) {
+			binder_user_error("binder: %d:%d got new "
+				"transaction with bad transaction stack"
+				", transaction %d has target %d:%d\n",
+				proc->pid, thread->pid, tmp->debug_id,
+				tmp->to_proc ? tmp->to_proc->pid : 0,
+				tmp->to_thread ?
+				tmp->to_thread->pid : 0);
+			return_error = BR_FAILED_REPLY;
+			goto err_bad_target_stack;
+		}
+		while (tmp) {
+			if (tmp->from && tmp->from->proc == target_proc)
+				target_thread = tmp->from;
+			tmp = tmp->from_parent;
+		}
+		t->to_thread = target_thread;
 	}
+	if (target_thread) {
+		e->to_thread = target_thread->pid;
+		target_list = &target_thread->todo;
+		target_wait = &target_thread->wait;
+	} else {
+		target_list = &target_proc->todo;
+		target_wait = &target_proc->wait;
+	}
+
 	off_end = (void *)offp + tr->offsets_size;
 	for (; offp < off_end; offp++) {
 		struct flat_binder_object *fp;
@@ -1770,12 +2335,17 @@ static void binder_transaction(struct binder_proc *proc,
 		} else
 			target_node->has_async_transaction = 1;
 	}
+	trace_binder_transaction(reply, t, target_proc->pid,
+				 target_thread ? target_thread->pid : 0,
+				 t->buffer->target_node ?
+				 t->buffer->target_node->debug_id : 0);
 	t->work.type = BINDER_WORK_TRANSACTION;
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
 	if (target_wait)
 		wake_up_interruptible(target_wait);
+	binder_put_proc_tmpref(target_proc);
 	return;
 
 err_get_unused_fd_failed:
@@ -1786,11 +2356,14 @@ err_binder_get_ref_failed:
 err_binder_new_node_failed:
 err_bad_object_type:
 err_bad_offset:
+err_bad_target_stack:
 err_copy_data_failed:
+err_dead_target:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
 err_binder_alloc_buf_failed:
+	binder_put_proc_tmpref(target_proc);
 	kfree(tcomplete);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 err_alloc_tcomplete_failed:
@@ -1813,7 +2386,12 @@ err_no_context_mgr_node:
 		*fe = *e;
 	}
 
-	BUG_ON(thread->return_error != BR_OK);
+	if (thread->return_error != BR_OK) {
+		/* a failed reply arrived while binder_main_lock was dropped */
+		if (thread->return_error2 == BR_OK)
+			thread->return_error2 = thread->return_error;
+		thread->return_error = BR_OK;
+	}
 	if (in_reply_to) {
 		thread->return_error = BR_TRANSACTION_COMPLETE;
 		binder_send_failed_reply(in_reply_to, return_error);
@@ -2277,7 +2855,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock(__func__);
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2288,7 +2866,7 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
-		binder_set_nice(proc->default_priority);
+		binder_restore_priority(proc->default_priority);
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
@@ -2301,7 +2879,7 @@ retry:
 		} else
 			ret = wait_event_freezable(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_lock(__func__);
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2391,7 +2969,7 @@ retry:
 					     proc->pid, thread->pid, cmd_name, node->debug_id, node->ptr, node->cookie);
 			} else {
 				list_del_init(&w->entry);
-				if (!weak && !strong) {
+				if (!weak && !strong && !node->tmp_refs) {
 					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 						     "binder: %d:%d node %d u%p c%p deleted\n",
 						     proc->pid, thread->pid, node->debug_id,
@@ -2452,13 +3030,7 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			binder_transaction_priority(t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2496,6 +3068,7 @@ retry:
 			return -EFAULT;
 		ptr += sizeof(tr);
 
+		trace_binder_transaction_received(t);
 		binder_stat_br(proc, thread, cmd);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "binder: %d:%d %s %d %d:%d, cmd %d"
@@ -2673,19 +3246,19 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock(__func__);
 	thread = binder_get_thread(proc);
 #if defined(CONFIG_MACH_LGE_OMAP3) //LGE_CHANGE [sunggyun.yu@lge.com] 2011-03-19, WBT
 	if (thread == NULL) {
 		printk(KERN_ERR "binder_get_thread failed.\n");
-		mutex_unlock(&binder_lock);
+		binder_unlock(__func__);
 		return 0;
 	}
 #endif
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock(__func__);
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2717,7 +3290,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	binder_lock(__func__);
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2829,7 +3402,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock(__func__);
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		pr_info("binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2920,6 +3493,13 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		goto err_alloc_pages_failed;
 	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	proc->pages_cached = kzalloc(BITS_TO_LONGS(proc->buffer_size /
+					PAGE_SIZE) * sizeof(long), GFP_KERNEL);
+	if (proc->pages_cached == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc page cache bitmap";
+		goto err_alloc_small_buf_failed;
+	}
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2945,6 +3525,8 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->pages_cached);
+	proc->pages_cached = NULL;
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
@@ -2974,14 +3556,17 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
-	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	proc->default_priority = binder_current_priority();
+	mutex_init(&proc->alloc_lock);
+	binder_lock(__func__);
 	binder_stats_created(BINDER_STAT_PROC);
+	mutex_lock(&binder_procs_lock);
 	hlist_add_head(&proc->proc_node, &binder_procs);
+	mutex_unlock(&binder_procs_lock);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock(__func__);
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -3039,7 +3624,7 @@ static int binder_node_release(struct binder_node *node, int refs)
 	list_del_init(&node->work.entry);
 	binder_release_work(&node->async_todo);
 
-	if (hlist_empty(&node->refs)) {
+	if (hlist_empty(&node->refs) && !node->tmp_refs) {
 		kfree(node);
 		binder_stats_deleted(BINDER_STAT_NODE);
 
@@ -3080,13 +3665,14 @@ static void binder_deferred_release(struct binder_proc *proc)
 {
 	struct binder_transaction *t;
 	struct rb_node *n;
-	int threads, nodes, incoming_refs, outgoing_refs, buffers,
-		active_transactions, page_count;
+	int threads, nodes, incoming_refs, outgoing_refs, active_transactions;
 
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	mutex_lock(&binder_procs_lock);
 	hlist_del(&proc->proc_node);
+	mutex_unlock(&binder_procs_lock);
 
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
@@ -3128,9 +3714,8 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_release_work(&proc->todo);
 	binder_release_work(&proc->delivered_death);
 
-	buffers = 0;
-
-	while ((n = rb_first(&proc->allocated_buffers))) {
+	mutex_lock(&proc->alloc_lock);
+	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n)) {
 		struct binder_buffer *buffer;
 
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
@@ -3143,43 +3728,19 @@ static void binder_deferred_release(struct binder_proc *proc)
 			       proc->pid, t->debug_id);
 			/*BUG();*/
 		}
-
-		binder_free_buf(proc, buffer);
-		buffers++;
 	}
+	mutex_unlock(&proc->alloc_lock);
 
 	binder_stats_deleted(BINDER_STAT_PROC);
 
-	page_count = 0;
-	if (proc->pages) {
-		int i;
-
-		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			void *page_addr;
-
-			if (!proc->pages[i])
-				continue;
-
-			page_addr = proc->buffer + i * PAGE_SIZE;
-			binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-				     "%s: %d: page %d at %p not freed\n",
-				     __func__, proc->pid, i, page_addr);
-			unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-			__free_page(proc->pages[i]);
-			page_count++;
-		}
-		kfree(proc->pages);
-		vfree(proc->buffer);
-	}
-
-	put_task_struct(proc->tsk);
-
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
-		     "%s: %d threads %d, nodes %d (ref %d), refs %d, active transactions %d, buffers %d, pages %d\n",
+		     "%s: %d threads %d, nodes %d (ref %d), refs %d, active transactions %d\n",
 		     __func__, proc->pid, threads, nodes, incoming_refs,
-		     outgoing_refs, active_transactions, buffers, page_count);
+		     outgoing_refs, active_transactions);
 
-	kfree(proc);
+	proc->is_dead = true;
+	if (!proc->tmp_ref)
+		binder_free_proc(proc);
 }
 
 static void binder_deferred_func(struct work_struct *work)
@@ -3189,7 +3750,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock(__func__);
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3216,7 +3777,7 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_RELEASE)
 			binder_deferred_release(proc); /* frees proc */
 
-		mutex_unlock(&binder_lock);
+		binder_unlock(__func__);
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3240,13 +3801,14 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %u:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   t->priority.prio, t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3397,9 +3959,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	mutex_unlock(&proc->alloc_lock);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3495,6 +4059,21 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	}
 }
 
+static void print_binder_alloc_stats(struct seq_file *m,
+				     struct binder_proc *proc)
+{
+	struct binder_alloc_stats *stats = &proc->alloc_stats;
+
+	seq_printf(m, "  buffer space: %zd allocated, %zd max, %zd total\n",
+		   stats->allocated, stats->allocated_max, proc->buffer_size);
+	seq_printf(m, "  pages: %lu mapped, %lu unmapped, %lu reused, "
+		   "%d cached\n", stats->pages_mapped, stats->pages_unmapped,
+		   stats->pages_reused, stats->pages_cached);
+	seq_printf(m, "  allocs: %lu, %llu ns (max %llu ns)\n",
+		   stats->allocs, stats->alloc_ns, stats->alloc_ns_max);
+	seq_printf(m, "  frees: %lu, %llu ns\n", stats->frees, stats->free_ns);
+}
+
 static void print_binder_proc_stats(struct seq_file *m,
 				    struct binder_proc *proc)
 {
@@ -3528,10 +4107,13 @@ static void print_binder_proc_stats(struct seq_file *m,
 	}
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
+	mutex_lock(&proc->alloc_lock);
 	count = 0;
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	print_binder_alloc_stats(m, proc);
+	mutex_unlock(&proc->alloc_lock);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3557,7 +4139,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(__func__);
 
 	seq_puts(m, "binder state:\n");
 
@@ -3569,7 +4151,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock(__func__);
 	return 0;
 }
 
@@ -3580,7 +4162,7 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(__func__);
 
 	seq_puts(m, "binder stats:\n");
 
@@ -3589,7 +4171,7 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock(__func__);
 	return 0;
 }
 
@@ -3600,13 +4182,13 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(__func__);
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock(__func__);
 	return 0;
 }
 
@@ -3616,11 +4198,15 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(__func__);
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
+	seq_puts(m, "allocator:\n");
+	mutex_lock(&proc->alloc_lock);
+	print_binder_alloc_stats(m, proc);
+	mutex_unlock(&proc->alloc_lock);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock(__func__);
 	return 0;
 }
 
@@ -3683,6 +4269,7 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -24,44 +24,80 @@
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
+#include <linux/timer.h>
 #include "logger.h"
 #include "logger_interface.h"
 
 #include <asm/ioctls.h>
 
+/*
+ * Readers are woken once this many bytes have been committed since the
+ * last wakeup, or after wakeup_ms otherwise. 0 wakes them on every entry.
+ */
+static unsigned int logger_wakeup_bytes = 4096;
+module_param_named(wakeup_bytes, logger_wakeup_bytes, uint, S_IWUSR | S_IRUGO);
+
+static unsigned int logger_wakeup_ms = 10;
+module_param_named(wakeup_ms, logger_wakeup_ms, uint, S_IWUSR | S_IRUGO);
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Writers do not take 'mutex'. A write reserves its space at w_off under
+ * the spinlock 'lock', copies the entry in without any lock held, and then
+ * commits it. Entries up to c_off are complete; readers never look past it.
+ * 'lock' protects the offsets, the inflight list, the readers list and
+ * each reader's r_off. 'mutex' serializes readers and ioctls.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	struct mutex		mutex;	/* serializes readers */
+	spinlock_t		lock;	/* protects offsets and r_off */
+	struct list_head	inflight; /* uncommitted writes, oldest first */
 	size_t			w_off;	/* current write head offset */
+	size_t			c_off;	/* committed up to here */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	size_t			wake_bytes; /* committed since last wakeup */
+	struct timer_list	wake_timer; /* delayed reader wakeup */
 };
 
 /*
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. r_off and lapped are protected by log->lock, the
+ * rest by log->mutex.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
 	bool			r_all;	/* reader can read all entries */
+	bool			lapped;	/* pulled forward by a writer */
 	int			r_ver;	/* reader ABI version */
 };
 
+/*
+ * struct logger_reservation - a write that has claimed its space in the
+ * ring but has not been committed yet. Lives on the writer's stack.
+ */
+struct logger_reservation {
+	struct list_head	list;	/* entry in logger_log's inflight */
+	size_t			start;	/* offset of the entry header */
+};
+
+#define LOGGER_ENTRY_MAX_LEN \
+	(sizeof(struct logger_entry) + LOGGER_ENTRY_MAX_PAYLOAD)
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
@@ -113,7 +149,7 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 {
@@ -157,14 +193,16 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log_to_user - reads exactly 'count' bytes of the entry at 'off'
+ * from 'log' into the user-space buffer 'buf'. Returns 'count' on success.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->mutex but not log->lock, and must check
+ * reader->lapped afterwards: a writer may have overwritten the entry
+ * while it was being copied.
  */
 static ssize_t do_read_log_to_user(struct logger_log *log,
 				   struct logger_reader *reader,
-				   char __user *buf,
+				   size_t off, char __user *buf,
 				   size_t count)
 {
 	struct logger_entry scratch;
@@ -176,13 +214,13 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * First, copy the header to userspace, using the version of
 	 * the header requested
 	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
+	entry = get_entry_header(log, off, &scratch);
 	if (copy_header_to_user(reader->r_ver, entry, buf))
 		return -EFAULT;
 
 	count -= get_user_hdr_len(reader->r_ver);
 	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
+	msg_start = logger_offset(off + sizeof(struct logger_entry));
 
 	/*
 	 * We read from the msg in two disjoint operations. First, we read from
@@ -201,20 +239,19 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 		if (copy_to_user(buf + len, log->buffer, count - len))
 			return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
-
 	return count + get_user_hdr_len(reader->r_ver);
 }
 
 /*
  * get_next_entry_by_uid - Starting at 'off', returns an offset into
  * 'log->buffer' which contains the first entry readable by 'euid'
+ *
+ * Caller needs to hold log->lock.
  */
 static size_t get_next_entry_by_uid(struct logger_log *log,
 		size_t off, uid_t euid)
 {
-	while (off != log->w_off) {
+	while (off != log->c_off) {
 		struct logger_entry *entry;
 		struct logger_entry scratch;
 		size_t next_len;
@@ -248,6 +285,7 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t off, msg_len;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -255,9 +293,9 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		ret = (log->c_off == reader->r_off);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -279,27 +317,45 @@ start:
 		return ret;
 
 	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
 		mutex_unlock(&log->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
+	off = reader->r_off;
+	msg_len = get_entry_msg_len(log, off);
+	ret = get_user_hdr_len(reader->r_ver) + msg_len;
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
+	reader->lapped = false;
+	spin_unlock(&log->lock);
 
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	ret = do_read_log_to_user(log, reader, off, buf, ret);
+
+	spin_lock(&log->lock);
+	if (unlikely(reader->lapped)) {
+		/* the entry was overwritten under us, read the next one */
+		spin_unlock(&log->lock);
+		mutex_unlock(&log->mutex);
+		goto start;
+	}
+	if (ret > 0)
+		reader->r_off = logger_offset(off +
+			sizeof(struct logger_entry) + msg_len);
+	spin_unlock(&log->lock);
 
 out:
 	mutex_unlock(&log->mutex);
@@ -311,7 +367,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -350,7 +406,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -362,67 +418,185 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 		log->head = get_next_entry(log, log->head, len);
 
 	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
+		if (clock_interval(old, new, reader->r_off)) {
 			reader->r_off = get_next_entry(log, reader->r_off, len);
+			reader->lapped = true;
+		}
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * logger_inflight - bytes reserved by writes that are not committed yet
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static size_t logger_inflight(struct logger_log *log)
 {
-	size_t len;
+	struct logger_reservation *oldest;
 
-	// if logger mode is disabled, terminate instantly
-	if (logger_mode == 0)
-	{
-			return;
+	if (list_empty(&log->inflight))
+		return 0;
+
+	oldest = list_first_entry(&log->inflight,
+				  struct logger_reservation, list);
+	return logger_offset(log->w_off - oldest->start);
+}
+
+/*
+ * logger_reserve - claims 'len' bytes at the write head for one entry and
+ * returns their offset. Lapped readers are pulled forward now, so the
+ * entry can be copied in without any lock held.
+ *
+ * fix_up_readers() walks entries past the new write head, which must not
+ * run into space that is still being written. In the unlikely case that
+ * too much of the log is in flight, wait for the older writes to commit.
+ */
+static size_t logger_reserve(struct logger_log *log,
+			     struct logger_reservation *res, size_t len)
+{
+	spin_lock(&log->lock);
+	while (logger_inflight(log) + len + 2 * LOGGER_ENTRY_MAX_LEN >=
+	       log->size) {
+		spin_unlock(&log->lock);
+		schedule_timeout_uninterruptible(1);
+		spin_lock(&log->lock);
 	}
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	fix_up_readers(log, len);
 
-	if (count != len)
-		memcpy(log->buffer, buf + len, count - len);
+	res->start = log->w_off;
+	list_add_tail(&res->list, &log->inflight);
+	log->w_off = logger_offset(log->w_off + len);
+	spin_unlock(&log->lock);
 
-	log->w_off = logger_offset(log->w_off + count);
+	return res->start;
+}
 
+/*
+ * logger_retire - drops 'res' from the inflight list. Everything before
+ * the oldest write still in flight is committed.
+ *
+ * The caller needs to hold log->lock.
+ */
+static void logger_retire(struct logger_log *log,
+			  struct logger_reservation *res)
+{
+	list_del(&res->list);
+	if (list_empty(&log->inflight))
+		log->c_off = log->w_off;
+	else
+		log->c_off = list_first_entry(&log->inflight,
+				struct logger_reservation, list)->start;
+}
+
+static void logger_wake_timer_fn(unsigned long data)
+{
+	struct logger_log *log = (struct logger_log *) data;
+
+	wake_up_interruptible(&log->wq);
+}
+
+/*
+ * logger_commit - makes a reserved entry of 'len' bytes readable once all
+ * older writes are committed too, and wakes readers. Wakeups are batched:
+ * readers are woken once logger_wakeup_bytes have accumulated, otherwise
+ * by a timer after logger_wakeup_ms.
+ */
+static void logger_commit(struct logger_log *log,
+			  struct logger_reservation *res, size_t len)
+{
+	bool wake = false;
+
+	spin_lock(&log->lock);
+	logger_retire(log, res);
+	log->wake_bytes += len;
+	if (log->wake_bytes >= logger_wakeup_bytes) {
+		log->wake_bytes = 0;
+		wake = true;
+	}
+	spin_unlock(&log->lock);
+
+	/* pairs with the barrier in prepare_to_wait() in logger_read() */
+	smp_mb();
+	if (!waitqueue_active(&log->wq))
+		return;
+
+	if (wake)
+		wake_up_interruptible(&log->wq);
+	else if (!timer_pending(&log->wake_timer))
+		mod_timer(&log->wake_timer,
+			  jiffies + msecs_to_jiffies(logger_wakeup_ms));
+}
+
+/*
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at 'off'
+ *
+ * 'off' must lie in space reserved with logger_reserve().
+ */
+static void do_write_log(struct logger_log *log, size_t off,
+			 const void *buf, size_t count)
+{
+	size_t len;
+
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
+
+	if (count != len)
+		memcpy(log->buffer, buf + len, count - len);
 }
 
 /*
  * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * the log 'log' at 'off'
  *
- * The caller needs to hold log->mutex.
+ * 'off' must lie in space reserved with logger_reserve().
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	// if logger mode is disabled, terminate instantly
-	if (logger_mode == 0)
-	{
-			return;
-	}
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * logger_abort - gives up a reserved entry of 'len' bytes whose payload
+ * could not be copied in. The space is handed back if nothing was reserved
+ * after it; otherwise the 'left' payload bytes at 'off' are zeroed so the
+ * entry stays well-formed, and it is committed.
+ */
+static void logger_abort(struct logger_log *log,
+			 struct logger_reservation *res, size_t len,
+			 size_t off, size_t left)
+{
+	size_t n;
+
+	spin_lock(&log->lock);
+	if (log->w_off == logger_offset(res->start + len)) {
+		log->w_off = res->start;
+		logger_retire(log, res);
+		spin_unlock(&log->lock);
+		return;
+	}
+	spin_unlock(&log->lock);
+
+	n = min(left, log->size - off);
+	memset(log->buffer + off, 0, n);
+	if (left != n)
+		memset(log->buffer, 0, left - n);
+
+	logger_commit(log, res, len);
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
@@ -432,9 +606,10 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	struct logger_reservation res;
 	struct logger_entry header;
 	struct timespec now;
+	size_t off, len;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -451,41 +626,42 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	/* if logger mode is disabled, drop the entry */
+	if (logger_mode == 0)
+		return header.len;
 
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Reserve the whole entry up front. Any readers are pulled forward
+	 * to the first readable entry after (what will be) the new write
+	 * offset, so a partially failed write cannot leave clobbered
+	 * entries in readable buffer.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	len = sizeof(struct logger_entry) + header.len;
+	off = logger_reserve(log, &res, len);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, off, &header, sizeof(struct logger_entry));
+	off = logger_offset(off + sizeof(struct logger_entry));
 
 	while (nr_segs-- > 0) {
-		size_t len;
+		size_t seg;
 		ssize_t nr;
 
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
+		seg = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, off, iov->iov_base, seg);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
+			logger_abort(log, &res, len, off, header.len - ret);
 			return nr;
 		}
 
+		off = logger_offset(off + nr);
 		iov++;
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
-
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	logger_commit(log, &res, len);
 
 	return ret;
 }
@@ -524,9 +700,13 @@ static int logger_open(struct inode *inode, struct file *file)
 
 		INIT_LIST_HEAD(&reader->list);
 
+		reader->lapped = false;
+
 		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
+		spin_unlock(&log->lock);
 		mutex_unlock(&log->mutex);
 
 		file->private_data = reader;
@@ -548,7 +728,9 @@ static int logger_release(struct inode *ignored, struct file *file)
 		struct logger_log *log = reader->log;
 
 		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
 		mutex_unlock(&log->mutex);
 
 		kfree(reader);
@@ -581,12 +763,14 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	poll_wait(file, &log->wq, wait);
 
 	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
-	if (log->w_off != reader->r_off)
+	if (log->c_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
+	spin_unlock(&log->lock);
 	mutex_unlock(&log->mutex);
 
 	return ret;
@@ -624,10 +808,12 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		spin_lock(&log->lock);
+		if (log->c_off >= reader->r_off)
+			ret = log->c_off - reader->r_off;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = (log->size - reader->r_off) + log->c_off;
+		spin_unlock(&log->lock);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -636,24 +822,28 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 		reader = file->private_data;
 
+		spin_lock(&log->lock);
 		if (!reader->r_all)
 			reader->r_off = get_next_entry_by_uid(log,
 				reader->r_off, current_euid());
 
-		if (log->w_off != reader->r_off)
+		if (log->c_off != reader->r_off)
 			ret = get_user_hdr_len(reader->r_ver) +
 				get_entry_msg_len(log, reader->r_off);
 		else
 			ret = 0;
+		spin_unlock(&log->lock);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
+		spin_lock(&log->lock);
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		log->head = log->c_off;
+		spin_unlock(&log->lock);
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -708,9 +898,14 @@ static struct logger_log VAR = { \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
+	.inflight = LIST_HEAD_INIT(VAR .inflight), \
 	.w_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
+	.wake_timer = TIMER_INITIALIZER(logger_wake_timer_fn, 0, \
+				(unsigned long) &VAR), \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 64*1024)
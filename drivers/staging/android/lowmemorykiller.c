@@ -16,6 +16,12 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With CONFIG_VMPRESSURE, setting /sys/module/lowmemorykiller/parameters/
+ * use_vmpressure makes kills follow the reclaim pressure level instead: each
+ * low/medium/critical event kills a process with an oom_adj of at least the
+ * matching entry of pressure_adj. pressure_events and pressure_kills count
+ * the events seen and the kills made per level.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -36,6 +42,12 @@
 #include <linux/sched.h>
 #include <linux/notifier.h>
 #include <linux/compaction.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/vmpressure.h>
 
 //<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
 //<!-- MOD : make LMK see swap condition 
@@ -77,12 +89,184 @@ char *lmk_kill_info = 0;*/
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
+/* Serializes victim selection between the shrinker and pressure events */
+static DEFINE_MUTEX(lowmem_scan_lock);
+
+/*
+ * With use_vmpressure set, kills are driven by vmpressure levels instead
+ * of the minfree watermarks: a level kills the process with the highest
+ * oom_adj >= pressure_adj[level]. A value above OOM_ADJUST_MAX means no
+ * kill at that level.
+ */
+static bool lowmem_use_vmpressure;
+#ifdef CONFIG_VMPRESSURE
+static int lowmem_pressure_adj[VMPRESSURE_NUM_LEVELS] = {
+	OOM_ADJUST_MAX + 1,	/* low */
+	12,			/* medium */
+	6,			/* critical */
+};
+static unsigned int lowmem_pressure_events[VMPRESSURE_NUM_LEVELS];
+static unsigned int lowmem_pressure_kills[VMPRESSURE_NUM_LEVELS];
+#endif
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
 			printk(x);			\
 	} while (0)
 
+/*
+ * Process group leaders, bucketed by oom_adj, so that lowmem_shrink() only
+ * looks at the processes it may kill instead of walking the whole task
+ * list. The buckets are protected by tasklist_lock; fork, exit and exec
+ * already hold it for writing when they call in here.
+ */
+#define LOWMEM_NR_ADJ	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+static struct list_head lowmem_tasks[LOWMEM_NR_ADJ];
+static bool lowmem_tasks_ready;
+
+static struct list_head *lowmem_bucket(struct task_struct *p)
+{
+	int oom_adj = clamp_t(int, p->signal->oom_adj,
+				OOM_DISABLE, OOM_ADJUST_MAX);
+
+	return &lowmem_tasks[oom_adj - OOM_DISABLE];
+}
+
+/* New task, called with tasklist_lock held for writing */
+void lowmem_task_add(struct task_struct *p)
+{
+	INIT_LIST_HEAD(&p->lowmem_node);
+	if (lowmem_tasks_ready && thread_group_leader(p))
+		list_add_tail(&p->lowmem_node, lowmem_bucket(p));
+}
+
+/* Process released, called with tasklist_lock held for writing */
+void lowmem_task_del(struct task_struct *p)
+{
+	list_del_init(&p->lowmem_node);
+}
+
+/* Exec by a thread, called with tasklist_lock held for writing */
+void lowmem_task_replace(struct task_struct *old, struct task_struct *new)
+{
+	if (!list_empty(&old->lowmem_node))
+		list_replace_init(&old->lowmem_node, &new->lowmem_node);
+}
+
+/*
+ * oom_adj of the process changed. Must not be called with task_lock()
+ * held: lowmem_shrink() takes it under tasklist_lock.
+ */
+void lowmem_task_update(struct task_struct *p)
+{
+	unsigned long flags;
+	struct task_struct *leader;
+
+	write_lock_irqsave(&tasklist_lock, flags);
+	leader = p->group_leader;
+	if (!list_empty(&leader->lowmem_node))
+		list_move_tail(&leader->lowmem_node, lowmem_bucket(leader));
+	write_unlock_irqrestore(&tasklist_lock, flags);
+}
+
+static void __init lowmem_tasks_init(void)
+{
+	struct task_struct *p;
+	int i;
+
+	write_lock_irq(&tasklist_lock);
+	for (i = 0; i < LOWMEM_NR_ADJ; i++)
+		INIT_LIST_HEAD(&lowmem_tasks[i]);
+	for_each_process(p)
+		list_add_tail(&p->lowmem_node, lowmem_bucket(p));
+	lowmem_tasks_ready = true;
+	write_unlock_irq(&tasklist_lock);
+}
+
+#ifdef CONFIG_DEBUG_FS
+/* log2 histogram of victim selection time in lowmem_shrink(), in us */
+#define LOWMEM_LAT_BUCKETS	16
+
+static atomic_t lowmem_lat_hist[LOWMEM_LAT_BUCKETS];
+static atomic_t lowmem_shrink_calls;
+static atomic_t lowmem_shrink_scans;
+static u32 lowmem_lat_max_us;
+
+static void lowmem_lat_account(ktime_t start)
+{
+	u32 us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	atomic_inc(&lowmem_lat_hist[min_t(int, fls(us),
+					LOWMEM_LAT_BUCKETS - 1)]);
+	atomic_inc(&lowmem_shrink_scans);
+	if (us > lowmem_lat_max_us)
+		lowmem_lat_max_us = us;
+}
+
+static int lowmem_lat_show(struct seq_file *m, void *unused)
+{
+	int i;
+
+	seq_printf(m, "calls: %u scans: %u max: %uus\n",
+		   atomic_read(&lowmem_shrink_calls),
+		   atomic_read(&lowmem_shrink_scans), lowmem_lat_max_us);
+	for (i = 0; i < LOWMEM_LAT_BUCKETS; i++)
+		seq_printf(m, "%s%6uus: %u\n",
+			   i == LOWMEM_LAT_BUCKETS - 1 ? ">=" : " <",
+			   i == LOWMEM_LAT_BUCKETS - 1 ? 1U << (i - 1) : 1U << i,
+			   atomic_read(&lowmem_lat_hist[i]));
+	return 0;
+}
+
+static ssize_t lowmem_lat_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	int i;
+
+	for (i = 0; i < LOWMEM_LAT_BUCKETS; i++)
+		atomic_set(&lowmem_lat_hist[i], 0);
+	atomic_set(&lowmem_shrink_calls, 0);
+	atomic_set(&lowmem_shrink_scans, 0);
+	lowmem_lat_max_us = 0;
+	return count;
+}
+
+static int lowmem_lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lowmem_lat_show, inode->i_private);
+}
+
+static const struct file_operations lowmem_lat_fops = {
+	.open = lowmem_lat_open,
+	.read = seq_read,
+	.write = lowmem_lat_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *lowmem_debugfs;
+
+static void __init lowmem_debugfs_init(void)
+{
+	lowmem_debugfs = debugfs_create_dir("lowmemorykiller", NULL);
+	if (!lowmem_debugfs)
+		return;
+	debugfs_create_file("shrink_latency", S_IRUGO | S_IWUSR,
+			    lowmem_debugfs, NULL, &lowmem_lat_fops);
+}
+
+static void __exit lowmem_debugfs_exit(void)
+{
+	debugfs_remove_recursive(lowmem_debugfs);
+}
+#else
+static inline void lowmem_lat_account(ktime_t start) { }
+static inline void lowmem_debugfs_init(void) { }
+static inline void lowmem_debugfs_exit(void) { }
+#endif
+
 static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -101,16 +285,113 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+/*
+ * Kill the process with the highest oom_adj >= min_adj, the largest one
+ * among equals. Returns its size in pages, 0 if nothing was killed.
+ * Called with lowmem_scan_lock held.
+ */
+static int lowmem_kill(int min_adj)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
-	int rem = 0;
 	int tasksize;
+	int selected_tasksize = 0;
+	int selected_oom_adj = min_adj;
+	/* adj and pressure_adj may be set below the lowest bucket */
+	int lowest_adj = max(min_adj, OOM_DISABLE);
+	int adj;
+	ktime_t start;
+
+	start = ktime_get();
+	read_lock(&tasklist_lock);
+	/*
+	 * Higher oom_adj always wins, so the first bucket holding a
+	 * candidate decides; within it the largest RSS is picked.
+	 */
+	for (adj = OOM_ADJUST_MAX; adj >= lowest_adj && !selected; adj--) {
+		list_for_each_entry(p, &lowmem_tasks[adj - OOM_DISABLE],
+				    lowmem_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
+
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
+				continue;
+			}
+			oom_adj = sig->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+		//kiyong.choi@lge.com (+)
+			if(lowmem_deathpending && selected != lowmem_deathpending)
+			{
+			   if(selected_oom_adj > 5){
+					force_sig(SIGKILL, selected);
+					lowmem_print(1, "time out send sigkill to %d (%s), adj %d, size %d ****\n",
+						 selected->pid, selected->comm,
+						 selected_oom_adj, selected_tasksize);
+					selected=NULL;
+					continue;
+			   }
+			}
+	    	//kiyong.choi@lge.com (-)
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+				     p->pid, p->comm, oom_adj, tasksize);
+		}
+	}
+	if (selected) {
+		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
+			     selected->pid, selected->comm,
+			     selected_oom_adj, selected_tasksize);
+//<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
+//<!-- MOD : make LMK see swap condition 
+//DEL : bs.lim@lge.com
+/*	lmk_count++;
+		if(lmk_kill_info)
+			sprintf(lmk_kill_info, "%ul,%s,%d,%d\n",	lmk_count,
+													selected->comm,
+													selected_oom_adj,
+													selected_tasksize);*/
+//<!-- END: hyeongseok.kim@lge.com 2012-08-16 -->
+
+		lowmem_deathpending = selected;
+    //kiyong.choi@lge.com (+)
+		lowmem_deathpending_timeout = jiffies + (3*HZ/10);
+    //kiyong.choi@lge.com (-)
+    
+		//lowmem_deathpending_timeout = jiffies + HZ;		
+		force_sig(SIGKILL, selected);
+	}
+	read_unlock(&tasklist_lock);
+	lowmem_lat_account(start);
+
+	return selected ? selected_tasksize : 0;
+}
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	int rem = 0;
 	int i;
 	int min_adj = OOM_ADJUST_MAX + 1;
-	int selected_tasksize = 0;
-	int selected_oom_adj;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
@@ -153,6 +434,9 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	 * this pass.
 	 *
 	 */
+#ifdef CONFIG_DEBUG_FS
+	atomic_inc(&lowmem_shrink_calls);
+#endif
 	if (lowmem_deathpending &&
 	    time_before_eq(jiffies, lowmem_deathpending_timeout))
 		return 0;
@@ -176,12 +460,12 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		global_page_state(NR_ACTIVE_FILE) +
 		global_page_state(NR_INACTIVE_ANON) +
 		global_page_state(NR_INACTIVE_FILE);
-	if (sc->nr_to_scan <= 0 || min_adj == OOM_ADJUST_MAX + 1) {
+	if (sc->nr_to_scan <= 0 || min_adj == OOM_ADJUST_MAX + 1 ||
+	    lowmem_use_vmpressure) {
 		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
 	
 //<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
 //<!-- MOD : make LMK see swap condition 
@@ -190,81 +474,13 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		min_free_swap -= LMK_SWAP_DEC_KBYTES;*/
 //<!-- END: hyeongseok.kim@lge.com 2012-08-16 -->
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-	//kiyong.choi@lge.com (+)
-		if(lowmem_deathpending && selected != lowmem_deathpending)
-		{
-		   if(selected_oom_adj > 5){
-				force_sig(SIGKILL, selected);
-				lowmem_print(1, "time out send sigkill to %d (%s), adj %d, size %d ****\n",
-					 selected->pid, selected->comm,
-					 selected_oom_adj, selected_tasksize);
-				selected=NULL;
-				continue;
-		   }
-		}
-    	//kiyong.choi@lge.com (-)
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
-	}
-	if (selected) {
-		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-//<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
-//<!-- MOD : make LMK see swap condition 
-//DEL : bs.lim@lge.com
-/*	lmk_count++;
-		if(lmk_kill_info)
-			sprintf(lmk_kill_info, "%ul,%s,%d,%d\n",	lmk_count,
-													selected->comm,
-													selected_oom_adj,
-													selected_tasksize);*/
-//<!-- END: hyeongseok.kim@lge.com 2012-08-16 -->
+	if (!mutex_trylock(&lowmem_scan_lock))
+		return 0;
+	rem -= lowmem_kill(min_adj);
+	mutex_unlock(&lowmem_scan_lock);
 
-		lowmem_deathpending = selected;
-    //kiyong.choi@lge.com (+)
-		lowmem_deathpending_timeout = jiffies + (3*HZ/10);
-    //kiyong.choi@lge.com (-)
-    
-		//lowmem_deathpending_timeout = jiffies + HZ;		
-		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
-	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -273,6 +489,35 @@ static struct shrinker lowmem_shrinker = {
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+#ifdef CONFIG_VMPRESSURE
+static int lowmem_vmpressure_notify(struct notifier_block *nb,
+				    unsigned long level, void *data)
+{
+	int min_adj = lowmem_pressure_adj[level];
+
+	lowmem_pressure_events[level]++;
+	if (!lowmem_use_vmpressure || min_adj > OOM_ADJUST_MAX)
+		return NOTIFY_OK;
+
+	if (lowmem_deathpending &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout))
+		return NOTIFY_OK;
+
+	if (!mutex_trylock(&lowmem_scan_lock))
+		return NOTIFY_OK;
+	lowmem_print(3, "lowmem pressure level %lu, ma %d\n", level, min_adj);
+	if (lowmem_kill(min_adj))
+		lowmem_pressure_kills[level]++;
+	mutex_unlock(&lowmem_scan_lock);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call = lowmem_vmpressure_notify,
+};
+#endif
+
 static int __init lowmem_init(void)
 {
 //<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
@@ -281,13 +526,22 @@ static int __init lowmem_init(void)
 /*	lmk_kill_info = kmalloc(1024, GFP_KERNEL);*/
 //<!-- END: hyeongseok.kim@lge.com 2012-08-16 -->
 
+	lowmem_tasks_init();
 	task_free_register(&task_nb);
 	register_shrinker(&lowmem_shrinker);
+#ifdef CONFIG_VMPRESSURE
+	vmpressure_register_notifier(&lowmem_vmpressure_nb);
+#endif
+	lowmem_debugfs_init();
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	lowmem_debugfs_exit();
+#ifdef CONFIG_VMPRESSURE
+	vmpressure_unregister_notifier(&lowmem_vmpressure_nb);
+#endif
 	unregister_shrinker(&lowmem_shrinker);
 	task_free_unregister(&task_nb);
 //<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
@@ -305,6 +559,16 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+#ifdef CONFIG_VMPRESSURE
+module_param_named(use_vmpressure, lowmem_use_vmpressure, bool,
+		   S_IRUGO | S_IWUSR);
+module_param_array_named(pressure_adj, lowmem_pressure_adj, int, NULL,
+			 S_IRUGO | S_IWUSR);
+module_param_array_named(pressure_events, lowmem_pressure_events, uint, NULL,
+			 S_IRUGO);
+module_param_array_named(pressure_kills, lowmem_pressure_kills, uint, NULL,
+			 S_IRUGO);
+#endif
 //<!-- BEGIN: hyeongseok.kim@lge.com 2012-08-16 -->
 //<!-- MOD : make LMK see swap condition 
 //DEL : bs.lim@lge.com
@@ -0,0 +1,139 @@
+#undef TRACE_SYSTEM
+#define TRACE_INCLUDE_PATH ../../drivers/staging/android/trace
+#define TRACE_SYSTEM binder
+
+#if !defined(_TRACE_BINDER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_BINDER_H
+
+#include <linux/tracepoint.h>
+
+struct binder_transaction;
+
+DECLARE_EVENT_CLASS(binder_lock_class,
+	TP_PROTO(const char *tag),
+
+	TP_ARGS(tag),
+
+	TP_STRUCT__entry(
+		__field(const char *, tag)
+	),
+
+	TP_fast_assign(
+		__entry->tag = tag;
+	),
+
+	TP_printk("tag=%s", __entry->tag)
+);
+
+DEFINE_EVENT(binder_lock_class, binder_lock,
+	TP_PROTO(const char *tag),
+	TP_ARGS(tag)
+);
+
+DEFINE_EVENT(binder_lock_class, binder_locked,
+	TP_PROTO(const char *tag),
+	TP_ARGS(tag)
+);
+
+DEFINE_EVENT(binder_lock_class, binder_unlock,
+	TP_PROTO(const char *tag),
+	TP_ARGS(tag)
+);
+
+TRACE_EVENT(binder_transaction,
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 int to_proc, int to_thread, int to_node),
+
+	TP_ARGS(reply, t, to_proc, to_thread, to_node),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+		__field(unsigned int, policy)
+		__field(int, prio)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = to_node;
+		__entry->to_proc = to_proc;
+		__entry->to_thread = to_thread;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+		__entry->policy = t->priority.sched_policy;
+		__entry->prio = t->priority.prio;
+	),
+
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x policy=%u prio=%d",
+		  __entry->debug_id, __entry->target_node,
+		  __entry->to_proc, __entry->to_thread,
+		  __entry->reply, __entry->flags, __entry->code,
+		  __entry->policy, __entry->prio)
+);
+
+TRACE_EVENT(binder_transaction_received,
+	TP_PROTO(struct binder_transaction *t),
+
+	TP_ARGS(t),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+	),
+
+	TP_printk("transaction=%d", __entry->debug_id)
+);
+
+/*
+ * old_prio and new_prio are kernel priorities (0..MAX_PRIO-1, lower is
+ * more important). desired_prio differs from new_prio when the target
+ * lacked CAP_SYS_NICE and the request was capped to its rlimits.
+ */
+TRACE_EVENT(binder_set_priority,
+	TP_PROTO(int proc, int thread, unsigned int old_policy, int old_prio,
+		 unsigned int new_policy, int new_prio, int desired_prio),
+
+	TP_ARGS(proc, thread, old_policy, old_prio, new_policy, new_prio,
+		desired_prio),
+
+	TP_STRUCT__entry(
+		__field(int, proc)
+		__field(int, thread)
+		__field(unsigned int, old_policy)
+		__field(int, old_prio)
+		__field(unsigned int, new_policy)
+		__field(int, new_prio)
+		__field(int, desired_prio)
+	),
+
+	TP_fast_assign(
+		__entry->proc = proc;
+		__entry->thread = thread;
+		__entry->old_policy = old_policy;
+		__entry->old_prio = old_prio;
+		__entry->new_policy = new_policy;
+		__entry->new_prio = new_prio;
+		__entry->desired_prio = desired_prio;
+	),
+
+	TP_printk("proc=%d thread=%d old=%u:%d => new=%u:%d desired=%d",
+		  __entry->proc, __entry->thread,
+		  __entry->old_policy, __entry->old_prio,
+		  __entry->new_policy, __entry->new_prio,
+		  __entry->desired_prio)
+);
+
+#endif /* _TRACE_BINDER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
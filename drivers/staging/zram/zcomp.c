@@ -0,0 +1,346 @@
+/*
+ * Compressed RAM block device - compression backends
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/crypto.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+
+#include "zcomp.h"
+
+/* Size of each per-CPU compression buffer, in pages */
+#define ZCOMP_BUFFER_ORDER	1
+
+/*-- LZO backend */
+
+static void *zcomp_lzo_create(void)
+{
+	return kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+}
+
+static void zcomp_lzo_destroy(void *private)
+{
+	kfree(private);
+}
+
+static int zcomp_lzo_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	int ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len, private);
+
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static int zcomp_lzo_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret = lzo1x_decompress_safe(src, src_len, dst, &dst_len);
+
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static struct zcomp_backend zcomp_lzo = {
+	.name = "lzo",
+	.compress = zcomp_lzo_compress,
+	.decompress = zcomp_lzo_decompress,
+	.create = zcomp_lzo_create,
+	.destroy = zcomp_lzo_destroy,
+};
+
+/*-- LZ4 backend */
+
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+static void *zcomp_lz4_create(void)
+{
+	return kzalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+}
+
+static void zcomp_lz4_destroy(void *private)
+{
+	kfree(private);
+}
+
+static int zcomp_lz4_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	return lz4_compress(src, PAGE_SIZE, dst, dst_len, private);
+}
+
+static int zcomp_lz4_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret = lz4_decompress_unknownoutputsize(src, src_len, dst, &dst_len);
+
+	if (!ret && dst_len != PAGE_SIZE)
+		ret = LZ4_E_ERROR;
+	return ret;
+}
+
+static struct zcomp_backend zcomp_lz4 = {
+	.name = "lz4",
+	.compress = zcomp_lz4_compress,
+	.decompress = zcomp_lz4_decompress,
+	.create = zcomp_lz4_create,
+	.destroy = zcomp_lz4_destroy,
+};
+#endif
+
+/*-- Deflate backend (through crypto/deflate.c) */
+
+#ifdef CONFIG_ZRAM_DEFLATE_COMPRESS
+static void *zcomp_deflate_create(void)
+{
+	struct crypto_comp *tfm = crypto_alloc_comp("deflate", 0, 0);
+
+	return IS_ERR(tfm) ? NULL : tfm;
+}
+
+static void zcomp_deflate_destroy(void *private)
+{
+	crypto_free_comp(private);
+}
+
+static int zcomp_deflate_compress(const unsigned char *src,
+		unsigned char *dst, size_t *dst_len, void *private)
+{
+	unsigned int len = PAGE_SIZE << ZCOMP_BUFFER_ORDER;
+	int ret;
+
+	ret = crypto_comp_compress(private, src, PAGE_SIZE, dst, &len);
+	*dst_len = len;
+	return ret;
+}
+
+static int zcomp_deflate_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	unsigned int len = PAGE_SIZE;
+	int ret;
+
+	ret = crypto_comp_decompress(private, src, src_len, dst, &len);
+	if (!ret && len != PAGE_SIZE)
+		ret = -EIO;
+	return ret;
+}
+
+static struct zcomp_backend zcomp_deflate = {
+	.name = "deflate",
+	.compress = zcomp_deflate_compress,
+	.decompress = zcomp_deflate_decompress,
+	.create = zcomp_deflate_create,
+	.destroy = zcomp_deflate_destroy,
+};
+#endif
+
+static struct zcomp_backend *backends[] = {
+	&zcomp_lzo,
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	&zcomp_lz4,
+#endif
+#ifdef CONFIG_ZRAM_DEFLATE_COMPRESS
+	&zcomp_deflate,
+#endif
+	NULL
+};
+
+static struct zcomp_backend *find_backend(const char *compress)
+{
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (sysfs_streq(compress, backends[i]->name))
+			return backends[i];
+	}
+
+	return NULL;
+}
+
+bool zcomp_available_algorithm(const char *comp)
+{
+	return find_backend(comp) != NULL;
+}
+
+/* show available compressors, the selected one in square brackets */
+ssize_t zcomp_available_show(const char *comp, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (!strcmp(comp, backends[i]->name))
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"[%s] ", backends[i]->name);
+		else
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"%s ", backends[i]->name);
+	}
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+
+	return sz;
+}
+
+static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	if (zstrm->private)
+		comp->backend->destroy(zstrm->private);
+	free_pages((unsigned long)zstrm->buffer, ZCOMP_BUFFER_ORDER);
+
+	zstrm->private = NULL;
+	zstrm->buffer = NULL;
+}
+
+static int zcomp_strm_init(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	zstrm->private = comp->backend->create();
+	/*
+	 * Allocate two pages: the compressor may produce more than
+	 * PAGE_SIZE of output for incompressible input.
+	 */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+						ZCOMP_BUFFER_ORDER);
+	if (!zstrm->private || !zstrm->buffer) {
+		zcomp_strm_free(comp, zstrm);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+struct zcomp_strm *zcomp_strm_get(struct zcomp *comp)
+{
+	return get_cpu_ptr(comp->stream);
+}
+
+void zcomp_strm_put(struct zcomp *comp)
+{
+	put_cpu_ptr(comp->stream);
+}
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = comp->backend->compress(src, zstrm->buffer, dst_len,
+					zstrm->private);
+
+	u64_stats_update_begin(&zstrm->syncp);
+	zstrm->stats.comp_pages++;
+	zstrm->stats.comp_bytes += *dst_len;
+	zstrm->stats.comp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64_stats_update_end(&zstrm->syncp);
+
+	return ret;
+}
+
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst)
+{
+	struct zcomp_strm *zstrm;
+	ktime_t start = ktime_get();
+	int ret;
+
+	zstrm = zcomp_strm_get(comp);
+	ret = comp->backend->decompress(src, src_len, dst, zstrm->private);
+
+	u64_stats_update_begin(&zstrm->syncp);
+	zstrm->stats.decomp_pages++;
+	zstrm->stats.decomp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64_stats_update_end(&zstrm->syncp);
+	zcomp_strm_put(comp);
+
+	return ret;
+}
+
+void zcomp_get_stats(struct zcomp *comp, struct zcomp_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for_each_possible_cpu(cpu) {
+		struct zcomp_strm *zstrm = per_cpu_ptr(comp->stream, cpu);
+		struct zcomp_stats snap;
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin(&zstrm->syncp);
+			snap = zstrm->stats;
+		} while (u64_stats_fetch_retry(&zstrm->syncp, start));
+
+		stats->comp_pages += snap.comp_pages;
+		stats->comp_bytes += snap.comp_bytes;
+		stats->comp_ns += snap.comp_ns;
+		stats->decomp_pages += snap.decomp_pages;
+		stats->decomp_ns += snap.decomp_ns;
+	}
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		zcomp_strm_free(comp, per_cpu_ptr(comp->stream, cpu));
+	free_percpu(comp->stream);
+	kfree(comp);
+}
+
+/*
+ * Streams are set up for every possible CPU at creation time, so the
+ * write path never has to allocate or wait for a free stream.
+ */
+struct zcomp *zcomp_create(const char *compress)
+{
+	struct zcomp *comp;
+	struct zcomp_backend *backend;
+	int cpu;
+
+	backend = find_backend(compress);
+	if (!backend)
+		return ERR_PTR(-EINVAL);
+
+	comp = kzalloc(sizeof(struct zcomp), GFP_KERNEL);
+	if (!comp)
+		return ERR_PTR(-ENOMEM);
+
+	comp->backend = backend;
+	comp->stream = alloc_percpu(struct zcomp_strm);
+	if (!comp->stream) {
+		kfree(comp);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for_each_possible_cpu(cpu) {
+		if (zcomp_strm_init(comp, per_cpu_ptr(comp->stream, cpu))) {
+			pr_err("Error allocating %s stream for cpu %d\n",
+				backend->name, cpu);
+			zcomp_destroy(comp);
+			return ERR_PTR(-ENOMEM);
+		}
+	}
+
+	return comp;
+}
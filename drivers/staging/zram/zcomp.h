@@ -0,0 +1,79 @@
+/*
+ * Compressed RAM block device - compression backends
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/types.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+
+/*
+ * Per-backend counters. Each CPU only ever updates its own copy, so the
+ * write side needs no lock; readers fold all CPUs together.
+ */
+struct zcomp_stats {
+	u64 comp_pages;		/* pages passed to ->compress() */
+	u64 comp_bytes;		/* compressed bytes produced */
+	u64 comp_ns;		/* time spent in ->compress() */
+	u64 decomp_pages;	/* pages passed to ->decompress() */
+	u64 decomp_ns;		/* time spent in ->decompress() */
+};
+
+/* Per-CPU compression stream */
+struct zcomp_strm {
+	/* compression/decompression buffer, two pages long */
+	void *buffer;
+	/* backend private working memory */
+	void *private;
+	struct zcomp_stats stats;
+	struct u64_stats_sync syncp;
+};
+
+struct zcomp_backend {
+	const char *name;
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *private);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, void *private);
+	void *(*create)(void);
+	void (*destroy)(void *private);
+};
+
+struct zcomp {
+	struct zcomp_strm __percpu *stream;
+	struct zcomp_backend *backend;
+};
+
+ssize_t zcomp_available_show(const char *comp, char *buf);
+bool zcomp_available_algorithm(const char *comp);
+
+struct zcomp *zcomp_create(const char *comp);
+void zcomp_destroy(struct zcomp *comp);
+
+/*
+ * zcomp_strm_get() disables preemption until the matching
+ * zcomp_strm_put(); callers must not sleep in between.
+ */
+struct zcomp_strm *zcomp_strm_get(struct zcomp *comp);
+void zcomp_strm_put(struct zcomp *comp);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len);
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst);
+
+void zcomp_get_stats(struct zcomp *comp, struct zcomp_stats *stats);
+
+#endif /* _ZCOMP_H_ */
@@ -0,0 +1,204 @@
+/*
+ * Compressed RAM block device - content deduplication
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/* One hash bucket per this many disk pages, bounded below */
+#define ZRAM_DEDUP_PAGES_PER_BUCKET	64
+#define ZRAM_DEDUP_MIN_BUCKETS		64
+
+u32 zram_dedup_checksum(unsigned char *mem)
+{
+	return jhash2((u32 *)mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->hash[checksum % zram->hash_size];
+}
+
+static void zram_dedup_rb_insert(struct zram_hash *hash,
+				struct zram_entry *new)
+{
+	struct rb_node **rb_node = &hash->rb_root.rb_node, *parent = NULL;
+
+	while (*rb_node) {
+		struct zram_entry *entry;
+
+		parent = *rb_node;
+		entry = rb_entry(parent, struct zram_entry, rb_node);
+		/* Checksum collisions go to the right */
+		if (new->checksum < entry->checksum)
+			rb_node = &parent->rb_left;
+		else
+			rb_node = &parent->rb_right;
+	}
+
+	rb_link_node(&new->rb_node, parent, rb_node);
+	rb_insert_color(&new->rb_node, &hash->rb_root);
+}
+
+/*
+ * Decompress the candidate and compare it with the page being written.
+ * The compression stream buffer is free at this point of zram_write().
+ */
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+				unsigned char *mem)
+{
+	struct zcomp_strm *zstrm;
+	unsigned char *cmem;
+	bool match = false;
+
+	zstrm = zcomp_strm_get(zram->comp);
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	if (!zcomp_decompress(zram->comp, cmem, entry->len, zstrm->buffer))
+		match = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+	zcomp_strm_put(zram->comp);
+
+	return match;
+}
+
+/*
+ * Returns a referenced entry with the same content as 'page', or NULL.
+ * Only the first entry with a matching checksum is considered; a
+ * checksum collision simply counts as a miss.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry = NULL;
+	struct rb_node *rb_node;
+	unsigned char *mem;
+	bool match;
+
+	spin_lock(&hash->lock);
+	rb_node = hash->rb_root.rb_node;
+	while (rb_node) {
+		struct zram_entry *cur = rb_entry(rb_node,
+					struct zram_entry, rb_node);
+
+		if (checksum == cur->checksum) {
+			entry = cur;
+			entry->refcount++;
+			break;
+		}
+		rb_node = checksum < cur->checksum ?
+				rb_node->rb_left : rb_node->rb_right;
+	}
+	spin_unlock(&hash->lock);
+
+	if (!entry)
+		return NULL;
+
+	mem = kmap_atomic(page, KM_USER0);
+	match = zram_dedup_match(zram, entry, mem);
+	kunmap_atomic(mem, KM_USER0);
+
+	if (match)
+		return entry;
+
+	zram_dedup_put(zram, entry);
+	return NULL;
+}
+
+/*
+ * Make a freshly stored object available for deduplication. On failure
+ * the caller keeps owning the handle.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				u16 len, u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->handle = handle;
+
+	spin_lock(&hash->lock);
+	zram_dedup_rb_insert(hash, entry);
+	spin_unlock(&hash->lock);
+
+	atomic_inc(&zram->stats.dedup_entries);
+	return entry;
+}
+
+/* Drop a reference. Returns true if the object itself was freed. */
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, entry->checksum);
+	int refcount;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		rb_erase(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	if (refcount)
+		return false;
+
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+	atomic_dec(&zram->stats.dedup_entries);
+
+	return true;
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t i;
+
+	if (!zram->use_dedup)
+		return 0;
+
+	zram->hash_size = max_t(size_t, ZRAM_DEDUP_MIN_BUCKETS,
+				num_pages / ZRAM_DEDUP_PAGES_PER_BUCKET);
+	zram->hash = vzalloc(zram->hash_size * sizeof(struct zram_hash));
+	if (!zram->hash) {
+		pr_err("Error allocating zram dedup hash\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < zram->hash_size; i++) {
+		spin_lock_init(&zram->hash[i].lock);
+		zram->hash[i].rb_root = RB_ROOT;
+	}
+
+	return 0;
+}
+
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
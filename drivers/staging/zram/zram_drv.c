@@ -22,14 +22,16 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/bio.h>
+#include <linux/bit_spinlock.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
+#include <linux/err.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -42,14 +44,16 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static const char *default_compressor = "lzo";
+
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -71,39 +75,82 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 	zram_stat64_add(zram, v, 1);
 }
 
+/*
+ * The table flags share a word with the ZRAM_LOCK bit spinlock. They are
+ * only modified with the slot locked, so non-atomic updates are fine.
+ */
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_LOCK, &zram->table[index].value);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_LOCK, &zram->table[index].value);
+}
+
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	return zram->table[index].flags & BIT(flag);
+	return zram->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags |= BIT(flag);
+	zram->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags &= ~BIT(flag);
+	zram->table[index].value &= ~BIT(flag);
+}
+
+static size_t zram_get_obj_size(struct zram *zram, u32 index)
+{
+	return zram->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram *zram, u32 index, size_t size)
+{
+	unsigned long flags = zram->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * Check whether the page consists of a single repeated word. Comparing
+ * whole words keeps this as cheap as the old zero page check while also
+ * catching pattern filled pages.
+ */
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != val)
 			return 0;
 	}
 
+	*element = val;
 	return 1;
 }
 
+/* Handle of the compressed object backing a slot, shared or not */
+static unsigned long zram_get_handle(struct zram *zram, u32 index)
+{
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		return zram->table[index].entry->handle;
+
+	return zram->table[index].handle;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,56 +180,442 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/* Called with the slot locked */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
-
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	unsigned long handle = zram->table[index].handle;
+
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	/* An in-flight writeback of this slot is dropped at commit time */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		clear_bit(zram->table[index].blk_idx, zram->bitmap);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_stat_dec(&zram->stats.bd_count);
+		zram_stat_dec(&zram->stats.pages_stored);
+		zram->table[index].blk_idx = 0;
+		return;
+	}
+#endif
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		if (!zram->table[index].element)
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].element = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page(zram->table[index].page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram_get_obj_size(zram, index);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		if (!zram_dedup_put(zram, zram->table[index].entry)) {
+			/* Other slots still share the object */
+			zram_stat64_sub(zram, &zram->stats.dup_data_size,
+					clen);
+			clen = 0;
+		}
+	} else {
+		zs_free(zram->mem_pool, handle);
+	}
+
 out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram_set_obj_size(zram, index, 0);
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+struct zram_bd_read {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk_idx;
+	int error;
+};
+
+static void zram_bd_read_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static void zram_bd_read_work(struct work_struct *work)
+{
+	struct zram_bd_read *rd = container_of(work, struct zram_bd_read,
+						work);
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_bdev = rd->zram->bdev;
+	bio->bi_sector = rd->blk_idx << (PAGE_SHIFT - SECTOR_SHIFT);
+	bio->bi_end_io = zram_bd_read_end_io;
+	bio->bi_private = &done;
+	if (bio_add_page(bio, rd->page, PAGE_SIZE, 0) != PAGE_SIZE) {
+		bio_put(bio);
+		rd->error = -EIO;
+		return;
+	}
+
+	submit_bio(READ, bio);
+	wait_for_completion(&done);
+
+	rd->error = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+}
+
+/*
+ * Read a written back page. We are called from zram_make_request() with
+ * current->bio_list set, so a bio submitted here would only be issued
+ * after we return. Let a worker do the I/O and wait for it instead.
+ */
+static int zram_bd_read(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	struct zram_bd_read rd = {
+		.zram = zram,
+		.page = page,
+		.blk_idx = blk_idx,
+	};
+
+	INIT_WORK_ONSTACK(&rd.work, zram_bd_read_work);
+	queue_work(system_unbound_wq, &rd.work);
+	flush_work(&rd.work);
+	destroy_work_on_stack(&rd.work);
+
+	if (unlikely(rd.error)) {
+		pr_err("Backing device read failed! block=%lu\n", blk_idx);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return rd.error;
+	}
+
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+	flush_dcache_page(page);
+	return 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void zram_wb_end_io(struct bio *bio, int err)
+{
+	struct zram_wb_req *req = bio->bi_private;
+	struct zram *zram = req->zram;
+
+	req->error = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	if (atomic_dec_and_test(&zram->wb_inflight))
+		wake_up(&zram->wb_wait);
+}
+
+/*
+ * Wait for a batch of writeback bios and release the memory of the slots
+ * that made it to the backing device. Slots freed or rewritten while
+ * their bio was in flight lost ZRAM_UNDER_WB and keep their new data.
+ */
+static void zram_wb_commit(struct zram *zram, int nr)
+{
+	int i;
+
+	wait_event(zram->wb_wait, !atomic_read(&zram->wb_inflight));
+
+	for (i = 0; i < nr; i++) {
+		struct zram_wb_req *req = &zram->wb_reqs[i];
+		u32 index = req->index;
+		bool huge;
+
+		zram_slot_lock(zram, index);
+		if (req->error || !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
+
+			clear_bit(req->blk_idx, zram->bitmap);
+			if (req->error)
+				zram_stat64_inc(zram,
+					&zram->stats.bd_failed_writes);
+			continue;
+		}
+
+		huge = zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_free_page(zram, index);
+		zram->table[index].blk_idx = req->blk_idx;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_slot_unlock(zram, index);
+
+		zram_stat_inc(&zram->stats.pages_stored);
+		zram_stat_inc(&zram->stats.bd_count);
+		zram_stat64_inc(zram, huge ? &zram->stats.bd_huge_writes :
+					&zram->stats.bd_idle_writes);
+	}
+}
+
+/*
+ * Incompressible pages are always written back. On an idle pass, slots
+ * not accessed since the previous pass are written back too and all
+ * other slots are marked idle. Shared (dedup) objects stay in memory.
+ * Called with the slot locked.
+ */
+static bool zram_wb_eligible(struct zram *zram, u32 index, bool idle)
+{
+	if (zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_DEDUP) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+			!zram->table[index].handle)
+		return false;
+
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+		return true;
+
+	if (!idle)
+		return false;
+
+	if (zram_test_flag(zram, index, ZRAM_IDLE))
+		return true;
+
+	zram_set_flag(zram, index, ZRAM_IDLE);
+	return false;
+}
+
+/* Copy the uncompressed slot data to 'page'. Called with the slot locked. */
+static int zram_wb_copy(struct zram *zram, u32 index, struct page *page)
+{
+	int ret = 0;
+	unsigned long handle = zram->table[index].handle;
+	unsigned char *dst, *src;
+
+	dst = kmap_atomic(page, KM_USER0);
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		src = kmap_atomic(zram->table[index].page, KM_USER1);
+		memcpy(dst, src, PAGE_SIZE);
+		kunmap_atomic(src, KM_USER1);
+	} else {
+		src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+		ret = zcomp_decompress(zram->comp, src,
+				zram_get_obj_size(zram, index), dst);
+		zs_unmap_object(zram->mem_pool, handle);
+	}
+	kunmap_atomic(dst, KM_USER0);
+
+	return ret;
+}
+
+/*
+ * Write eligible slots to the backing device, up to ZRAM_WB_BATCH bios at
+ * a time. Slot data stays in memory, and readable, until its bio has
+ * completed.
+ */
+static void zram_writeback(struct zram *zram, bool idle)
+{
+	u32 index, num_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long blk_idx;
+	int nr = 0;
+
+	mutex_lock(&zram->wb_mutex);
+	for (index = 0; index < num_pages; index++) {
+		struct zram_wb_req *req = &zram->wb_reqs[nr];
+		struct bio *bio;
+
+		if (!(index % ZRAM_WB_SCAN_BATCH))
+			cond_resched();
+
+		zram_slot_lock(zram, index);
+		if (!zram_wb_eligible(zram, index, idle)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+
+		blk_idx = find_first_zero_bit(zram->bitmap, zram->nr_pages);
+		if (blk_idx >= zram->nr_pages) {
+			zram_slot_unlock(zram, index);
+			break;
+		}
+
+		if (zram_wb_copy(zram, index, req->page)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+		set_bit(blk_idx, zram->bitmap);
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+
+		req->index = index;
+		req->blk_idx = blk_idx;
+		req->error = 0;
+
+		bio = bio_alloc(GFP_NOIO, 1);
+		bio->bi_bdev = zram->bdev;
+		bio->bi_sector = blk_idx << (PAGE_SHIFT - SECTOR_SHIFT);
+		bio->bi_end_io = zram_wb_end_io;
+		bio->bi_private = req;
+		if (bio_add_page(bio, req->page, PAGE_SIZE, 0) != PAGE_SIZE) {
+			bio_put(bio);
+			req->error = -EIO;
+		} else {
+			atomic_inc(&zram->wb_inflight);
+			submit_bio(WRITE, bio);
+		}
+
+		if (++nr == ZRAM_WB_BATCH) {
+			zram_wb_commit(zram, nr);
+			nr = 0;
+		}
+	}
+	zram_wb_commit(zram, nr);
+	mutex_unlock(&zram->wb_mutex);
+}
+
+static void zram_wb_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, wb_work);
+
+	zram_writeback(zram, false);
+}
+
+static void zram_idle_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(to_delayed_work(work),
+					struct zram, idle_work);
+
+	zram_writeback(zram, true);
+
+	if (zram->wb_idle_secs)
+		queue_delayed_work(system_unbound_wq, &zram->idle_work,
+				zram->wb_idle_secs * HZ);
+}
+
+/* Writeback passes must have been stopped */
+static void zram_reset_bdev(struct zram *zram)
+{
+	int i;
+
+	if (zram->wb_reqs) {
+		for (i = 0; i < ZRAM_WB_BATCH; i++) {
+			if (zram->wb_reqs[i].page)
+				__free_page(zram->wb_reqs[i].page);
+		}
+		kfree(zram->wb_reqs);
+		zram->wb_reqs = NULL;
+	}
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+
+	if (zram->bdev)
+		blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->bdev = NULL;
+	zram->nr_pages = 0;
+	zram->backing_dev[0] = '\0';
+}
+
+/*
+ * Open the backing device. An empty path or "none" just drops the current
+ * one. Called with init_lock held on an uninitialized device.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int i, ret;
+	struct block_device *bdev;
+
+	zram_reset_bdev(zram);
+
+	if (!*path || !strcmp(path, "none"))
+		return 0;
+
+	bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				zram);
+	if (IS_ERR(bdev)) {
+		pr_err("Error opening backing device %s\n", path);
+		return PTR_ERR(bdev);
+	}
+	zram->bdev = bdev;
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto fail;
+
+	ret = -ENOMEM;
+	zram->nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	zram->bitmap = vzalloc(BITS_TO_LONGS(zram->nr_pages) * sizeof(long));
+	if (!zram->bitmap)
+		goto fail;
+
+	zram->wb_reqs = kcalloc(ZRAM_WB_BATCH, sizeof(*zram->wb_reqs),
+				GFP_KERNEL);
+	if (!zram->wb_reqs)
+		goto fail;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		zram->wb_reqs[i].zram = zram;
+		zram->wb_reqs[i].page = alloc_page(GFP_KERNEL);
+		if (!zram->wb_reqs[i].page)
+			goto fail;
+	}
+
+	strlcpy(zram->backing_dev, path, sizeof(zram->backing_dev));
+	pr_info("Using %s as backing device (%lu pages)\n",
+		path, zram->nr_pages);
+	return 0;
+
+fail:
+	zram_reset_bdev(zram);
+	return ret;
+}
+
+/* Called with init_lock held */
+void zram_set_wb_idle_secs(struct zram *zram, unsigned int secs)
+{
+	zram->wb_idle_secs = secs;
+
+	cancel_delayed_work_sync(&zram->idle_work);
+	if (zram->init_done && zram->bdev && secs)
+		queue_delayed_work(system_unbound_wq, &zram->idle_work,
+				secs * HZ);
+}
+#else
+static inline int zram_bd_read(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	return -EIO;
+}
+#endif
+
+static void handle_same_page(struct page *page, unsigned long element)
 {
 	void *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		unsigned int pos;
+		unsigned long *fill = user_mem;
+
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*fill); pos++)
+			fill[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -194,80 +627,88 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic(zram->table[index].page, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
-static void zram_read(struct zram *zram, struct bio *bio)
+static int zram_bvec_read(struct zram *zram, struct page *page, u32 index)
 {
+	int ret;
+	unsigned long handle;
+	unsigned char *user_mem, *cmem;
 
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+	zram_slot_lock(zram, index);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		unsigned long blk_idx = zram->table[index].blk_idx;
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+		zram_slot_unlock(zram, index);
+		return zram_bd_read(zram, page, blk_idx);
+	}
 
-		page = bvec->bv_page;
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		handle_same_page(page, zram->table[index].element);
+		zram_slot_unlock(zram, index);
+		return 0;
+	}
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].handle)) {
+		zram_slot_unlock(zram, index);
+		pr_debug("Read before write: page=%u\n", index);
+		handle_same_page(page, 0);
+		return 0;
+	}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		zram_slot_unlock(zram, index);
+		return 0;
+	}
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
-		}
+	user_mem = kmap_atomic(page, KM_USER0);
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+	handle = zram_get_handle(zram, index);
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	ret = zcomp_decompress(zram->comp, cmem,
+			zram_get_obj_size(zram, index), user_mem);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+	zs_unmap_object(zram->mem_pool, handle);
+	kunmap_atomic(user_mem, KM_USER0);
+	zram_slot_unlock(zram, index);
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
-			zram_stat64_inc(zram, &zram->stats.failed_reads);
-			goto out;
-		}
+	flush_dcache_page(page);
+	return 0;
+}
 
-		flush_dcache_page(page);
+static void zram_read(struct zram *zram, struct bio *bio)
+{
+
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
+
+	zram_stat64_inc(zram, &zram->stats.num_reads);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_bvec_read(zram, bvec->bv_page, index))
+			goto out;
 		index++;
 	}
 
@@ -279,121 +720,190 @@ out:
 	bio_io_error(bio);
 }
 
-static void zram_write(struct zram *zram, struct bio *bio)
+/*
+ * The new data is prepared without the slot lock held since compressing
+ * and allocating may sleep. The old data is only dropped once the new
+ * data is ready.
+ */
+static int zram_bvec_write(struct zram *zram, struct page *page, u32 index)
 {
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
-
-	zram_stat64_inc(zram, &zram->stats.num_writes);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
-		unsigned char *user_mem, *cmem, *src;
-
-		page = bvec->bv_page;
-		src = zram->compress_buffer;
+	int ret;
+	size_t clen, alloc_len = 0;
+	unsigned long handle = 0, element;
+	u32 checksum = 0;
+	bool dedup_hit = false;
+	struct zram_entry *entry = NULL;
+	struct zcomp_strm *zstrm;
+	struct page *page_store = NULL;
+	unsigned char *user_mem, *cmem;
 
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (page_same_filled(user_mem, &element)) {
+		kunmap_atomic(user_mem, KM_USER0);
 
-		mutex_lock(&zram->lock);
+		zram_slot_lock(zram, index);
+		zram_free_page(zram, index);
+		zram->table[index].element = element;
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram_slot_unlock(zram, index);
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
+		if (!element)
 			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
-			index++;
-			continue;
+		zram_stat_inc(&zram->stats.pages_same);
+		return 0;
+	}
+	if (zram->use_dedup)
+		checksum = zram_dedup_checksum(user_mem);
+	kunmap_atomic(user_mem, KM_USER0);
+
+	if (zram->use_dedup) {
+		entry = zram_dedup_find(zram, page, checksum);
+		if (entry) {
+			clen = entry->len;
+			dedup_hit = true;
+			goto store;
 		}
+	}
+
+compress_again:
+	/* Preemption stays disabled until zcomp_strm_put() */
+	zstrm = zcomp_strm_get(zram->comp);
+	user_mem = kmap_atomic(page, KM_USER0);
+	ret = zcomp_compress(zram->comp, zstrm, user_mem, &clen);
+	kunmap_atomic(user_mem, KM_USER0);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+	if (unlikely(ret)) {
+		zcomp_strm_put(zram->comp);
+		zs_free(zram->mem_pool, handle);
+		pr_err("Compression failed! err=%d\n", ret);
+		zram_stat64_inc(zram, &zram->stats.failed_writes);
+		return ret;
+	}
 
-		kunmap_atomic(user_mem, KM_USER0);
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (unlikely(clen > max_zpage_size)) {
+		zcomp_strm_put(zram->comp);
+		zs_free(zram->mem_pool, handle);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
-			pr_err("Compression failed! err=%d\n", ret);
+		clen = PAGE_SIZE;
+		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!page_store)) {
+			pr_info("Error allocating memory for "
+				"incompressible page: %u\n", index);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+			return -ENOMEM;
 		}
 
+		user_mem = kmap_atomic(page, KM_USER0);
+		cmem = kmap_atomic(page_store, KM_USER1);
+		memcpy(cmem, user_mem, PAGE_SIZE);
+		kunmap_atomic(cmem, KM_USER1);
+		kunmap_atomic(user_mem, KM_USER0);
+
+		goto store;
+	}
+
+	/*
+	 * A previous pass may already have allocated the object;
+	 * the page can change under us, so it must still fit.
+	 */
+	if (handle && clen > alloc_len) {
+		zs_free(zram->mem_pool, handle);
+		handle = 0;
+	}
+
+	if (!handle) {
 		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
+		 * Try the allocation without sleeping while the
+		 * stream is held. On failure drop the stream,
+		 * allocate with reclaim allowed and compress again
+		 * since the per-CPU buffer may have been reused.
 		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
+		alloc_len = clen;
+		handle = zs_malloc(zram->mem_pool, alloc_len,
+				GFP_NOWAIT | __GFP_HIGHMEM | __GFP_NOWARN);
+		if (!handle) {
+			zcomp_strm_put(zram->comp);
+			handle = zs_malloc(zram->mem_pool, alloc_len,
+					GFP_NOIO | __GFP_HIGHMEM);
+			if (!handle) {
 				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
+					"compressed page: %u, size=%zu\n",
+					index, clen);
 				zram_stat64_inc(zram,
 					&zram->stats.failed_writes);
-				goto out;
+				return -ENOMEM;
 			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
-
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+			goto compress_again;
 		}
+	}
 
-memstore:
-		zram->table[index].offset = offset;
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zs_unmap_object(zram->mem_pool, handle);
+	zcomp_strm_put(zram->comp);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	if (zram->use_dedup)
+		entry = zram_dedup_insert(zram, handle, clen, checksum);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
+store:
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	zram_slot_lock(zram, index);
+	zram_free_page(zram, index);
+	if (page_store) {
+		zram->table[index].page = page_store;
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+	} else if (entry) {
+		zram->table[index].entry = entry;
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+	} else {
+		zram->table[index].handle = handle;
+	}
+	zram_set_obj_size(zram, index, clen);
+	zram_slot_unlock(zram, index);
+
+	/* Update stats */
+	if (dedup_hit) {
+		zram_stat64_inc(zram, &zram->stats.dedup_hits);
+		zram_stat64_add(zram, &zram->stats.dup_data_size, clen);
+	} else {
+		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	}
+	zram_stat_inc(&zram->stats.pages_stored);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+
+	if (page_store) {
+		zram_stat_inc(&zram->stats.pages_expand);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		/* Get the page out of memory */
+		if (zram->bdev)
+			queue_work(system_unbound_wq, &zram->wb_work);
 #endif
+	}
 
-		memcpy(cmem, src, clen);
+	return 0;
+}
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+static void zram_write(struct zram *zram, struct bio *bio)
+{
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
 
-		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+	zram_stat64_inc(zram, &zram->stats.num_writes);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
-		mutex_unlock(&zram->lock);
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_bvec_write(zram, bvec->bv_page, index))
+			goto out;
 		index++;
 	}
 
@@ -460,34 +970,34 @@ void zram_reset_device(struct zram *zram)
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Writeback passes walk the table */
+	cancel_delayed_work_sync(&zram->idle_work);
+	cancel_work_sync(&zram->wb_work);
+#endif
 
 	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
-			continue;
-
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+	if (zram->table) {
+		for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++)
+			zram_free_page(zram, index);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_bdev(zram);
+#endif
+
+	/* Free per-CPU compression streams */
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
+
+	zram_dedup_fini(zram);
+
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -511,17 +1021,11 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	zram->comp = zcomp_create(zram->compressor);
+	if (IS_ERR(zram->comp)) {
+		pr_err("Error initializing %s compressor\n", zram->compressor);
+		ret = PTR_ERR(zram->comp);
+		zram->comp = NULL;
 		goto fail;
 	}
 
@@ -535,12 +1039,16 @@ int zram_init_device(struct zram *zram)
 		goto fail;
 	}
 
+	ret = zram_dedup_init(zram, num_pages);
+	if (ret)
+		goto fail;
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -548,6 +1056,11 @@ int zram_init_device(struct zram *zram)
 	}
 
 	zram->init_done = 1;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram->bdev && zram->wb_idle_secs)
+		queue_delayed_work(system_unbound_wq, &zram->idle_work,
+				zram->wb_idle_secs * HZ);
+#endif
 	mutex_unlock(&zram->init_lock);
 
 	pr_debug("Initialization done!\n");
@@ -566,7 +1079,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
+	zram_slot_unlock(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +1094,16 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
+#ifdef CONFIG_ZRAM_WRITEBACK
+	mutex_init(&zram->wb_mutex);
+	init_waitqueue_head(&zram->wb_wait);
+	INIT_WORK(&zram->wb_work, zram_wb_work);
+	INIT_DELAYED_WORK(&zram->idle_work, zram_idle_work);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -713,6 +1235,9 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		zram_reset_bdev(zram);
+#endif
 	}
 
 	unregister_blkdev(zram_major, "zram");
@@ -17,8 +17,12 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zcomp.h"
+#include "zram_dedup.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +30,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -51,8 +43,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -63,13 +55,43 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
 #define ZRAM_LOGICAL_BLOCK_SIZE	4096
 
-/* Flags for zram pages (table[page_no].flags) */
+/* Max writeback bios in flight to the backing device */
+#define ZRAM_WB_BATCH		32
+
+/* Slots scanned between reschedule points of a writeback pass */
+#define ZRAM_WB_SCAN_BATCH	1024
+
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table[page_no].value hold the object
+ * size, the upper bits hold the zram_pageflags.
+ */
+#define ZRAM_FLAG_SHIFT		16
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
 	/* Page is stored uncompressed */
-	ZRAM_UNCOMPRESSED,
+	ZRAM_UNCOMPRESSED = ZRAM_FLAG_SHIFT,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, which is kept in
+	 * table[page_no].element. Zero filled pages are the common case.
+	 */
+	ZRAM_SAME,
+
+	/* Page is a shared, deduplicated object (table[page_no].entry) */
+	ZRAM_DEDUP,
+
+	/* Bit spinlock serializing all accesses to the slot */
+	ZRAM_LOCK,
+
+	/* Slot has not been accessed since the last idle scan */
+	ZRAM_IDLE,
+
+	/* Page lives on the backing device at table[page_no].blk_idx */
+	ZRAM_WB,
+
+	/* Page is being written back, its data is still in memory */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,12 +100,25 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
+	union {
+		unsigned long handle;	/* zsmalloc object */
+		struct page *page;	/* ZRAM_UNCOMPRESSED pages */
+		unsigned long element;	/* ZRAM_SAME fill pattern */
+		struct zram_entry *entry;	/* ZRAM_DEDUP object */
+		unsigned long blk_idx;	/* ZRAM_WB backing device block */
+	};
+	unsigned long value;	/* object size and zram_pageflags */
 } __attribute__((aligned(4)));
 
+/* A page on its way to the backing device */
+struct zram_wb_req {
+	struct zram *zram;
+	struct page *page;	/* copy of the slot data */
+	u32 index;
+	unsigned long blk_idx;
+	int error;
+};
+
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
 	u64 num_reads;		/* failed + successful */
@@ -92,20 +127,26 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 dedup_hits;		/* writes satisfied by an existing object */
+	u64 dup_data_size;	/* compressed bytes saved by dedup */
+	u64 bd_reads;		/* pages read from the backing device */
+	u64 bd_huge_writes;	/* incompressible pages written back */
+	u64 bd_idle_writes;	/* idle pages written back */
+	u64 bd_failed_writes;	/* writeback I/O errors */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of same filled pages, incl. zero */
+	atomic_t dedup_entries;	/* no. of shared objects */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	atomic_t bd_count;	/* no. of pages on the backing device */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zcomp *comp;	/* per-CPU compression streams */
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -116,6 +157,28 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
+	/* Compression backend, may only be changed before init */
+	char compressor[16];
+	/* Content deduplication, may only be changed before init */
+	bool use_dedup;
+	struct zram_hash *hash;
+	size_t hash_size;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Backing device, may only be changed before init */
+	char backing_dev[64];
+	struct block_device *bdev;
+	unsigned long *bitmap;		/* used backing device blocks */
+	unsigned long nr_pages;		/* backing device size in pages */
+	struct zram_wb_req *wb_reqs;	/* ZRAM_WB_BATCH requests */
+	struct mutex wb_mutex;		/* serializes writeback passes */
+	atomic_t wb_inflight;
+	wait_queue_head_t wb_wait;
+	struct work_struct wb_work;	/* writes back incompressible pages */
+	/* Pages idle for wb_idle_secs are written back, 0 disables */
+	unsigned int wb_idle_secs;
+	struct delayed_work idle_work;
+#endif
 
 	struct zram_stats stats;
 };
@@ -128,5 +191,9 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_set_wb_idle_secs(struct zram *zram, unsigned int secs);
+#endif
 
 #endif
@@ -0,0 +1,808 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2011  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc is a slab-like allocator for compressed pages. Objects of a
+ * given size class live in "zspages" of 1-4 physically discontiguous
+ * (highmem capable) pages, which keeps internal fragmentation low without
+ * needing higher order allocations. Objects are addressed through handles
+ * rather than pointers, so a compaction pass can move objects out of
+ * sparsely used zspages and give the freed pages back to the system.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the number of pages per zspage which wastes the least space at the
+ * end of the zspage for the given object size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size = i * PAGE_SIZE;
+		int waste = zspage_size % class_size;
+		int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	int inuse = zspage->inuse;
+	int max_objects = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse <= max_objects * (ZS_FULLNESS_THRESHOLD_FRAC - 1) /
+			ZS_FULLNESS_THRESHOLD_FRAC)
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+				enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	if (fullness >= _ZS_NR_FULLNESS_GROUPS)
+		return;
+
+	list_add(&zspage->list, &class->fullness_list[fullness]);
+	class->fullness_count[fullness]++;
+}
+
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	if (zspage->fullness >= _ZS_NR_FULLNESS_GROUPS)
+		return;
+
+	list_del_init(&zspage->list);
+	class->fullness_count[zspage->fullness]--;
+}
+
+/*
+ * Move the zspage to the list matching its current usage. Returns the new
+ * fullness group; ZS_EMPTY zspages are unlinked and must be freed by the
+ * caller.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(class, zspage);
+
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	remove_zspage(class, zspage);
+	insert_zspage(class, zspage, newfg);
+
+	return newfg;
+}
+
+static unsigned long *obj_head_map(struct size_class *class,
+				struct zspage *zspage, unsigned int idx)
+{
+	unsigned long off = (unsigned long)idx * class->size;
+
+	return kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER0) +
+			(off & ~PAGE_MASK);
+}
+
+static void obj_head_unmap(unsigned long *head)
+{
+	kunmap_atomic(head, KM_USER0);
+}
+
+/* Copy 'len' bytes at zspage offset 'off' to or from a linear buffer */
+static void zs_copy_obj(struct zspage *zspage, unsigned long off,
+			char *buf, int len, bool to_obj)
+{
+	while (len) {
+		struct page *page = zspage->pages[off >> PAGE_SHIFT];
+		unsigned long poff = off & ~PAGE_MASK;
+		int chunk = min_t(int, len, PAGE_SIZE - poff);
+		char *addr = kmap_atomic(page, KM_USER0);
+
+		if (to_obj)
+			memcpy(addr + poff, buf, chunk);
+		else
+			memcpy(buf, addr + poff, chunk);
+		kunmap_atomic(addr, KM_USER0);
+
+		buf += chunk;
+		off += chunk;
+		len -= chunk;
+	}
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		if (zspage->pages[i])
+			__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class_idx = class->index;
+	zspage->fullness = ZS_EMPTY;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i]) {
+			free_zspage(zspage);
+			return NULL;
+		}
+	}
+
+	/* Link all objects into the freelist */
+	for (i = 0; i < class->objs_per_zspage; i++) {
+		unsigned long *head = obj_head_map(class, zspage, i);
+		unsigned long next = i + 1;
+
+		if (next == class->objs_per_zspage)
+			next = OBJ_FREELIST_END;
+		*head = next << OBJ_TAG_BITS;
+		obj_head_unmap(head);
+	}
+	zspage->freelist = 0;
+
+	return zspage;
+}
+
+static unsigned int obj_malloc(struct size_class *class,
+			struct zspage *zspage, struct zs_handle *handle)
+{
+	unsigned int idx = zspage->freelist;
+	unsigned long *head;
+
+	BUG_ON(idx == OBJ_FREELIST_END);
+
+	head = obj_head_map(class, zspage, idx);
+	zspage->freelist = *head >> OBJ_TAG_BITS;
+	*head = (unsigned long)handle | OBJ_ALLOCATED_TAG;
+	obj_head_unmap(head);
+
+	zspage->inuse++;
+	return idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	unsigned long *head = obj_head_map(class, zspage, idx);
+
+	*head = (unsigned long)zspage->freelist << OBJ_TAG_BITS;
+	obj_head_unmap(head);
+
+	zspage->freelist = idx;
+	zspage->inuse--;
+}
+
+/* Allocation prefers the fullest zspage that still has room */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = ZS_ALMOST_FULL; i <= ZS_ALMOST_EMPTY; i++) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+/*
+ * Compaction
+ *
+ * Objects are moved from the least used almost-empty zspages into the
+ * fullest zspages of the same class. The relocation of a single object
+ * happens under the class lock and migrate_lock held for writing, so no
+ * user can have it mapped while it moves.
+ */
+
+/* Number of zspages which could be freed by compacting this class */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	if (!class->fullness_count[ZS_ALMOST_EMPTY])
+		return 0;
+
+	obj_wasted = class->zspages * class->objs_per_zspage -
+			class->objs_inuse;
+
+	return obj_wasted / class->objs_per_zspage;
+}
+
+static struct zspage *isolate_source_zspage(struct size_class *class)
+{
+	struct list_head *head = &class->fullness_list[ZS_ALMOST_EMPTY];
+
+	if (list_empty(head))
+		return NULL;
+
+	/* New zspages are added at the head, the tail is the oldest */
+	return list_entry(head->prev, struct zspage, list);
+}
+
+static struct zspage *isolate_target_zspage(struct size_class *class,
+					struct zspage *src)
+{
+	struct zspage *zspage;
+	int i;
+
+	for (i = ZS_ALMOST_FULL; i <= ZS_ALMOST_EMPTY; i++) {
+		list_for_each_entry(zspage, &class->fullness_list[i], list) {
+			if (zspage != src)
+				return zspage;
+		}
+	}
+
+	return NULL;
+}
+
+static int find_alloced_obj(struct size_class *class, struct zspage *zspage,
+				unsigned int start)
+{
+	unsigned int idx;
+
+	for (idx = start; idx < class->objs_per_zspage; idx++) {
+		unsigned long *head = obj_head_map(class, zspage, idx);
+		unsigned long val = *head;
+
+		obj_head_unmap(head);
+		if (val & OBJ_ALLOCATED_TAG)
+			return idx;
+	}
+
+	return -1;
+}
+
+static void migrate_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *src, struct zspage *dst)
+{
+	/* compaction runs with the class lock held, so preemption is off */
+	char *buf = this_cpu_ptr(pool->area)->vm_buf;
+	int len = class->size - ZS_HANDLE_SIZE;
+	int s_idx = 0;
+
+	while (src->inuse && dst->inuse < class->objs_per_zspage) {
+		struct zs_handle *handle;
+		unsigned long *head;
+		unsigned int d_idx;
+
+		s_idx = find_alloced_obj(class, src, s_idx);
+		BUG_ON(s_idx < 0);
+
+		head = obj_head_map(class, src, s_idx);
+		handle = (struct zs_handle *)(*head & ~OBJ_ALLOCATED_TAG);
+		obj_head_unmap(head);
+
+		d_idx = obj_malloc(class, dst, handle);
+
+		write_lock(&pool->migrate_lock);
+		zs_copy_obj(src, (unsigned long)s_idx * class->size +
+				ZS_HANDLE_SIZE, buf, len, false);
+		zs_copy_obj(dst, (unsigned long)d_idx * class->size +
+				ZS_HANDLE_SIZE, buf, len, true);
+		handle->zspage = dst;
+		handle->obj_idx = d_idx;
+		write_unlock(&pool->migrate_lock);
+
+		obj_free(class, src, s_idx);
+		class->objs_migrated++;
+		s_idx++;
+	}
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class)
+{
+	unsigned long pages_freed = 0;
+	struct zspage *src, *dst;
+
+	spin_lock(&class->lock);
+	while (zs_can_compact(class)) {
+		src = isolate_source_zspage(class);
+		dst = isolate_target_zspage(class, src);
+		if (!src || !dst)
+			break;
+
+		migrate_zspage(pool, class, src, dst);
+
+		fix_fullness_group(class, dst);
+		if (fix_fullness_group(class, src) == ZS_EMPTY) {
+			class->zspages--;
+			pages_freed += class->pages_per_zspage;
+			free_zspage(src);
+		}
+
+		if (need_resched()) {
+			spin_unlock(&class->lock);
+			cond_resched();
+			spin_lock(&class->lock);
+		}
+	}
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		pages_freed += zs_compact_class(pool, &pool->size_class[i]);
+
+	atomic_long_sub(pages_freed, &pool->pages_allocated);
+	atomic_long_add(pages_freed, &pool->pages_compacted);
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/*
+ * The shrinker lets memory pressure trigger compaction, so that pages
+ * return to the system as swap drains without anybody poking sysfs.
+ */
+static unsigned long zs_shrinker_count(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_to_free = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		pages_to_free += zs_can_compact(class) *
+					class->pages_per_zspage;
+		spin_unlock(&class->lock);
+	}
+
+	return pages_to_free;
+}
+
+static int zs_shrinker_scan(struct shrinker *shrinker,
+			struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+						shrinker);
+
+	if (sc->nr_to_scan)
+		zs_compact(pool);
+
+	return zs_shrinker_count(pool);
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *zs_stat_root;
+
+static int zs_classes_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	unsigned long total_objs = 0, total_used = 0, total_pages = 0;
+
+	seq_printf(s, " %5s %5s %12s %13s %6s %10s %10s %10s %16s\n",
+			"class", "size", "almost_full", "almost_empty",
+			"full", "obj_alloc", "obj_used", "pages_used",
+			"pages_per_zspage");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long almost_full, almost_empty, full;
+		unsigned long objs, used, pages;
+
+		spin_lock(&class->lock);
+		almost_full = class->fullness_count[ZS_ALMOST_FULL];
+		almost_empty = class->fullness_count[ZS_ALMOST_EMPTY];
+		full = class->fullness_count[ZS_FULL];
+		objs = class->zspages * class->objs_per_zspage;
+		used = class->objs_inuse;
+		pages = class->zspages * class->pages_per_zspage;
+		spin_unlock(&class->lock);
+
+		if (!objs)
+			continue;
+
+		seq_printf(s, " %5d %5d %12lu %13lu %6lu %10lu %10lu %10lu %16d\n",
+			i, class->size, almost_full, almost_empty, full,
+			objs, used, pages, class->pages_per_zspage);
+
+		total_objs += objs;
+		total_used += used;
+		total_pages += pages;
+	}
+
+	seq_printf(s, "\n %5s %5s %12s %13s %6s %10lu %10lu %10lu\n",
+			"Total", "", "", "", "", total_objs, total_used,
+			total_pages);
+	seq_printf(s, " pages compacted: %ld\n",
+			atomic_long_read(&pool->pages_compacted));
+
+	return 0;
+}
+
+static int zs_classes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_classes_show, inode->i_private);
+}
+
+static const struct file_operations zs_classes_fops = {
+	.open = zs_classes_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	if (!zs_stat_root)
+		return;
+
+	pool->stat_dentry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (!pool->stat_dentry)
+		return;
+
+	debugfs_create_file("classes", S_IRUGO, pool->stat_dentry, pool,
+				&zs_classes_fops);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->stat_dentry);
+}
+
+static int __init zs_init(void)
+{
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+	return 0;
+}
+module_init(zs_init);
+
+#else
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+
+#endif
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool, used for the handle cache and debugfs
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	int i, cpu;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	strlcpy(pool->name, name, sizeof(pool->name));
+	snprintf(pool->cache_name, sizeof(pool->cache_name),
+		"zs_handle-%s", name);
+	rwlock_init(&pool->migrate_lock);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int j;
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock_init(&class->lock);
+		for (j = 0; j < _ZS_NR_FULLNESS_GROUPS; j++)
+			INIT_LIST_HEAD(&class->fullness_list[j]);
+
+		class->index = i;
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+						class->size;
+	}
+
+	pool->handle_cachep = kmem_cache_create(pool->cache_name,
+				sizeof(struct zs_handle), 0, 0, NULL);
+	if (!pool->handle_cachep)
+		goto fail;
+
+	pool->area = alloc_percpu(struct mapping_area);
+	if (!pool->area)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = per_cpu_ptr(pool->area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf)
+			goto fail;
+	}
+
+	zs_pool_stat_create(pool);
+
+	pool->shrinker.shrink = zs_shrinker_scan;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+
+fail:
+	zs_destroy_pool(pool);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, cpu;
+
+	if (pool->shrinker.shrink)
+		unregister_shrinker(&pool->shrinker);
+	zs_pool_stat_destroy(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			struct zspage *zspage, *tmp;
+
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				pr_info("Freeing non-empty class %d\n",
+					class->size);
+				list_del(&zspage->list);
+				free_zspage(zspage);
+			}
+		}
+	}
+
+	if (pool->area) {
+		for_each_possible_cpu(cpu)
+			kfree(per_cpu_ptr(pool->area, cpu)->vm_buf);
+		free_percpu(pool->area);
+	}
+
+	if (pool->handle_cachep)
+		kmem_cache_destroy(pool->handle_cachep);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: flags for the backing page and metadata allocations
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	handle = kmem_cache_alloc(pool->handle_cachep, flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(class, flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(pool->handle_cachep, handle);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		spin_lock(&class->lock);
+		class->zspages++;
+		insert_zspage(class, zspage, ZS_ALMOST_EMPTY);
+	}
+
+	handle->zspage = zspage;
+	handle->class_idx = class->index;
+	handle->obj_idx = obj_malloc(class, zspage, handle);
+	class->objs_inuse++;
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fullness;
+
+	if (unlikely(!obj))
+		return;
+
+	/* An object never changes class, only its zspage */
+	class = &pool->size_class[handle->class_idx];
+
+	spin_lock(&class->lock);
+	zspage = handle->zspage;
+	obj_free(class, zspage, handle->obj_idx);
+	class->objs_inuse--;
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		class->zspages--;
+	spin_unlock(&class->lock);
+
+	if (fullness == ZS_EMPTY) {
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		free_zspage(zspage);
+	}
+
+	kmem_cache_free(pool->handle_cachep, handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: how the caller is going to access the object
+ *
+ * Objects within one page are mapped directly with kmap_atomic(); objects
+ * spanning two pages are copied through a per-CPU buffer. Preemption is
+ * disabled until zs_unmap_object().
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long obj,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct mapping_area *area;
+	struct size_class *class;
+	unsigned long off;
+
+	BUG_ON(!obj);
+
+	read_lock(&pool->migrate_lock);
+
+	class = &pool->size_class[handle->class_idx];
+	off = (unsigned long)handle->obj_idx * class->size;
+
+	area = get_cpu_ptr(pool->area);
+	area->vm_mm = mm;
+	area->zspage = handle->zspage;
+	area->offset = off + ZS_HANDLE_SIZE;
+	area->len = class->size - ZS_HANDLE_SIZE;
+
+	if ((off & ~PAGE_MASK) + class->size <= PAGE_SIZE) {
+		area->spans = false;
+		area->vm_addr = kmap_atomic(
+			area->zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		return area->vm_addr + (area->offset & ~PAGE_MASK);
+	}
+
+	area->spans = true;
+	if (mm != ZS_MM_WO)
+		zs_copy_obj(area->zspage, area->offset, area->vm_buf,
+				area->len, false);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long obj)
+{
+	struct mapping_area *area = this_cpu_ptr(pool->area);
+
+	if (!area->spans)
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	else if (area->vm_mm != ZS_MM_RO)
+		zs_copy_obj(area->zspage, area->offset, area->vm_buf,
+				area->len, true);
+
+	put_cpu_ptr(pool->area);
+	read_unlock(&pool->migrate_lock);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+u64 zs_get_pages_compacted(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_pages_compacted);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
@@ -0,0 +1,137 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2011  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE 0-order (possibly
+ * highmem) pages holding objects of a single size class. Objects are laid
+ * out back to back and may span page boundaries.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * Every object starts with a one word header. For an allocated object it
+ * holds the handle pointing back at it (with OBJ_ALLOCATED_TAG set), which
+ * is what lets compaction relocate objects. For a free object it holds
+ * the index of the next free object.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+#define OBJ_ALLOCATED_TAG	1UL
+#define OBJ_TAG_BITS		1
+#define OBJ_FREELIST_END	0xffff
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA apart. Object headers stay word
+ * aligned within a page since every class size is a multiple of the delta.
+ */
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+#define ZS_SIZE_CLASS_DELTA	16
+#define ZS_SIZE_CLASSES	((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * A zspage is "almost empty" when at most 3/4 of its objects are in use.
+ * Such zspages are the source of compaction; allocation prefers almost
+ * full ones to keep the number of partially used zspages low.
+ */
+#define ZS_FULLNESS_THRESHOLD_FRAC	4
+
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+};
+
+struct zspage {
+	struct list_head list;		/* fullness group list */
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	u16 inuse;			/* allocated objects */
+	u16 freelist;			/* first free object index */
+	u8 fullness;
+	u8 class_idx;
+};
+
+/*
+ * Handles returned to users point at one of these. Compaction updates the
+ * location while holding the pool's migrate_lock for writing.
+ */
+struct zs_handle {
+	struct zspage *zspage;
+	u16 obj_idx;
+	u16 class_idx;
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	unsigned long fullness_count[_ZS_NR_FULLNESS_GROUPS];
+
+	/* object size, including the handle header */
+	int size;
+	unsigned int index;
+	int pages_per_zspage;
+	int objs_per_zspage;
+
+	/* protected by lock */
+	unsigned long zspages;
+	unsigned long objs_inuse;
+	u64 objs_migrated;
+};
+
+/* Per-CPU state of the currently mapped object */
+struct mapping_area {
+	char *vm_buf;		/* bounce buffer for objects spanning pages */
+	char *vm_addr;		/* kmap address for objects within a page */
+	struct zspage *zspage;
+	unsigned long offset;	/* payload offset within the zspage */
+	int len;		/* payload length */
+	enum zs_mapmode vm_mm;
+	bool spans;
+};
+
+struct zs_pool {
+	char name[32];
+	char cache_name[48];
+
+	struct size_class size_class[ZS_SIZE_CLASSES];
+
+	/*
+	 * Taken for reading while an object is mapped and for writing when
+	 * compaction relocates an object. Lock order: class->lock, then
+	 * migrate_lock.
+	 */
+	rwlock_t migrate_lock;
+
+	struct kmem_cache *handle_cachep;
+	struct mapping_area __percpu *area;
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+
+	struct shrinker shrinker;
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *stat_dentry;
+#endif
+};
+
+#endif
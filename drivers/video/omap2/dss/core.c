@@ -135,6 +135,12 @@ static int dss_initialize_debugfs(void)
 			&dss_dump_regs, &dss_debug_fops);
 	debugfs_create_file("dispc", S_IRUGO, dss_debugfs_dir,
 			&dispc_dump_regs, &dss_debug_fops);
+	debugfs_create_file("dispc_shadow", S_IRUGO, dss_debugfs_dir,
+			&dispc_dump_shadow, &dss_debug_fops);
+#ifdef CONFIG_OMAP2_DSS_FIFOMERGE
+	debugfs_create_file("fifomerge", S_IRUGO, dss_debugfs_dir,
+			&dss_dump_fifomerge, &dss_debug_fops);
+#endif
 #ifdef CONFIG_OMAP2_DSS_RFBI
 	debugfs_create_file("rfbi", S_IRUGO, dss_debugfs_dir,
 			&rfbi_dump_regs, &dss_debug_fops);
@@ -23,6 +23,7 @@
 #define DSS_SUBSYS_NAME "DISPC"
 
 #include <linux/kernel.h>
+#include <linux/bitmap.h>
 #include <linux/dma-mapping.h>
 #include <linux/vmalloc.h>
 #include <linux/clk.h>
@@ -49,6 +50,11 @@
 #include "dss_features.h"
 #include "dispc.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/dss.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(dsscomp_apply);
+
 /* DISPC */
 #define DISPC_SZ_REGS			SZ_4K
 
@@ -89,6 +95,19 @@ struct dispc_irq_stats {
 	unsigned irqs[32];
 };
 
+#define DISPC_NR_REGS			(DISPC_SZ_REGS / sizeof(u32))
+
+struct dispc_shadow_stats {
+	unsigned frames;	/* batches that wrote something */
+	unsigned gos;
+	unsigned long writes;	/* register writes requested in batches */
+	unsigned long flushed;	/* of which reached the hardware */
+	unsigned last_writes, last_flushed, last_gos;
+	unsigned max_flushed;
+	/* current batch */
+	unsigned frame_writes, frame_flushed, frame_gos;
+};
+
 static struct {
 	struct platform_device *pdev;
 	void __iomem    *base;
@@ -113,6 +132,20 @@ static struct {
 	bool		ctx_valid;
 	u32		ctx[DISPC_SZ_REGS / sizeof(u32)];
 
+	/*
+	 * Shadow register cache.  Between dispc_shadow_begin() and
+	 * dispc_shadow_end(), writes are kept in shadow_pending and reach
+	 * the hardware in one pass before the GO bit is set, skipping the
+	 * ones that match what was last written (shadow_hw).
+	 */
+	bool		shadow_batch;
+	int		shadow_cpu;
+	u32		shadow_pending[DISPC_NR_REGS];
+	u32		shadow_hw[DISPC_NR_REGS];
+	DECLARE_BITMAP(shadow_dirty, DISPC_NR_REGS);
+	DECLARE_BITMAP(shadow_known, DISPC_NR_REGS);
+	struct dispc_shadow_stats shadow_stats;
+
 #ifdef CONFIG_OMAP2_DSS_COLLECT_IRQ_STATS
 	spinlock_t irq_stats_lock;
 	struct dispc_irq_stats irq_stats;
@@ -654,16 +687,129 @@ volatile unsigned long int GammaTable[] = {
 
 static void _omap_dispc_set_irqs(void);
 
+static void dispc_shadow_flush(void);
+
+/*
+ * Registers below CONTROL are interrupt and sysconfig, and the GO bits in
+ * CONTROL and CONTROL2 must be set after everything else.
+ */
+static inline bool dispc_reg_shadowed(const u16 idx)
+{
+	return idx > DISPC_CONTROL && idx != DISPC_CONTROL2 &&
+		idx < DISPC_SZ_REGS;
+}
+
+static inline bool dispc_shadow_batching(void)
+{
+	return dispc.shadow_batch &&
+		dispc.shadow_cpu == raw_smp_processor_id();
+}
+
 static inline void dispc_write_reg(const u16 idx, u32 val)
 {
+	if (dispc_reg_shadowed(idx)) {
+		if (dispc_shadow_batching()) {
+			dispc.shadow_pending[idx / sizeof(u32)] = val;
+			__set_bit(idx / sizeof(u32), dispc.shadow_dirty);
+			dispc.shadow_stats.frame_writes++;
+			return;
+		}
+		dispc.shadow_hw[idx / sizeof(u32)] = val;
+		set_bit(idx / sizeof(u32), dispc.shadow_known);
+	} else if (dispc_shadow_batching()) {
+		/* keep the order of the writes around this one */
+		dispc_shadow_flush();
+	}
+
 	__raw_writel(val, dispc.base + idx);
 }
 
 static inline u32 dispc_read_reg(const u16 idx)
 {
+	if (dispc_reg_shadowed(idx) && dispc_shadow_batching() &&
+	    test_bit(idx / sizeof(u32), dispc.shadow_dirty))
+		return dispc.shadow_pending[idx / sizeof(u32)];
+
 	return __raw_readl(dispc.base + idx);
 }
 
+/* writes the batched registers that changed to the hardware */
+static void dispc_shadow_flush(void)
+{
+	int r;
+
+	for_each_set_bit(r, dispc.shadow_dirty, DISPC_NR_REGS) {
+		u32 val = dispc.shadow_pending[r];
+
+		__clear_bit(r, dispc.shadow_dirty);
+
+		if (test_bit(r, dispc.shadow_known) &&
+		    dispc.shadow_hw[r] == val)
+			continue;
+
+		__raw_writel(val, dispc.base + r * sizeof(u32));
+		dispc.shadow_hw[r] = val;
+		set_bit(r, dispc.shadow_known);
+		dispc.shadow_stats.frame_flushed++;
+	}
+}
+
+/**
+ * dispc_shadow_begin - starts batching DISPC register writes
+ *
+ * Must be called with interrupts disabled, and ended with
+ * dispc_shadow_end() on the same CPU.  Writes from other CPUs are not
+ * batched.
+ */
+void dispc_shadow_begin(void)
+{
+	struct dispc_shadow_stats *st = &dispc.shadow_stats;
+
+	st->frame_writes = st->frame_flushed = st->frame_gos = 0;
+	dispc.shadow_cpu = smp_processor_id();
+	dispc.shadow_batch = true;
+}
+
+/**
+ * dispc_shadow_end - writes what is left of the batch and stops batching
+ */
+void dispc_shadow_end(void)
+{
+	struct dispc_shadow_stats *st = &dispc.shadow_stats;
+
+	dispc_shadow_flush();
+	dispc.shadow_batch = false;
+
+	if (!st->frame_writes && !st->frame_gos)
+		return;
+
+	st->frames++;
+	st->gos += st->frame_gos;
+	st->writes += st->frame_writes;
+	st->flushed += st->frame_flushed;
+	st->last_writes = st->frame_writes;
+	st->last_flushed = st->frame_flushed;
+	st->last_gos = st->frame_gos;
+	st->max_flushed = max(st->max_flushed, st->frame_flushed);
+}
+
+void dispc_dump_shadow(struct seq_file *s)
+{
+	struct dispc_shadow_stats st = dispc.shadow_stats;
+
+	seq_printf(s, "frames\t\t%u\n", st.frames);
+	seq_printf(s, "GOs\t\t%u\n", st.gos);
+	seq_printf(s, "writes\t\t%lu\n", st.writes);
+	seq_printf(s, "flushed\t\t%lu\n", st.flushed);
+	seq_printf(s, "skipped\t\t%lu\n", st.writes - st.flushed);
+	if (st.frames)
+		seq_printf(s, "per frame\t%lu writes, %lu flushed\n",
+			   st.writes / st.frames, st.flushed / st.frames);
+	seq_printf(s, "last frame\t%u writes, %u flushed, %u GOs\n",
+		   st.last_writes, st.last_flushed, st.last_gos);
+	seq_printf(s, "max flushed\t%u\n", st.max_flushed);
+}
+
 static int dispc_get_ctx_loss_count(void)
 {
 	struct device *dev = &dispc.pdev->dev;
@@ -1102,6 +1248,9 @@ void dispc_runtime_put(void)
 
 		dispc_save_context();
 
+		/* the registers may be reset before the next get */
+		bitmap_zero(dispc.shadow_known, DISPC_NR_REGS);
+
 		/* Sets DSS max latency constraint
 		 * * (allowing for deeper power state)
 		 * */
@@ -1187,6 +1336,14 @@ void dispc_go(enum omap_channel channel)
 	DSSDBG("GO %s\n", channel == OMAP_DSS_CHANNEL_LCD ? "LCD" :
 		(channel == OMAP_DSS_CHANNEL_LCD2 ? "LCD2" : "DIGIT"));
 
+	/* the GO latches everything batched so far, on all channels */
+	if (dispc_shadow_batching()) {
+		dispc_shadow_flush();
+		dispc.shadow_stats.frame_gos++;
+	}
+
+	trace_dispc_go(channel);
+
 	if (channel == OMAP_DSS_CHANNEL_LCD2)
 		REG_FLD_MOD(DISPC_CONTROL2, 1, bit, bit);
 	else
@@ -4113,6 +4270,9 @@ static irqreturn_t omap_dispc_irq_handler(int irq, void *arg)
 		return IRQ_NONE;
 	}
 
+	if (irqstatus & DISPC_TRACE_IRQS)
+		trace_dispc_irq(irqstatus);
+
 #ifdef CONFIG_OMAP2_DSS_COLLECT_IRQ_STATS
 	spin_lock(&dispc.irq_stats_lock);
 	dispc.irq_stats.irq_count++;
@@ -391,6 +391,8 @@ void dispc_uninit_platform_driver(void);
 void dispc_dump_clocks(struct seq_file *s);
 void dispc_dump_irqs(struct seq_file *s);
 void dispc_dump_regs(struct seq_file *s);
+void dispc_dump_shadow(struct seq_file *s);
+void dss_dump_fifomerge(struct seq_file *s);
 void dispc_irq_handler(void);
 void dispc_fake_vsync_irq(void);
 
@@ -454,6 +456,8 @@ int dispc_scaling_decision(u16 width, u16 height,
 
 bool dispc_go_busy(enum omap_channel channel);
 void dispc_go(enum omap_channel channel);
+void dispc_shadow_begin(void);
+void dispc_shadow_end(void);
 void dispc_enable_channel(enum omap_channel channel,
 		enum omap_display_type type, bool enable);
 bool dispc_is_channel_enabled(enum omap_channel channel);
@@ -30,6 +30,8 @@
 #include <linux/jiffies.h>
 #include <linux/ratelimit.h>
 #include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <video/omapdss.h>
 #include <plat/cpu.h>
@@ -1094,6 +1096,234 @@ static bool dispc_is_overlay_scaled(struct overlay_cache_data *oc)
 	return false;
 }
 
+static void dss_ovl_setup_fifo(enum omap_plane plane,
+		struct omap_dss_device *dssdev, struct overlay_cache_data *oc,
+		bool merged)
+{
+	u32 size = dispc_get_plane_fifo_size(plane);
+
+	switch (dssdev->type) {
+	case OMAP_DISPLAY_TYPE_DPI:
+	case OMAP_DISPLAY_TYPE_DBI:
+	case OMAP_DISPLAY_TYPE_SDI:
+	case OMAP_DISPLAY_TYPE_VENC:
+	case OMAP_DISPLAY_TYPE_HDMI:
+		default_get_overlay_fifo_thresholds(plane, size,
+				&oc->burst_size, &oc->fifo_low,
+				&oc->fifo_high);
+		break;
+#ifdef CONFIG_OMAP2_DSS_DSI
+	case OMAP_DISPLAY_TYPE_DSI:
+		dsi_get_overlay_fifo_thresholds(plane, size,
+				&oc->burst_size, &oc->fifo_low,
+				&oc->fifo_high);
+		break;
+#endif
+	default:
+		BUG();
+	}
+
+	/*
+	 * With the FIFOs merged, DMA still restarts at the low threshold of
+	 * a single FIFO but only stops when the merged one is full, so the
+	 * interconnect idles for longer between the refills.
+	 */
+	if (merged) {
+		int i;
+
+		for (i = 0; i < dss_feat_get_num_ovls(); i++)
+			if (i != plane)
+				oc->fifo_high += dispc_get_plane_fifo_size(i);
+	}
+}
+
+#ifdef CONFIG_OMAP2_DSS_FIFOMERGE
+/*
+ * FIFO merge gives the FIFOs of all overlays to the only enabled one. It is
+ * used when GFX alone is shown, typically a static home screen, and left
+ * as soon as another overlay gets enabled.
+ *
+ * The merge bit affects both managers at once, so the switch must not
+ * happen while another overlay still fetches. Entering waits until the
+ * other overlays are disabled in the hardware. Leaving is latched by one
+ * GO first, and the new overlays are only enabled with the next one. On
+ * manual update displays nothing is fetched while the registers are
+ * written, so both happen at once there.
+ */
+static struct {
+	bool active;
+	bool settling;		/* left, waiting for the GO to latch it */
+	u32 enters;
+	u32 leaves;
+	u32 deferred;		/* overlay enables held back while settling */
+	ktime_t since;
+	u64 merged_us;
+} fifomerge;
+
+static inline bool dss_fifomerge_active(void)
+{
+	return fifomerge.active;
+}
+
+/* other overlays wait until the unmerged FIFOs are latched */
+static bool dss_fifomerge_defer(enum omap_plane plane)
+{
+	if (!fifomerge.settling || plane == OMAP_DSS_GFX)
+		return false;
+
+	fifomerge.deferred++;
+	return true;
+}
+
+/* returns the overlay that would get the merged FIFO, or -1 */
+static int dss_fifomerge_candidate(void)
+{
+	const int num_ovls = dss_feat_get_num_ovls();
+	int i, found = -1;
+
+	for (i = 0; i < num_ovls; i++) {
+		if (!dss_cache.overlay_cache[i].enabled)
+			continue;
+		if (found >= 0)
+			return -1;
+		found = i;
+	}
+
+	return found == OMAP_DSS_GFX ? found : -1;
+}
+
+static void dss_fifomerge_set(bool merge)
+{
+	const int num_ovls = dss_feat_get_num_ovls();
+	ktime_t now = ktime_get();
+	int i;
+
+	for (i = 0; i < num_ovls; i++) {
+		struct overlay_cache_data *oc = &dss_cache.overlay_cache[i];
+		struct omap_overlay *ovl = omap_dss_get_overlay(i);
+
+		if (!oc->enabled || !ovl->manager || !ovl->manager->device)
+			continue;
+
+		dss_ovl_setup_fifo(i, ovl->manager->device, oc, merge);
+		oc->dirty = true;
+	}
+
+	dispc_enable_fifomerge(merge);
+
+	if (merge) {
+		fifomerge.enters++;
+		fifomerge.since = now;
+	} else {
+		fifomerge.leaves++;
+		fifomerge.merged_us += ktime_us_delta(now, fifomerge.since);
+	}
+	fifomerge.active = merge;
+}
+
+/*
+ * Called from configure_dispc() before the overlays are written. Returns
+ * true if a switch is still pending and configure_dispc() must be called
+ * again at the next VSYNC.
+ */
+static bool dss_fifomerge_update(const bool *mgr_busy)
+{
+	const int num_ovls = dss_feat_get_num_ovls();
+	const int num_mgrs = dss_feat_get_num_mgrs();
+	struct manager_cache_data *mc;
+	int plane, i;
+
+	if (fifomerge.settling) {
+		for (i = 0; i < num_mgrs; i++)
+			if (mgr_busy[i])
+				return true;
+		fifomerge.settling = false;
+	}
+
+	plane = dss_fifomerge_candidate();
+	if ((plane >= 0) == fifomerge.active)
+		return false;
+
+	if (fifomerge.active) {
+		/*
+		 * A pending GO would latch FIFOMERGE=0 while GFX still has
+		 * its merged thresholds. Wait for it, holding back the
+		 * other overlays meanwhile.
+		 */
+		for (i = 0; i < num_mgrs; i++) {
+			if (mgr_busy[i]) {
+				fifomerge.settling = true;
+				return true;
+			}
+		}
+
+		mc = &dss_cache.manager_cache[
+				dss_cache.overlay_cache[OMAP_DSS_GFX].channel];
+		dss_fifomerge_set(false);
+		fifomerge.settling = !mc->manual_upd_display;
+		return fifomerge.settling;
+	}
+
+	mc = &dss_cache.manager_cache[dss_cache.overlay_cache[plane].channel];
+	if (mc->manual_update && !mc->do_manual_update)
+		return false;
+
+	if (!mc->manual_upd_display) {
+		/* the other overlays must be off in the hardware already */
+		for (i = 0; i < num_mgrs; i++)
+			if (mgr_busy[i])
+				return true;
+		for (i = 0; i < num_ovls; i++) {
+			struct overlay_cache_data *oc =
+				&dss_cache.overlay_cache[i];
+
+			if (i != plane && (oc->dirty || oc->shadow_dirty))
+				return true;
+		}
+	}
+
+	dss_fifomerge_set(true);
+	return false;
+}
+
+void dss_dump_fifomerge(struct seq_file *s)
+{
+	unsigned long flags;
+	u64 merged_us;
+
+	spin_lock_irqsave(&dss_cache.lock, flags);
+	merged_us = fifomerge.merged_us;
+	if (fifomerge.active)
+		merged_us += ktime_us_delta(ktime_get(), fifomerge.since);
+
+	seq_printf(s, "merged\t\t%s%s\n", fifomerge.active ? "yes" : "no",
+		   fifomerge.settling ? " (settling)" : "");
+	seq_printf(s, "enters\t\t%u\n", fifomerge.enters);
+	seq_printf(s, "leaves\t\t%u\n", fifomerge.leaves);
+	seq_printf(s, "deferred\t%u\n", fifomerge.deferred);
+	seq_printf(s, "merged_ms\t%llu\n", div_u64(merged_us, USEC_PER_MSEC));
+	seq_printf(s, "gfx fifo\t%u/%u\n",
+		   dss_cache.overlay_cache[OMAP_DSS_GFX].fifo_low,
+		   dss_cache.overlay_cache[OMAP_DSS_GFX].fifo_high);
+	spin_unlock_irqrestore(&dss_cache.lock, flags);
+}
+#else
+static inline bool dss_fifomerge_active(void)
+{
+	return false;
+}
+
+static inline bool dss_fifomerge_defer(enum omap_plane plane)
+{
+	return false;
+}
+
+static inline bool dss_fifomerge_update(const bool *mgr_busy)
+{
+	return false;
+}
+#endif
+
 static int configure_overlay(enum omap_plane plane)
 {
 	struct overlay_cache_data *c;
@@ -1294,6 +1524,8 @@ static void configure_manager(enum omap_channel channel)
 
 /* configure_dispc() tries to write values from cache to shadow registers.
  * It writes only to those managers/overlays that are not busy.
+ * The register writes are batched by DISPC and reach the hardware in one
+ * pass right before the GO bits are set, unchanged registers are skipped.
  * returns 0 if everything could be written to shadow registers.
  * returns 1 if not everything could be written to shadow registers. */
 static int configure_dispc(void)
@@ -1312,11 +1544,16 @@ static int configure_dispc(void)
 	r = 0;
 	busy = false;
 
+	dispc_shadow_begin();
+
 	for (i = 0; i < num_mgrs; i++) {
 		mgr_busy[i] = dispc_go_busy(i);
 		mgr_go[i] = false;
 	}
 
+	if (dss_fifomerge_update(mgr_busy))
+		busy = true;
+
 	/* Commit overlay settings */
 	for (i = 0; i < num_ovls; ++i) {
 		oc = &dss_cache.overlay_cache[i];
@@ -1333,6 +1570,11 @@ static int configure_dispc(void)
 			continue;
 		}
 
+		if (dss_fifomerge_defer(i)) {
+			busy = true;
+			continue;
+		}
+
 		r = configure_overlay(i);
 		if (r)
 			DSSERR("configure_overlay %d failed\n", i);
@@ -1392,6 +1634,8 @@ static int configure_dispc(void)
 		}
 	}
 
+	dispc_shadow_end();
+
 	if (busy)
 		r = 1;
 	else
@@ -2003,7 +2247,6 @@ static int omap_dss_mgr_apply(struct omap_overlay_manager *mgr)
 	int i;
 	struct omap_overlay *ovl;
 	int num_planes_enabled = 0;
-	bool use_fifomerge;
 	unsigned long flags;
 	int r;
 
@@ -2199,25 +2442,9 @@ static int omap_dss_mgr_apply(struct omap_overlay_manager *mgr)
 
 skip_mgr:
 
-	/* XXX TODO: Try to get fifomerge working. The problem is that it
-	 * affects both managers, not individually but at the same time. This
-	 * means the change has to be well synchronized. I guess the proper way
-	 * is to have a two step process for fifo merge:
-	 *        fifomerge enable:
-	 *             1. disable other planes, leaving one plane enabled
-	 *             2. wait until the planes are disabled on HW
-	 *             3. config merged fifo thresholds, enable fifomerge
-	 *        fifomerge disable:
-	 *             1. config unmerged fifo thresholds, disable fifomerge
-	 *             2. wait until fifo changes are in HW
-	 *             3. enable planes
-	 */
-	use_fifomerge = false;
-
-	/* Configure overlay fifos */
+	/* Configure overlay fifos, configure_dispc() switches FIFO merge */
 	for (i = 0; i < omap_dss_get_num_overlays(); ++i) {
 		struct omap_dss_device *dssdev;
-		u32 size;
 
 		ovl = omap_dss_get_overlay(i);
 
@@ -2233,30 +2460,7 @@ skip_mgr:
 		if (!dssdev)
 			continue;
 
-		size = dispc_get_plane_fifo_size(ovl->id);
-		if (use_fifomerge)
-			size *= 3;
-
-		switch (dssdev->type) {
-		case OMAP_DISPLAY_TYPE_DPI:
-		case OMAP_DISPLAY_TYPE_DBI:
-		case OMAP_DISPLAY_TYPE_SDI:
-		case OMAP_DISPLAY_TYPE_VENC:
-		case OMAP_DISPLAY_TYPE_HDMI:
-			default_get_overlay_fifo_thresholds(ovl->id, size,
-					&oc->burst_size, &oc->fifo_low,
-					&oc->fifo_high);
-			break;
-#ifdef CONFIG_OMAP2_DSS_DSI
-		case OMAP_DISPLAY_TYPE_DSI:
-			dsi_get_overlay_fifo_thresholds(ovl->id, size,
-					&oc->burst_size, &oc->fifo_low,
-					&oc->fifo_high);
-			break;
-#endif
-		default:
-			BUG();
-		}
+		dss_ovl_setup_fifo(ovl->id, dssdev, oc, dss_fifomerge_active());
 	}
 
 	r = 0;
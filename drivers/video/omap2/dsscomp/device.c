@@ -424,6 +424,9 @@ static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			struct dss2_ovl_info ovl[MAX_OVERLAYS];
 		} m;
 		struct dsscomp_setup_dispc_data dispc;
+#ifdef CONFIG_DSSCOMP_FENCE
+		struct dsscomp_setup_dispc_fence_data fdispc;
+#endif
 		struct dsscomp_display_info dis;
 		struct dsscomp_check_ovl_data chk;
 		struct dsscomp_setup_display_data sdis;
@@ -448,6 +451,14 @@ static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		    dsscomp_gralloc_queue_ioctl(&u.dispc);
 		break;
 	}
+#ifdef CONFIG_DSSCOMP_FENCE
+	case DSSCIOC_SETUP_DISPC_FENCE:
+	{
+		r = copy_from_user(&u.fdispc, ptr, sizeof(u.fdispc)) ? :
+		    dsscomp_fence_queue_ioctl(&u.fdispc);
+		break;
+	}
+#endif
 	case DSSCIOC_QUERY_DISPLAY:
 	{
 		struct dsscomp_display_info *dis = NULL;
@@ -540,6 +551,10 @@ static int dsscomp_probe(struct platform_device *pdev)
 			cdev->dbgfs, dsscomp_dbg_comps, &dsscomp_debug_fops);
 		debugfs_create_file("gralloc", S_IRUGO,
 			cdev->dbgfs, dsscomp_dbg_gralloc, &dsscomp_debug_fops);
+#ifdef CONFIG_DSSCOMP_FENCE
+		debugfs_create_file("fence", S_IRUGO,
+			cdev->dbgfs, dsscomp_dbg_fence, &dsscomp_debug_fops);
+#endif
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
 		debugfs_create_file("log", S_IRUGO,
 			cdev->dbgfs, dsscomp_dbg_events, &dsscomp_debug_fops);
@@ -565,6 +580,11 @@ static int dsscomp_probe(struct platform_device *pdev)
 	/* initialize queues */
 	dsscomp_queue_init(cdev);
 	dsscomp_gralloc_init(cdev);
+#ifdef CONFIG_DSSCOMP_FENCE
+	ret = dsscomp_fence_init(cdev);
+	if (ret)
+		dev_warn(DEV(cdev), "no fence support (%d)\n", ret);
+#endif
 
 	return 0;
 }
@@ -574,6 +594,9 @@ static int dsscomp_remove(struct platform_device *pdev)
 	struct dsscomp_dev *cdev = platform_get_drvdata(pdev);
 	misc_deregister(&cdev->dev);
 	debugfs_remove_recursive(cdev->dbgfs);
+#ifdef CONFIG_DSSCOMP_FENCE
+	dsscomp_fence_exit();
+#endif
 	dsscomp_queue_exit();
 	dsscomp_gralloc_exit();
 	kfree(cdev);
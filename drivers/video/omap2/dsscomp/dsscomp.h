@@ -138,11 +138,20 @@ struct dsscomp_sync_obj {
 /*
  * Kernel interface
  */
+struct tiler_pa_info;
+
 int dsscomp_queue_init(struct dsscomp_dev *cdev);
 void dsscomp_queue_exit(void);
 void dsscomp_gralloc_init(struct dsscomp_dev *cdev);
 void dsscomp_gralloc_exit(void);
 int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d);
+void dsscomp_gralloc_map(struct dsscomp_setup_dispc_data *d,
+			 struct tiler_pa_info **pas);
+#ifdef CONFIG_DSSCOMP_FENCE
+int dsscomp_fence_init(struct dsscomp_dev *cdev);
+void dsscomp_fence_exit(void);
+int dsscomp_fence_queue_ioctl(struct dsscomp_setup_dispc_fence_data *f);
+#endif
 int dsscomp_wait(struct dsscomp_sync_obj *sync, enum dsscomp_wait_phase phase,
 								int timeout);
 int dsscomp_state_notifier(struct notifier_block *nb,
@@ -168,6 +177,7 @@ const char *dsscomp_get_color_name(enum omap_color_mode m);
 
 void dsscomp_dbg_comps(struct seq_file *s);
 void dsscomp_dbg_gralloc(struct seq_file *s);
+void dsscomp_dbg_fence(struct seq_file *s);
 
 #define log_state_str(s) (\
 	(s) == DSSCOMP_STATE_ACTIVE		? "ACTIVE"	: \
@@ -0,0 +1,358 @@
+/*
+ * linux/drivers/video/omap2/dsscomp/fence.c
+ *
+ * DSS Composition sync fence support
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * DSSCIOC_SETUP_DISPC_FENCE queues a gralloc composition together with an
+ * acquire fence for each overlay, and returns a release fence right away.
+ * A kernel thread waits for the acquire fences of the queued compositions
+ * in order and hands each one to the gralloc queue once all its buffers
+ * are ready, so the caller never blocks on the GPU.
+ *
+ * Release fences are points on a software sync timeline.  A composition
+ * retires when DSS releases its buffers, or when it is dropped because an
+ * acquire fence failed or timed out.  Compositions retire in queue order,
+ * and the timeline is advanced to the last retired one.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/file.h>
+#include <linux/sync.h>
+#include <linux/sw_sync.h>
+#include <mach/tiler.h>
+#include <video/dsscomp.h>
+#include <plat/dsscomp.h>
+#include "dsscomp.h"
+
+/* give up on a buffer that is not ready after this long */
+#define ACQUIRE_TIMEOUT_MS	1000
+/* compositions waiting for their acquire fences */
+#define MAX_WAITING		4
+
+enum fence_job_state {
+	JOB_WAITING,		/* waiting for acquire fences */
+	JOB_QUEUED,		/* handed to the gralloc queue */
+	JOB_DONE,		/* released or dropped, can retire */
+};
+
+struct fence_job {
+	struct list_head q;
+	enum fence_job_state state;
+	u32 value;		/* release fence point on the timeline */
+	ktime_t queued;
+	struct sync_fence *acquire[MAX_OVERLAYS];
+	struct tiler_pa_info *pas[MAX_OVERLAYS];
+	struct dsscomp_setup_dispc_data d;
+};
+
+static struct fence_stats {
+	u32 queued;
+	u32 displayed;
+	u32 dropped_timeout;
+	u32 dropped_error;
+	u32 rejected;
+	u32 max_waiting;
+	u32 max_inflight;
+	u32 wait_us;		/* running average of the acquire wait */
+	u32 max_wait_us;
+} stats;
+
+static struct dsscomp_dev *cdev;
+static struct sw_sync_timeline *timeline;
+static u32 timeline_next;	/* last point handed out */
+static u32 timeline_done;	/* last point signalled */
+
+/* all jobs that did not retire yet, in queue order */
+static LIST_HEAD(jobs);
+static u32 num_waiting, num_inflight;
+static DEFINE_MUTEX(fence_mtx);
+static DECLARE_WAIT_QUEUE_HEAD(fence_wq);
+static struct task_struct *fence_thread;
+
+static void put_acquire_fences(struct fence_job *job)
+{
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(job->acquire); i++) {
+		if (job->acquire[i])
+			sync_fence_put(job->acquire[i]);
+		job->acquire[i] = NULL;
+	}
+}
+
+/* retire done jobs from the head of the queue - call with fence_mtx held */
+static void retire_jobs(void)
+{
+	struct fence_job *job, *job_;
+	u32 done = timeline_done;
+	u32 i;
+
+	list_for_each_entry_safe(job, job_, &jobs, q) {
+		if (job->state != JOB_DONE)
+			break;
+		done = job->value;
+		list_del(&job->q);
+		for (i = 0; i < ARRAY_SIZE(job->pas); i++)
+			tiler_pa_free(job->pas[i]);
+		kfree(job);
+	}
+
+	if (timeline && done != timeline_done)
+		sw_sync_timeline_inc(timeline, done - timeline_done);
+	timeline_done = done;
+}
+
+static void dsscomp_fence_released(void *data, int status)
+{
+	struct fence_job *job = data;
+
+	mutex_lock(&fence_mtx);
+	job->state = JOB_DONE;
+	num_inflight--;
+	stats.displayed++;
+	retire_jobs();
+	mutex_unlock(&fence_mtx);
+}
+
+static int wait_acquire_fences(struct fence_job *job)
+{
+	ktime_t start = ktime_get();
+	u32 i, us;
+	int r = 0;
+
+	for (i = 0; i < ARRAY_SIZE(job->acquire) && !r; i++)
+		if (job->acquire[i])
+			r = sync_fence_wait(job->acquire[i],
+					    ACQUIRE_TIMEOUT_MS);
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	stats.wait_us += ((s32) us - (s32) stats.wait_us) / 8;
+	stats.max_wait_us = max(stats.max_wait_us, us);
+
+	return r;
+}
+
+static struct fence_job *next_waiting_job(void)
+{
+	struct fence_job *job;
+
+	list_for_each_entry(job, &jobs, q)
+		if (job->state == JOB_WAITING)
+			return job;
+	return NULL;
+}
+
+static int dsscomp_fence_thread(void *data)
+{
+	struct fence_job *job;
+	int r;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(fence_wq, kthread_should_stop() ||
+					 num_waiting);
+
+		mutex_lock(&fence_mtx);
+		job = next_waiting_job();
+		mutex_unlock(&fence_mtx);
+		if (!job)
+			continue;
+
+		/* only this thread moves jobs out of JOB_WAITING */
+		r = wait_acquire_fences(job);
+		put_acquire_fences(job);
+
+		mutex_lock(&fence_mtx);
+		num_waiting--;
+		if (r) {
+			dev_warn(DEV(cdev), "dropped composition "
+				 "%08x (%d)\n", job->d.sync_id, r);
+			if (r == -ETIME)
+				stats.dropped_timeout++;
+			else
+				stats.dropped_error++;
+			job->state = JOB_DONE;
+			retire_jobs();
+			mutex_unlock(&fence_mtx);
+			continue;
+		}
+		job->state = JOB_QUEUED;
+		num_inflight++;
+		stats.max_inflight = max(stats.max_inflight, num_inflight);
+		mutex_unlock(&fence_mtx);
+
+		/* the job may retire from within the call */
+		dsscomp_gralloc_queue(&job->d, job->pas, false,
+				      dsscomp_fence_released, job);
+	}
+
+	return 0;
+}
+
+/* queues a gralloc composition after its acquire fences, returns release fd */
+int dsscomp_fence_queue_ioctl(struct dsscomp_setup_dispc_fence_data *f)
+{
+	struct fence_job *job;
+	struct sync_fence *fence;
+	struct sync_pt *pt;
+	int fd, r;
+	u32 i;
+
+	if (!timeline)
+		return -ENODEV;
+
+	job = kzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+
+	job->d = f->dispc;
+	dsscomp_gralloc_map(&job->d, job->pas);
+
+	for (i = 0; i < job->d.num_ovls; i++) {
+		if (f->acquire_fence[i] < 0)
+			continue;
+		job->acquire[i] = sync_fence_fdget(f->acquire_fence[i]);
+		if (!job->acquire[i]) {
+			r = -EBADF;
+			goto err;
+		}
+	}
+
+	fd = get_unused_fd();
+	if (fd < 0) {
+		r = fd;
+		goto err;
+	}
+
+	mutex_lock(&fence_mtx);
+	if (num_waiting >= MAX_WAITING) {
+		stats.rejected++;
+		r = -EBUSY;
+		goto err_unlock;
+	}
+
+	pt = sw_sync_pt_create(timeline, timeline_next + 1);
+	fence = pt ? sync_fence_create("dsscomp", pt) : NULL;
+	if (!fence) {
+		if (pt)
+			sync_pt_free(pt);
+		r = -ENOMEM;
+		goto err_unlock;
+	}
+
+	job->value = ++timeline_next;
+	job->state = JOB_WAITING;
+	job->queued = ktime_get();
+	list_add_tail(&job->q, &jobs);
+	num_waiting++;
+	stats.queued++;
+	stats.max_waiting = max(stats.max_waiting, num_waiting);
+	mutex_unlock(&fence_mtx);
+
+	sync_fence_install(fence, fd);
+	wake_up(&fence_wq);
+
+	return fd;
+
+err_unlock:
+	mutex_unlock(&fence_mtx);
+	put_unused_fd(fd);
+err:
+	put_acquire_fences(job);
+	for (i = 0; i < ARRAY_SIZE(job->pas); i++)
+		tiler_pa_free(job->pas[i]);
+	kfree(job);
+	return r;
+}
+
+void dsscomp_dbg_fence(struct seq_file *s)
+{
+#ifdef CONFIG_DEBUG_FS
+	struct fence_job *job;
+	ktime_t now = ktime_get();
+
+	mutex_lock(&fence_mtx);
+	seq_printf(s, "depth:           %u waiting (max %u), %u on display "
+		   "(max %u)\n", num_waiting, stats.max_waiting,
+		   num_inflight, stats.max_inflight);
+	seq_printf(s, "queued:          %u\n", stats.queued);
+	seq_printf(s, "displayed:       %u\n", stats.displayed);
+	seq_printf(s, "dropped:         %u (%u timeout, %u error)\n",
+		   stats.dropped_timeout + stats.dropped_error,
+		   stats.dropped_timeout, stats.dropped_error);
+	seq_printf(s, "rejected:        %u\n", stats.rejected);
+	seq_printf(s, "acquire wait:    %u us avg, %u us max\n",
+		   stats.wait_us, stats.max_wait_us);
+	seq_printf(s, "timeline:        %u signalled, %u queued\n\n",
+		   timeline_done, timeline_next);
+
+	list_for_each_entry(job, &jobs, q)
+		seq_printf(s, "  [%p] %08x pt=%u %s for %lld us\n", job,
+			   job->d.sync_id, job->value,
+			   job->state == JOB_WAITING ? "waiting" :
+			   job->state == JOB_QUEUED ? "queued" : "done",
+			   ktime_us_delta(now, job->queued));
+	mutex_unlock(&fence_mtx);
+#endif
+}
+
+int dsscomp_fence_init(struct dsscomp_dev *cdev_)
+{
+	cdev = cdev_;
+
+	timeline = sw_sync_timeline_create("dsscomp");
+	if (!timeline)
+		return -ENOMEM;
+
+	fence_thread = kthread_run(dsscomp_fence_thread, NULL, "dsscomp_fence");
+	if (IS_ERR(fence_thread)) {
+		sync_timeline_destroy(&timeline->obj);
+		timeline = NULL;
+		return PTR_ERR(fence_thread);
+	}
+
+	return 0;
+}
+
+void dsscomp_fence_exit(void)
+{
+	struct fence_job *job;
+
+	if (!timeline)
+		return;
+
+	kthread_stop(fence_thread);
+
+	/* drop what never made it to the display */
+	mutex_lock(&fence_mtx);
+	list_for_each_entry(job, &jobs, q) {
+		if (job->state != JOB_WAITING)
+			continue;
+		put_acquire_fences(job);
+		job->state = JOB_DONE;
+		num_waiting--;
+	}
+	retire_jobs();
+
+	/* compositions still on display retire without signalling */
+	sync_timeline_destroy(&timeline->obj);
+	timeline = NULL;
+	mutex_unlock(&fence_mtx);
+}
@@ -124,16 +124,19 @@ static void dsscomp_gralloc_cb(void *data, int status)
 	}
 }
 
-/* This is just test code for now that does the setup + apply.
-   It still uses userspace virtual addresses, but maps non
-   TILER buffers into 1D */
-int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d)
+/*
+ * Converts the userspace virtual addresses of the overlays to physical and
+ * gets the tiler pa infos of non-TILER buffers.  Must be called in the
+ * context of the process owning the buffers.
+ */
+void dsscomp_gralloc_map(struct dsscomp_setup_dispc_data *d,
+			 struct tiler_pa_info **pas)
 {
-	struct tiler_pa_info *pas[MAX_OVERLAYS];
-	s32 ret;
 	u32 i;
 
-	/* convert virtual addresses to physical and get tiler pa infos */
+	/* pas has room for the overlays of this DSS only */
+	d->num_ovls = min(d->num_ovls, (u16) MAX_OVERLAYS);
+
 	for (i = 0; i < d->num_ovls; i++) {
 		struct dss2_ovl_info *oi = d->ovls + i;
 		u32 addr = (u32) oi->address;
@@ -154,6 +157,18 @@ int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d)
 				PAGE_ALIGN(oi->cfg.height * oi->cfg.stride +
 					(addr & ~PAGE_MASK)) >> PAGE_SHIFT);
 	}
+}
+
+/* This is just test code for now that does the setup + apply.
+   It still uses userspace virtual addresses, but maps non
+   TILER buffers into 1D */
+int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d)
+{
+	struct tiler_pa_info *pas[MAX_OVERLAYS];
+	s32 ret;
+	u32 i;
+
+	dsscomp_gralloc_map(d, pas);
 	ret = dsscomp_gralloc_queue(d, pas, false, NULL, NULL);
 	for (i = 0; i < d->num_ovls; i++)
 		tiler_pa_free(pas[i]);
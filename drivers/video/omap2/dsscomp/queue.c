@@ -30,6 +30,7 @@
 #include <plat/dsscomp.h>
 
 #include <linux/debugfs.h>
+#include <trace/events/dss.h>
 
 #include "dsscomp.h"
 /* queue state */
@@ -521,6 +522,7 @@ static int dsscomp_apply(dsscomp_t comp)
 	d = &comp->frm;
 
 	display_ix = d->mgr.ix;
+	trace_dsscomp_apply(d->sync_id, display_ix, d->num_ovls);
 
 	if (display_ix >= cdev->num_displays)
 		goto done;
@@ -183,6 +183,13 @@ static inline void cpuidle_unregister_governor(struct cpuidle_governor *gov) { }
 
 #endif
 
+#ifdef CONFIG_CPU_IDLE_GOV_IRQPREDICT
+extern void cpuidle_irq_record(unsigned int irq, unsigned long flags);
+#else
+static inline void cpuidle_irq_record(unsigned int irq, unsigned long flags)
+{ }
+#endif
+
 #ifdef CONFIG_ARCH_HAS_CPU_RELAX
 #define CPUIDLE_DRIVER_STATE_START	1
 #else
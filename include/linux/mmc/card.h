@@ -64,6 +64,9 @@ struct mmc_ext_csd {
 	unsigned long long	enhanced_area_offset;	/* Units: Byte */
 	unsigned int		enhanced_area_size;	/* Units: KB */
 	unsigned int		boot_size;		/* in bytes */
+	u8			max_packed_writes;	/* 500 */
+	u8			max_packed_reads;	/* 501 */
+	bool			packed_event_en;	/* packed failures reported */
 	u8			raw_partition_support;	/* 160 */
 	u8			raw_erased_mem_count;	/* 181 */
 	u8			raw_ext_csd_structure;	/* 194 */
@@ -79,6 +82,32 @@ struct mmc_ext_csd {
 	u8			raw_sectors[4];		/* 212 - 4 bytes */
 };
 
+/* Largest number of requests combined into one packed command */
+#define MMC_PACKED_NR_MAX	32
+
+/* Why the block driver stopped adding requests to a packed command */
+enum mmc_packed_stop_reason {
+	MMC_PACK_STOP_SEGMENTS = 0,	/* sg segments of the host used up */
+	MMC_PACK_STOP_SECTORS,		/* host max_blk_count reached */
+	MMC_PACK_STOP_DATA_DIR,		/* next request is a read */
+	MMC_PACK_STOP_FLUSH_DISCARD,	/* next request is a flush or discard */
+	MMC_PACK_STOP_EMPTY_QUEUE,	/* no more requests queued */
+	MMC_PACK_STOP_REL_WRITE,	/* legacy reliable write */
+	MMC_PACK_STOP_MAX_COUNT,	/* MMC_PACKED_NR_MAX or MAX_PACKED_WRITES */
+	MMC_PACK_STOP_REASONS,
+};
+
+/*
+ * Packed write statistics, shown in debugfs as wr_pack_stats.
+ * packing_events[n] counts the writes issued as a group of n requests.
+ */
+struct mmc_wr_pack_stats {
+	spinlock_t		lock;
+	bool			enabled;
+	u32			packing_events[MMC_PACKED_NR_MAX + 1];
+	u32			pack_stop_reason[MMC_PACK_STOP_REASONS];
+};
+
 struct sd_scr {
 	unsigned char		sda_vsn;
 	unsigned char		sda_spec3;
@@ -201,6 +230,7 @@ struct mmc_card {
 	struct mmc_cid		cid;		/* card identification */
 	struct mmc_csd		csd;		/* card specific */
 	struct mmc_ext_csd	ext_csd;	/* mmc v4 extended card specific */
+	struct mmc_wr_pack_stats wr_pack_stats;	/* packed write statistics */
 	struct sd_scr		scr;		/* extra SD information */
 	struct sd_ssr		ssr;		/* yet more SD information */
 	struct sd_switch_caps	sw_caps;	/* switch (CMD6) caps */
@@ -9,6 +9,8 @@
 #define LINUX_MMC_CORE_H
 
 #include <linux/interrupt.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
 #include <linux/device.h>
 
 struct request;
@@ -123,6 +125,7 @@ struct mmc_data {
 
 	unsigned int		sg_len;		/* size of scatter list */
 	struct scatterlist	*sg;		/* I/O scatter list */
+	s32			host_cookie;	/* host private data */
 };
 
 struct mmc_request {
@@ -132,15 +135,21 @@ struct mmc_request {
 	struct mmc_command	*stop;
 
 	void			*done_data;	/* completion data */
+	struct completion	completion;	/* used by mmc_start_req() */
 	void			(*done)(struct mmc_request *);/* completion function */
+	ktime_t			io_start;	/* when handed to the host */
 };
 
 struct mmc_host;
 struct mmc_card;
+struct mmc_async_req;
 
+extern struct mmc_async_req *mmc_start_req(struct mmc_host *,
+					   struct mmc_async_req *, int *);
 extern void mmc_wait_for_req(struct mmc_host *, struct mmc_request *);
 extern int mmc_wait_for_cmd(struct mmc_host *, struct mmc_command *, int);
 extern int mmc_app_cmd(struct mmc_host *, struct mmc_card *);
+extern int mmc_send_ext_csd(struct mmc_card *card, u8 *ext_csd);
 extern int mmc_wait_for_app_cmd(struct mmc_host *, struct mmc_card *,
 	struct mmc_command *, int);
 extern int mmc_switch(struct mmc_card *, u8, u8, u8, unsigned int);
@@ -107,6 +107,18 @@ struct mmc_host_ops {
 	 */
 	int (*enable)(struct mmc_host *host);
 	int (*disable)(struct mmc_host *host, int lazy);
+	/*
+	 * It is optional for the host to implement pre_req and post_req in
+	 * order to support double buffering of requests (prepare one
+	 * request while another request is active). pre_req() is called
+	 * before request(), possibly while the previous request is still
+	 * running; post_req() is called once the request has completed,
+	 * or with a non-zero 'err' if it was prepared but never started.
+	 */
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
@@ -143,8 +155,19 @@ struct mmc_host_ops {
 };
 
 struct mmc_card;
+struct mmc_lat_stats;
 struct device;
 
+struct mmc_async_req {
+	/* active mmc request */
+	struct mmc_request	*mrq;
+	/*
+	 * Check error status of completed mmc request.
+	 * Returns 0 if success otherwise non zero.
+	 */
+	int (*err_check) (struct mmc_card *, struct mmc_async_req *);
+};
+
 struct mmc_host {
 	struct device		*parent;
 	struct device		class_dev;
@@ -213,6 +236,10 @@ struct mmc_host {
 #define MMC_CAP_MAX_CURRENT_800	(1 << 29)	/* Host max current limit is 800mA */
 #define MMC_CAP_CMD23		(1 << 30)	/* CMD23 supported. */
 
+	u32			caps2;		/* More host capabilities */
+
+#define MMC_CAP2_PACKED_WR	(1 << 0)	/* Allow packed write */
+
 	mmc_pm_flag_t		pm_caps;	/* supported pm features */
 
 #ifdef CONFIG_MMC_CLKGATE
@@ -287,6 +314,9 @@ struct mmc_host {
 #endif
 
 	struct dentry		*debugfs_root;
+	struct mmc_lat_stats	*lat_stats;	/* request latency, debugfs */
+
+	struct mmc_async_req	*areq;		/* active async req */
 
 #ifdef CONFIG_MMC_EMBEDDED_SDIO
 #define MMC_QUIRK_VDD_165_195    (1<<0)/* from GB , do not ignore MMC_VDD_165_195 */
@@ -1350,6 +1350,9 @@ struct task_struct {
 	cputime_t gtime;
 #ifndef CONFIG_VIRT_CPU_ACCOUNTING
 	cputime_t prev_utime, prev_stime;
+#endif
+#ifdef CONFIG_CPU_FREQ_STAT_TASKS
+	cputime64_t *time_in_state;	/* per frequency, see cpufreq_stats */
 #endif
 	unsigned long nvcsw, nivcsw; /* context switch counts */
 	struct timespec start_time; 		/* monotonic time */
@@ -1573,6 +1576,10 @@ struct task_struct {
 #ifdef CONFIG_HAVE_HW_BREAKPOINT
 	atomic_t ptrace_bp_refcnt;
 #endif
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	/* lowmemorykiller oom_adj bucket, group leaders only */
+	struct list_head lowmem_node;
+#endif
 };
 
 /* Future-safe accessor for struct task_struct's cpus_allowed. */
@@ -2045,6 +2052,23 @@ extern int task_nice(const struct task_struct *p);
 extern int can_nice(const struct task_struct *p, const int nice);
 extern int task_curr(const struct task_struct *p);
 extern int idle_cpu(int cpu);
+
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+/*
+ * Runqueue utilisation updates for the scheduler driven cpufreq governor.
+ * The hook is called with the runqueue lock held and interrupts disabled,
+ * util is the recent fraction of time the runqueue was busy, scaled to
+ * SCHED_POWER_SCALE.
+ */
+#define SCHED_CPUFREQ_WAKEUP	(1U << 0)	/* task woke up */
+#define SCHED_CPUFREQ_TICK	(1U << 1)	/* scheduler tick */
+#define SCHED_CPUFREQ_RT	(1U << 2)	/* ... of an RT task */
+#define SCHED_CPUFREQ_IDLE	(1U << 3)	/* runqueue became empty */
+
+typedef void (*sched_cpufreq_hook_t)(int cpu, unsigned long util,
+				     unsigned int flags);
+extern void sched_cpufreq_set_hook(sched_cpufreq_hook_t hook);
+#endif
 extern int sched_setscheduler(struct task_struct *, int,
 			      const struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int,
@@ -0,0 +1,32 @@
+#ifndef __LINUX_VMPRESSURE_H
+#define __LINUX_VMPRESSURE_H
+
+#include <linux/gfp.h>
+#include <linux/notifier.h>
+
+/*
+ * Memory pressure levels, computed from the ratio of reclaimed to scanned
+ * pages. See Documentation/vm/vmpressure.txt.
+ */
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+#ifdef CONFIG_VMPRESSURE
+extern void vmpressure(gfp_t gfp, unsigned long scanned,
+		       unsigned long reclaimed);
+extern void vmpressure_prio(gfp_t gfp, int prio);
+
+/* Notifiers are called from process context with the level as 'val' */
+extern int vmpressure_register_notifier(struct notifier_block *nb);
+extern int vmpressure_unregister_notifier(struct notifier_block *nb);
+#else
+static inline void vmpressure(gfp_t gfp, unsigned long scanned,
+			      unsigned long reclaimed) { }
+static inline void vmpressure_prio(gfp_t gfp, int prio) { }
+#endif
+
+#endif /* __LINUX_VMPRESSURE_H */
@@ -0,0 +1,85 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dss
+
+#if !defined(_TRACE_DSS_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_DSS_H
+
+#include <linux/tracepoint.h>
+#include <video/omapdss.h>
+
+TRACE_EVENT(dsscomp_apply,
+
+	TP_PROTO(u32 sync_id, u32 mgr_ix, u32 num_ovls),
+
+	TP_ARGS(sync_id, mgr_ix, num_ovls),
+
+	TP_STRUCT__entry(
+		__field(u32,	sync_id)
+		__field(u32,	mgr_ix)
+		__field(u32,	num_ovls)
+	),
+
+	TP_fast_assign(
+		__entry->sync_id = sync_id;
+		__entry->mgr_ix = mgr_ix;
+		__entry->num_ovls = num_ovls;
+	),
+
+	TP_printk("sync_id=%u mgr=%u ovls=%u", __entry->sync_id,
+		  __entry->mgr_ix, __entry->num_ovls)
+);
+
+TRACE_EVENT(dispc_go,
+
+	TP_PROTO(int channel),
+
+	TP_ARGS(channel),
+
+	TP_STRUCT__entry(
+		__field(int,	channel)
+	),
+
+	TP_fast_assign(
+		__entry->channel = channel;
+	),
+
+	TP_printk("channel=%s",
+		  __print_symbolic(__entry->channel,
+				   { OMAP_DSS_CHANNEL_LCD,	"LCD" },
+				   { OMAP_DSS_CHANNEL_DIGIT,	"DIGIT" },
+				   { OMAP_DSS_CHANNEL_LCD2,	"LCD2" }))
+);
+
+#define DISPC_TRACE_IRQS	(DISPC_IRQ_FRAMEDONE | DISPC_IRQ_VSYNC | \
+				 DISPC_IRQ_EVSYNC_EVEN | DISPC_IRQ_EVSYNC_ODD | \
+				 DISPC_IRQ_VSYNC2 | DISPC_IRQ_FRAMEDONE2)
+
+/* only traced when one of DISPC_TRACE_IRQS is set */
+TRACE_EVENT(dispc_irq,
+
+	TP_PROTO(u32 irqstatus),
+
+	TP_ARGS(irqstatus),
+
+	TP_STRUCT__entry(
+		__field(u32,	irqstatus)
+	),
+
+	TP_fast_assign(
+		__entry->irqstatus = irqstatus;
+	),
+
+	TP_printk("status=%s",
+		  __print_flags(__entry->irqstatus & DISPC_TRACE_IRQS, "|",
+				{ DISPC_IRQ_FRAMEDONE,		"FRAMEDONE" },
+				{ DISPC_IRQ_VSYNC,		"VSYNC" },
+				{ DISPC_IRQ_EVSYNC_EVEN,	"EVSYNC_EVEN" },
+				{ DISPC_IRQ_EVSYNC_ODD,		"EVSYNC_ODD" },
+				{ DISPC_IRQ_VSYNC2,		"VSYNC2" },
+				{ DISPC_IRQ_FRAMEDONE2,		"FRAMEDONE2" }))
+);
+
+#endif /* _TRACE_DSS_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
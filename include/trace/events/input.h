@@ -0,0 +1,49 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM input
+
+#if !defined(_TRACE_INPUT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_INPUT_H
+
+#include <linux/input.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(input_dev_class,
+
+	TP_PROTO(struct input_dev *dev),
+
+	TP_ARGS(dev),
+
+	TP_STRUCT__entry(
+		__string(	name,	dev->name ? dev->name : "")
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev->name ? dev->name : "");
+	),
+
+	TP_printk("dev=%s", __get_str(name))
+);
+
+/*
+ * Hard interrupt of a touchscreen, the start of a touch to display
+ * latency measurement.
+ */
+DEFINE_EVENT(input_dev_class, input_touch_irq,
+
+	TP_PROTO(struct input_dev *dev),
+
+	TP_ARGS(dev)
+);
+
+/* SYN_REPORT passed to the handlers, the frame is visible to userspace */
+DEFINE_EVENT(input_dev_class, input_sync,
+
+	TP_PROTO(struct input_dev *dev),
+
+	TP_ARGS(dev)
+);
+
+#endif /* _TRACE_INPUT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,81 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mmc
+
+#if !defined(_TRACE_MMC_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_MMC_H
+
+#include <linux/mmc/core.h>
+#include <linux/mmc/host.h>
+#include <linux/ktime.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(mmc_request_start,
+
+	TP_PROTO(struct mmc_host *host, struct mmc_request *mrq),
+
+	TP_ARGS(host, mrq),
+
+	TP_STRUCT__entry(
+		__field(int,		host)
+		__field(u32,		opcode)
+		__field(u32,		arg)
+		__field(u32,		sbc_arg)
+		__field(unsigned int,	blocks)
+		__field(unsigned int,	blksz)
+		__field(unsigned int,	data_flags)
+	),
+
+	TP_fast_assign(
+		__entry->host = host->index;
+		__entry->opcode = mrq->cmd->opcode;
+		__entry->arg = mrq->cmd->arg;
+		__entry->sbc_arg = mrq->sbc ? mrq->sbc->arg : 0;
+		__entry->blocks = mrq->data ? mrq->data->blocks : 0;
+		__entry->blksz = mrq->data ? mrq->data->blksz : 0;
+		__entry->data_flags = mrq->data ? mrq->data->flags : 0;
+	),
+
+	TP_printk("mmc%d: CMD%u arg=%08x sbc_arg=%08x blocks=%u blksz=%u %s",
+		  __entry->host, __entry->opcode, __entry->arg,
+		  __entry->sbc_arg, __entry->blocks, __entry->blksz,
+		  __entry->data_flags & MMC_DATA_WRITE ? "W" :
+		  __entry->data_flags & MMC_DATA_READ ? "R" : "-")
+);
+
+TRACE_EVENT(mmc_request_done,
+
+	TP_PROTO(struct mmc_host *host, struct mmc_request *mrq),
+
+	TP_ARGS(host, mrq),
+
+	TP_STRUCT__entry(
+		__field(int,		host)
+		__field(u32,		opcode)
+		__field(int,		cmd_err)
+		__field(int,		data_err)
+		__field(int,		stop_err)
+		__field(unsigned int,	bytes)
+		__field(s64,		latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->host = host->index;
+		__entry->opcode = mrq->cmd->opcode;
+		__entry->cmd_err = mrq->cmd->error;
+		__entry->data_err = mrq->data ? mrq->data->error : 0;
+		__entry->stop_err = mrq->stop ? mrq->stop->error : 0;
+		__entry->bytes = mrq->data ? mrq->data->bytes_xfered : 0;
+		__entry->latency_us = ktime_us_delta(ktime_get(),
+						     mrq->io_start);
+	),
+
+	TP_printk("mmc%d: CMD%u err=%d/%d/%d bytes=%u latency=%lldus",
+		  __entry->host, __entry->opcode, __entry->cmd_err,
+		  __entry->data_err, __entry->stop_err, __entry->bytes,
+		  (long long)__entry->latency_us)
+);
+
+#endif /* _TRACE_MMC_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
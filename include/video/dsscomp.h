@@ -550,6 +550,25 @@ struct dsscomp_setup_dispc_data {
 	struct dss2_ovl_info ovls[5]; /* up to 5 overlays to set up */
 };
 
+/*
+ * ioctl: DSSCIOC_SETUP_DISPC_FENCE, struct dsscomp_setup_dispc_fence_data
+ *
+ * Same as DSSCIOC_SETUP_DISPC, but does not block.  The composition is
+ * queued and displayed once the acquire fences of all its overlays have
+ * signalled.  Use -1 for overlays whose buffer is ready.  The fences are
+ * not consumed, the caller still owns the file descriptors.
+ *
+ * Returns the fd of a release fence on success, or a negative value on
+ * failure.  The release fence signals when DSS no longer reads the buffers
+ * of the composition, or when the composition is dropped because one of
+ * its acquire fences failed or did not signal in time.  Returns -EBUSY if
+ * too many compositions are already waiting for their acquire fences.
+ */
+struct dsscomp_setup_dispc_fence_data {
+	struct dsscomp_setup_dispc_data dispc;
+	__s32 acquire_fence[5];	/* acquire fence fd for each overlay */
+};
+
 /*
  * ioctl: DSSCIOC_WB_COPY, struct dsscomp_wb_copy_data
  *
@@ -641,4 +660,6 @@ struct dsscomp_wait_data {
 
 #define DSSCIOC_SETUP_DISPC	_IOW('O', 133, struct dsscomp_setup_dispc_data)
 #define DSSCIOC_SETUP_DISPLAY	_IOW('O', 134, struct dsscomp_setup_display_data)
+#define DSSCIOC_SETUP_DISPC_FENCE \
+		_IOW('O', 135, struct dsscomp_setup_dispc_fence_data)
 #endif
@@ -15,6 +15,7 @@
 #include <linux/sched.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/cpuidle.h>
 
 #include <trace/events/irq.h>
 
@@ -125,6 +126,8 @@ handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action)
 	irqreturn_t retval = IRQ_NONE;
 	unsigned int flags = 0, irq = desc->irq_data.irq;
 
+	cpuidle_irq_record(irq, action->flags);
+
 	do {
 		irqreturn_t res;
 
@@ -72,6 +72,7 @@
 #include <linux/ftrace.h>
 #include <linux/slab.h>
 #include <linux/cpuacct.h>
+#include <linux/cpufreq.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -500,6 +501,12 @@ struct rq {
 	u64 clock;
 	u64 clock_task;
 
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+	/* busy fraction for cpufreq, see sched_cpufreq_account() */
+	unsigned long cpufreq_util;
+	u64 cpufreq_stamp;
+#endif
+
 	atomic_t nr_iowait;
 
 #ifdef CONFIG_SMP
@@ -1777,14 +1784,80 @@ static const struct sched_class rt_sched_class;
 
 #include "sched_stats.h"
 
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+/*
+ * Half-life of the busy fraction average, 2^22 ns is about half a tick at
+ * HZ=128: a CPU that turns fully busy crosses 90% within two ticks.
+ */
+#define SCHED_CPUFREQ_HALFLIFE_SHIFT	22
+
+static sched_cpufreq_hook_t __rcu sched_cpufreq_hook;
+
+/*
+ * Fold the time since the last update into rq->cpufreq_util: the runqueue
+ * counts as busy for that time if it had runnable tasks. Whole half-lives
+ * are applied exactly, the remainder linearly.
+ */
+static void sched_cpufreq_account(struct rq *rq)
+{
+	u64 delta = rq->clock - rq->cpufreq_stamp;
+	long target = rq->nr_running ? SCHED_POWER_SCALE : 0;
+	long util = rq->cpufreq_util;
+	long rem;
+
+	rq->cpufreq_stamp = rq->clock;
+
+	if ((delta >> SCHED_CPUFREQ_HALFLIFE_SHIFT) >= 10) {
+		rq->cpufreq_util = target;
+		return;
+	}
+
+	util = target - (target - util) /
+		(1L << (delta >> SCHED_CPUFREQ_HALFLIFE_SHIFT));
+	rem = (delta & ((1ULL << SCHED_CPUFREQ_HALFLIFE_SHIFT) - 1)) >> 10;
+	util += (target - util) * rem /
+		(1L << (SCHED_CPUFREQ_HALFLIFE_SHIFT - 9));
+
+	rq->cpufreq_util = util;
+}
+
+static inline void sched_cpufreq_update(struct rq *rq, unsigned int flags)
+{
+	sched_cpufreq_hook_t hook;
+
+	sched_cpufreq_account(rq);
+
+	hook = rcu_dereference_sched(sched_cpufreq_hook);
+	if (hook)
+		hook(cpu_of(rq), rq->cpufreq_util, flags);
+}
+
+/*
+ * Install or remove (hook == NULL) the governor hook. On return no CPU is
+ * running the previous hook anymore.
+ */
+void sched_cpufreq_set_hook(sched_cpufreq_hook_t hook)
+{
+	rcu_assign_pointer(sched_cpufreq_hook, hook);
+	synchronize_sched();
+}
+#else
+static inline void sched_cpufreq_account(struct rq *rq) { }
+static inline void sched_cpufreq_update(struct rq *rq, unsigned int flags) { }
+#endif
+
 static void inc_nr_running(struct rq *rq)
 {
+	sched_cpufreq_account(rq);
 	rq->nr_running++;
 }
 
 static void dec_nr_running(struct rq *rq)
 {
+	sched_cpufreq_account(rq);
 	rq->nr_running--;
+	if (!rq->nr_running)
+		sched_cpufreq_update(rq, SCHED_CPUFREQ_IDLE);
 }
 
 static void set_load_weight(struct task_struct *p)
@@ -3739,6 +3812,7 @@ void account_user_time(struct task_struct *p, cputime_t cputime,
 		cpustat->user = cputime64_add(cpustat->user, tmp);
 
 	cpuacct_update_stats(p, CPUACCT_STAT_USER, cputime);
+	cpufreq_task_stats_account(p, cputime);
 	/* Account for user time used */
 	acct_update_integrals(p);
 }
@@ -3794,6 +3868,7 @@ void __account_system_time(struct task_struct *p, cputime_t cputime,
 	/* Add system time to cpustat. */
 	*target_cputime64 = cputime64_add(*target_cputime64, tmp);
 	cpuacct_update_stats(p, CPUACCT_STAT_SYSTEM, cputime);
+	cpufreq_task_stats_account(p, cputime);
 
 	/* Account for system time used */
 	acct_update_integrals(p);
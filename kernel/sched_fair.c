@@ -1327,6 +1327,9 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	if (flags & ENQUEUE_WAKEUP)
+		sched_cpufreq_update(rq, SCHED_CPUFREQ_WAKEUP);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -4120,6 +4123,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	sched_cpufreq_update(rq, SCHED_CPUFREQ_TICK);
 }
 
 /*
@@ -942,8 +942,10 @@ enqueue_task_rt(struct rq *rq, struct task_struct *p, int flags)
 {
 	struct sched_rt_entity *rt_se = &p->rt;
 
-	if (flags & ENQUEUE_WAKEUP)
+	if (flags & ENQUEUE_WAKEUP) {
 		rt_se->timeout = 0;
+		sched_cpufreq_update(rq, SCHED_CPUFREQ_WAKEUP | SCHED_CPUFREQ_RT);
+	}
 
 	enqueue_rt_entity(rt_se, flags & ENQUEUE_HEAD);
 
@@ -1765,6 +1767,8 @@ static void task_tick_rt(struct rq *rq, struct task_struct *p, int queued)
 {
 	update_curr_rt(rq);
 
+	sched_cpufreq_update(rq, SCHED_CPUFREQ_TICK | SCHED_CPUFREQ_RT);
+
 	watchdog(rq, p);
 
 	/*
@@ -0,0 +1,132 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  LZ4 - Fast LZ compression algorithm
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ *  The block format is documented at:
+ *  http://code.google.com/p/lz4/
+ *
+ *  Changed for kernel use: single-pass greedy parser using a 4K entry
+ *  hash table of 32-bit input offsets kept in caller supplied 'wrkmem'.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (unsigned char)len;
+
+	return op;
+}
+
+static unsigned char *lz4_put_literals(unsigned char *op,
+		const unsigned char *anchor, size_t lit_len,
+		unsigned char **token)
+{
+	*token = op++;
+	if (lit_len >= LZ4_RUN_MASK) {
+		**token = LZ4_RUN_MASK << LZ4_ML_BITS;
+		op = lz4_put_length(op, lit_len - LZ4_RUN_MASK);
+	} else {
+		**token = lit_len << LZ4_ML_BITS;
+	}
+
+	memcpy(op, anchor, lit_len);
+	return op + lit_len;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - LZ4_MFLIMIT;
+	const unsigned char * const matchlimit = iend - LZ4_LASTLITERALS;
+	const unsigned char *ip = src, *anchor = src, *ref;
+	unsigned char *op = dst, *token;
+	u32 *table = wrkmem;
+	unsigned int misses;
+	size_t len;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+
+	if (src_len < LZ4_MFLIMIT + 1)
+		goto last_literals;
+
+	table[lz4_hash(get_unaligned((const u32 *)ip))] = 0;
+	ip++;
+	misses = 0;
+
+	while (ip < mflimit) {
+		u32 seq = get_unaligned((const u32 *)ip);
+		u32 h = lz4_hash(seq);
+
+		ref = src + table[h];
+		table[h] = ip - src;
+
+		if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE ||
+				get_unaligned((const u32 *)ref) != seq) {
+			ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+			continue;
+		}
+		misses = 0;
+
+		/* catch up: extend the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		op = lz4_put_literals(op, anchor, ip - anchor, &token);
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		ip += LZ4_MINMATCH;
+		ref += LZ4_MINMATCH;
+		anchor = ip;
+		while (ip < matchlimit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		len = ip - anchor;
+		if (len >= LZ4_ML_MASK) {
+			*token |= LZ4_ML_MASK;
+			op = lz4_put_length(op, len - LZ4_ML_MASK);
+		} else {
+			*token |= len;
+		}
+		anchor = ip;
+
+		/* keep the table warm for the position just behind us */
+		if (ip - 2 > src && ip < mflimit)
+			table[lz4_hash(get_unaligned((const u32 *)(ip - 2)))] =
+				ip - 2 - src;
+	}
+
+last_literals:
+	op = lz4_put_literals(op, anchor, iend - anchor, &token);
+	*dst_len = op - dst;
+
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
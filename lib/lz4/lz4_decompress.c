@@ -0,0 +1,113 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  LZ4 - Fast LZ compression algorithm
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ *  The block format is documented at:
+ *  http://code.google.com/p/lz4/
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline int lz4_get_length(const unsigned char **ip,
+		const unsigned char *iend, size_t *len)
+{
+	unsigned char s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return -1;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+
+	return 0;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char * const iend = src + src_len;
+	unsigned char *op = dst;
+	unsigned char * const oend = dst + *dst_len;
+	const unsigned char *ref;
+	unsigned int token;
+	size_t len, offset;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* literal run */
+		len = token >> LZ4_ML_BITS;
+		if (len == LZ4_RUN_MASK && lz4_get_length(&ip, iend, &len))
+			goto input_overrun;
+		if (unlikely(len > (size_t)(iend - ip)))
+			goto input_overrun;
+		if (unlikely(len > (size_t)(oend - op)))
+			goto output_overrun;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the block always ends with a literal run */
+		if (ip == iend)
+			break;
+
+		if (unlikely(iend - ip < 2))
+			goto input_overrun;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dst)))
+			goto lookbehind_overrun;
+
+		/* match */
+		len = token & LZ4_ML_MASK;
+		if (len == LZ4_ML_MASK && lz4_get_length(&ip, iend, &len))
+			goto input_overrun;
+		len += LZ4_MINMATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			goto output_overrun;
+
+		ref = op - offset;
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* overlapping copy replicates the last 'offset' bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+
+input_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_INPUT_OVERRUN;
+
+output_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_LOOKBEHIND_OVERRUN;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+
+#endif
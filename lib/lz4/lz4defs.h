@@ -0,0 +1,25 @@
+/*
+ *  lz4defs.h -- LZ4 block format constants shared by the compressor
+ *  and the decompressor
+ *
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ */
+
+#define LZ4_MINMATCH		4
+
+/* the last LZ4_LASTLITERALS bytes of a block are always literals */
+#define LZ4_LASTLITERALS	5
+
+/* a match may not start within the last LZ4_MFLIMIT bytes */
+#define LZ4_MFLIMIT		(8 + LZ4_MINMATCH)
+
+#define LZ4_MAX_DISTANCE	0xffff
+
+#define LZ4_ML_BITS		4
+#define LZ4_ML_MASK		((1U << LZ4_ML_BITS) - 1)
+#define LZ4_RUN_BITS		(8 - LZ4_ML_BITS)
+#define LZ4_RUN_MASK		((1U << LZ4_RUN_BITS) - 1)
+
+/* once this many probes miss in a row, start skipping input faster */
+#define LZ4_SKIP_TRIGGER	6
@@ -0,0 +1,355 @@
+/*
+ * Memory pressure notifications
+ *
+ * Reclaim reports how many pages it scanned and how many of those it
+ * managed to reclaim. Once a window of scanned pages has been collected,
+ * the reclaim efficiency is turned into a pressure level which is passed
+ * on to in-kernel notifiers and to userspace listeners of /dev/vmpressure.
+ *
+ * See Documentation/vm/vmpressure.txt for the userspace interface.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/eventfd.h>
+#include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/uaccess.h>
+#include <linux/vmpressure.h>
+#include <linux/workqueue.h>
+
+/*
+ * Pages to scan before a level is computed. Smaller windows react faster
+ * but are noisier; by default it is 512 pages (2MB with 4K pages).
+ */
+static unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+/* Pressure, in percent of scanned pages left unreclaimed, per level */
+static unsigned int vmpressure_level_med = 60;
+static unsigned int vmpressure_level_critical = 95;
+
+/*
+ * Reclaim reaching this priority, i.e. scanning 1/8 of the LRU or more in
+ * one go, is reported as critical regardless of the ratio.
+ */
+static int vmpressure_level_critical_prio = ilog2(100 / 10);
+
+/* Events generated per level */
+static unsigned int vmpressure_events[VMPRESSURE_NUM_LEVELS];
+
+static const char * const vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+/* A /dev/vmpressure file */
+struct vmpressure_listener {
+	struct list_head node;
+	enum vmpressure_levels level;	/* lowest level of interest */
+	int pending;			/* level to report, -1 if none */
+	struct eventfd_ctx *eventfd;
+};
+
+static BLOCKING_NOTIFIER_HEAD(vmpressure_notifier);
+
+static void vmpressure_work_fn(struct work_struct *work);
+
+static struct {
+	spinlock_t sr_lock;		/* protects scanned and reclaimed */
+	unsigned long scanned;
+	unsigned long reclaimed;
+	struct work_struct work;
+
+	spinlock_t listeners_lock;	/* protects listeners and pending */
+	struct list_head listeners;
+	wait_queue_head_t wait;
+} vmpr = {
+	.sr_lock = __SPIN_LOCK_UNLOCKED(vmpr.sr_lock),
+	.work = __WORK_INITIALIZER(vmpr.work, vmpressure_work_fn),
+	.listeners_lock = __SPIN_LOCK_UNLOCKED(vmpr.listeners_lock),
+	.listeners = LIST_HEAD_INIT(vmpr.listeners),
+	.wait = __WAIT_QUEUE_HEAD_INITIALIZER(vmpr.wait),
+};
+
+
+static enum vmpressure_levels vmpressure_calc_level(unsigned long scanned,
+						    unsigned long reclaimed)
+{
+	unsigned long pressure = 0;
+
+	/* Slab and other reclaim may free more than was scanned */
+	if (reclaimed < scanned)
+		pressure = 100 - reclaimed * 100 / scanned;
+
+	pr_debug("%s: %3lu (s: %lu r: %lu)\n", __func__, pressure,
+		 scanned, reclaimed);
+
+	if (pressure >= vmpressure_level_critical)
+		return VMPRESSURE_CRITICAL;
+	if (pressure >= vmpressure_level_med)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	struct vmpressure_listener *listener;
+	enum vmpressure_levels level;
+	unsigned long scanned, reclaimed;
+
+	spin_lock(&vmpr.sr_lock);
+	scanned = vmpr.scanned;
+	reclaimed = vmpr.reclaimed;
+	vmpr.scanned = 0;
+	vmpr.reclaimed = 0;
+	spin_unlock(&vmpr.sr_lock);
+
+	if (!scanned)
+		return;
+
+	level = vmpressure_calc_level(scanned, reclaimed);
+	vmpressure_events[level]++;
+
+	spin_lock(&vmpr.listeners_lock);
+	list_for_each_entry(listener, &vmpr.listeners, node) {
+		if (level < listener->level)
+			continue;
+		if ((int)level > listener->pending)
+			listener->pending = level;
+		if (listener->eventfd)
+			eventfd_signal(listener->eventfd, 1);
+	}
+	spin_unlock(&vmpr.listeners_lock);
+	wake_up_interruptible(&vmpr.wait);
+
+	blocking_notifier_call_chain(&vmpressure_notifier, level, NULL);
+}
+
+/**
+ * vmpressure() - account memory pressure through reclaim efficiency
+ * @gfp:	reclaimer's gfp mask
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from the reclaim paths for global reclaim. Cheap enough for
+ * every shrink_zone() call: the level is computed by a work item once
+ * vmpressure_win pages have been scanned.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	/*
+	 * Only reclaim on behalf of user and page cache allocations says
+	 * something about pressure userspace can relieve.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpr.sr_lock);
+	vmpr.scanned += scanned;
+	vmpr.reclaimed += reclaimed;
+	scanned = vmpr.scanned;
+	spin_unlock(&vmpr.sr_lock);
+
+	if (scanned < vmpressure_win)
+		return;
+	schedule_work(&vmpr.work);
+}
+
+/**
+ * vmpressure_prio() - account memory pressure through reclaim priority
+ * @gfp:	reclaimer's gfp mask
+ * @prio:	reclaimer's priority
+ *
+ * Reclaim that has to dig this deep is in trouble even if it still
+ * reclaims some pages, so report a full window of unreclaimed pages.
+ */
+void vmpressure_prio(gfp_t gfp, int prio)
+{
+	if (prio > vmpressure_level_critical_prio)
+		return;
+
+	vmpressure(gfp, vmpressure_win, 0);
+}
+
+int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_register_notifier);
+
+int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_unregister_notifier);
+
+static int vmpressure_open(struct inode *inode, struct file *file)
+{
+	struct vmpressure_listener *listener;
+
+	listener = kzalloc(sizeof(*listener), GFP_KERNEL);
+	if (!listener)
+		return -ENOMEM;
+
+	listener->level = VMPRESSURE_LOW;
+	listener->pending = -1;
+
+	spin_lock(&vmpr.listeners_lock);
+	list_add(&listener->node, &vmpr.listeners);
+	spin_unlock(&vmpr.listeners_lock);
+
+	file->private_data = listener;
+	return nonseekable_open(inode, file);
+}
+
+static int vmpressure_release(struct inode *inode, struct file *file)
+{
+	struct vmpressure_listener *listener = file->private_data;
+
+	spin_lock(&vmpr.listeners_lock);
+	list_del(&listener->node);
+	spin_unlock(&vmpr.listeners_lock);
+
+	if (listener->eventfd)
+		eventfd_ctx_put(listener->eventfd);
+	kfree(listener);
+	return 0;
+}
+
+/* Returns the pending level and clears it, -1 if there is none */
+static int vmpressure_take_pending(struct vmpressure_listener *listener)
+{
+	int level;
+
+	spin_lock(&vmpr.listeners_lock);
+	level = listener->pending;
+	listener->pending = -1;
+	spin_unlock(&vmpr.listeners_lock);
+
+	return level;
+}
+
+static ssize_t vmpressure_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *pos)
+{
+	struct vmpressure_listener *listener = file->private_data;
+	char level_buf[16];
+	int level, ret;
+	size_t len;
+
+	while ((level = vmpressure_take_pending(listener)) < 0) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(vmpr.wait,
+					       listener->pending >= 0);
+		if (ret)
+			return ret;
+	}
+
+	len = scnprintf(level_buf, sizeof(level_buf), "%s\n",
+			vmpressure_str_levels[level]);
+	if (count < len)
+		return -EINVAL;
+	if (copy_to_user(buf, level_buf, len))
+		return -EFAULT;
+	return len;
+}
+
+/*
+ * Writing "<level>" selects the lowest level reported to this file;
+ * "<level> <eventfd>" also signals the eventfd on each such event.
+ */
+static ssize_t vmpressure_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *pos)
+{
+	struct vmpressure_listener *listener = file->private_data;
+	struct eventfd_ctx *eventfd = NULL, *old;
+	char kbuf[32], *args, *name;
+	int level, efd;
+
+	if (count >= sizeof(kbuf))
+		return -EINVAL;
+	if (copy_from_user(kbuf, buf, count))
+		return -EFAULT;
+	kbuf[count] = '\0';
+
+	args = strim(kbuf);
+	name = strsep(&args, " ");
+	for (level = 0; level < VMPRESSURE_NUM_LEVELS; level++) {
+		if (!strcmp(name, vmpressure_str_levels[level]))
+			break;
+	}
+	if (level == VMPRESSURE_NUM_LEVELS)
+		return -EINVAL;
+
+	if (args) {
+		if (kstrtoint(skip_spaces(args), 10, &efd))
+			return -EINVAL;
+		eventfd = eventfd_ctx_fdget(efd);
+		if (IS_ERR(eventfd))
+			return PTR_ERR(eventfd);
+	}
+
+	spin_lock(&vmpr.listeners_lock);
+	listener->level = level;
+	old = listener->eventfd;
+	listener->eventfd = eventfd;
+	spin_unlock(&vmpr.listeners_lock);
+
+	if (old)
+		eventfd_ctx_put(old);
+	return count;
+}
+
+static unsigned int vmpressure_poll(struct file *file, poll_table *wait)
+{
+	struct vmpressure_listener *listener = file->private_data;
+
+	poll_wait(file, &vmpr.wait, wait);
+	if (listener->pending >= 0)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations vmpressure_fops = {
+	.owner = THIS_MODULE,
+	.open = vmpressure_open,
+	.release = vmpressure_release,
+	.read = vmpressure_read,
+	.write = vmpressure_write,
+	.poll = vmpressure_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice vmpressure_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "vmpressure",
+	.fops = &vmpressure_fops,
+};
+
+static int __init vmpressure_init(void)
+{
+	return misc_register(&vmpressure_misc);
+}
+module_init(vmpressure_init);
+
+module_param_named(window, vmpressure_win, ulong, S_IRUGO | S_IWUSR);
+module_param_named(level_medium, vmpressure_level_med, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(level_critical, vmpressure_level_critical, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(critical_prio, vmpressure_level_critical_prio, int,
+		   S_IRUGO | S_IWUSR);
+module_param_array_named(events, vmpressure_events, uint, NULL, S_IRUGO);
@@ -0,0 +1,599 @@
+/*
+ * binder_bench - binder transaction throughput and latency benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Forks N client/server process pairs. Each client issues synchronous
+ * transactions to its own server as fast as it can, so the pairs only
+ * share the binder driver itself. With a single global binder lock the
+ * pairs serialize against each other; with finer grained locking the
+ * throughput should scale with the number of CPUs.
+ *
+ * The benchmark process becomes the context manager to hand out server
+ * handles to the clients, so servicemanager must not be running:
+ *
+ *	stop; binder_bench -p 4 -n 20000 -s 256; start
+ *
+ * Build with "make" in this directory, CROSS_COMPILE=arm-linux-gnueabi-
+ * for the target.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV		"/dev/binder"
+#define BINDER_MAP_SIZE		(128 * 1024)
+#define MAX_PAIRS		64
+#define MAX_PAYLOAD		(32 * 1024)
+
+/* transaction codes understood by the broker */
+#define BROKER_REGISTER		1
+#define BROKER_LOOKUP		2
+
+/* transaction code used for the measured calls */
+#define BENCH_CALL		3
+
+struct binder_conn {
+	int fd;
+	void *map;
+};
+
+static int pairs = 1;
+static int iterations = 10000;
+static size_t payload = 128;
+static int verbose;
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "binder_bench: %s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void binder_open_conn(struct binder_conn *bc)
+{
+	struct binder_version vers;
+	size_t max_threads = 0;
+
+	bc->fd = open(BINDER_DEV, O_RDWR);
+	if (bc->fd < 0)
+		die("open " BINDER_DEV);
+	if (ioctl(bc->fd, BINDER_VERSION, &vers) < 0)
+		die("BINDER_VERSION");
+	if (vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder_bench: protocol version %ld, "
+			"expected %d\n", vers.protocol_version,
+			BINDER_CURRENT_PROTOCOL_VERSION);
+		exit(1);
+	}
+	if (ioctl(bc->fd, BINDER_SET_MAX_THREADS, &max_threads) < 0)
+		die("BINDER_SET_MAX_THREADS");
+	bc->map = mmap(NULL, BINDER_MAP_SIZE, PROT_READ, MAP_PRIVATE,
+		       bc->fd, 0);
+	if (bc->map == MAP_FAILED)
+		die("mmap");
+}
+
+static int binder_write_read(struct binder_conn *bc, void *wbuf, size_t wlen,
+			     void *rbuf, size_t rlen, size_t *consumed)
+{
+	struct binder_write_read bwr;
+	int ret;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_buffer = (unsigned long)wbuf;
+	bwr.write_size = wlen;
+	bwr.read_buffer = (unsigned long)rbuf;
+	bwr.read_size = rlen;
+
+	/* the driver updates write_consumed, so a retry resumes the write */
+	do {
+		ret = ioctl(bc->fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -1;
+
+	if (bwr.write_consumed < wlen) {
+		errno = EIO;
+		return -1;
+	}
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return 0;
+}
+
+static void binder_write(struct binder_conn *bc, void *wbuf, size_t wlen)
+{
+	if (binder_write_read(bc, wbuf, wlen, NULL, 0, NULL))
+		die("BINDER_WRITE_READ write");
+}
+
+struct cmd_buf {
+	uint8_t data[256 + 2 * sizeof(struct binder_transaction_data)];
+	size_t len;
+};
+
+static void cmd_put(struct cmd_buf *cb, uint32_t cmd, const void *arg,
+		    size_t size)
+{
+	memcpy(cb->data + cb->len, &cmd, sizeof(cmd));
+	cb->len += sizeof(cmd);
+	if (size) {
+		memcpy(cb->data + cb->len, arg, size);
+		cb->len += size;
+	}
+}
+
+static void cmd_free_buffer(struct cmd_buf *cb, const void *buffer)
+{
+	cmd_put(cb, BC_FREE_BUFFER, &buffer, sizeof(buffer));
+}
+
+/*
+ * Parse the read buffer. Reference count requests from the driver are
+ * acknowledged right away, BR_TRANSACTION and BR_REPLY are returned to
+ * the caller. Returns the command found, BR_NOOP if the buffer held
+ * nothing of interest.
+ */
+static uint32_t binder_parse(struct binder_conn *bc, uint8_t *rbuf,
+			     size_t len, struct binder_transaction_data *tr)
+{
+	uint8_t *ptr = rbuf, *end = rbuf + len;
+	uint32_t found = BR_NOOP;
+
+	while (ptr + sizeof(uint32_t) <= end) {
+		uint32_t cmd;
+		struct binder_ptr_cookie pc;
+		struct cmd_buf cb = { .len = 0 };
+
+		memcpy(&cmd, ptr, sizeof(cmd));
+		ptr += sizeof(cmd);
+
+		switch (cmd) {
+		case BR_NOOP:
+		case BR_TRANSACTION_COMPLETE:
+		case BR_SPAWN_LOOPER:
+			break;
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+			memcpy(&pc, ptr, sizeof(pc));
+			cmd_put(&cb, cmd == BR_INCREFS ? BC_INCREFS_DONE :
+				BC_ACQUIRE_DONE, &pc, sizeof(pc));
+			binder_write(bc, cb.data, cb.len);
+			break;
+		case BR_RELEASE:
+		case BR_DECREFS:
+			break;
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(tr, ptr, sizeof(*tr));
+			found = cmd;
+			break;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			fprintf(stderr, "binder_bench: transaction failed "
+				"(%s)\n", cmd == BR_DEAD_REPLY ? "dead reply" :
+				"failed reply");
+			exit(1);
+		default:
+			fprintf(stderr, "binder_bench: unexpected "
+				"command %08x\n", cmd);
+			exit(1);
+		}
+		ptr += _IOC_SIZE(cmd);
+	}
+	return found;
+}
+
+/* Write cb (if any) and read until a command of type 'want' arrives. */
+static void binder_wait_for(struct binder_conn *bc, struct cmd_buf *cb,
+			    uint32_t want, struct binder_transaction_data *tr)
+{
+	uint8_t rbuf[256];
+	size_t consumed;
+	void *wbuf = cb ? cb->data : NULL;
+	size_t wlen = cb ? cb->len : 0;
+
+	for (;;) {
+		if (binder_write_read(bc, wbuf, wlen, rbuf, sizeof(rbuf),
+				      &consumed))
+			die("BINDER_WRITE_READ");
+		wlen = 0;
+		if (binder_parse(bc, rbuf, consumed, tr) == want)
+			return;
+	}
+}
+
+static void binder_call(struct binder_conn *bc, struct cmd_buf *cb,
+			uint32_t handle, uint32_t code, const void *data,
+			size_t data_size, const size_t *offsets,
+			size_t offsets_size, struct binder_transaction_data *reply)
+{
+	struct binder_transaction_data tr;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.target.handle = handle;
+	tr.code = code;
+	tr.data_size = data_size;
+	tr.offsets_size = offsets_size;
+	tr.data.ptr.buffer = data;
+	tr.data.ptr.offsets = offsets;
+	cmd_put(cb, BC_TRANSACTION, &tr, sizeof(tr));
+
+	binder_wait_for(bc, cb, BR_REPLY, reply);
+}
+
+static void reply_put(struct cmd_buf *cb, const void *data, size_t data_size,
+		      const size_t *offsets, size_t offsets_size)
+{
+	struct binder_transaction_data tr;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.data_size = data_size;
+	tr.offsets_size = offsets_size;
+	tr.data.ptr.buffer = data;
+	tr.data.ptr.offsets = offsets;
+	cmd_put(cb, BC_REPLY, &tr, sizeof(tr));
+}
+
+static void enter_looper(struct binder_conn *bc)
+{
+	struct cmd_buf cb = { .len = 0 };
+
+	cmd_put(&cb, BC_ENTER_LOOPER, NULL, 0);
+	binder_write(bc, cb.data, cb.len);
+}
+
+/*
+ * Broker: context manager mapping pair index to server handle.
+ */
+static void *broker_thread(void *arg)
+{
+	struct binder_conn *bc = arg;
+	uint32_t handles[MAX_PAIRS];
+	struct binder_transaction_data tr;
+	struct cmd_buf cb = { .len = 0 };
+
+	memset(handles, 0, sizeof(handles));
+	enter_looper(bc);
+
+	for (;;) {
+		struct flat_binder_object obj;
+		size_t offset = 0;
+		int32_t status = -1;
+		int32_t index = -1;
+
+		binder_wait_for(bc, &cb, BR_TRANSACTION, &tr);
+		cb.len = 0;
+
+		if (tr.data_size >= sizeof(index))
+			memcpy(&index, tr.data.ptr.buffer, sizeof(index));
+		if (index < 0 || index >= MAX_PAIRS) {
+			cmd_free_buffer(&cb, tr.data.ptr.buffer);
+			reply_put(&cb, &status, sizeof(status), NULL, 0);
+			continue;
+		}
+
+		if (tr.code == BROKER_REGISTER &&
+		    tr.offsets_size == sizeof(size_t)) {
+			const struct flat_binder_object *fp;
+			size_t off;
+
+			memcpy(&off, tr.data.ptr.offsets, sizeof(off));
+			fp = (const void *)((const uint8_t *)tr.data.ptr.buffer +
+					    off);
+			handles[index] = fp->handle;
+			/* keep the ref once the buffer is freed */
+			cmd_put(&cb, BC_ACQUIRE, &handles[index],
+				sizeof(uint32_t));
+			cmd_free_buffer(&cb, tr.data.ptr.buffer);
+			status = 0;
+			reply_put(&cb, &status, sizeof(status), NULL, 0);
+		} else if (tr.code == BROKER_LOOKUP && handles[index]) {
+			cmd_free_buffer(&cb, tr.data.ptr.buffer);
+			memset(&obj, 0, sizeof(obj));
+			obj.type = BINDER_TYPE_HANDLE;
+			obj.handle = handles[index];
+			reply_put(&cb, &obj, sizeof(obj), &offset,
+				  sizeof(offset));
+		} else {
+			cmd_free_buffer(&cb, tr.data.ptr.buffer);
+			reply_put(&cb, &status, sizeof(status), NULL, 0);
+		}
+	}
+	return NULL;
+}
+
+static char reply_data[MAX_PAYLOAD];
+static int server_cookie;
+
+static void run_server(int index)
+{
+	struct binder_conn bc;
+	struct binder_transaction_data tr;
+	struct flat_binder_object obj;
+	struct cmd_buf cb = { .len = 0 };
+	size_t offset = sizeof(int32_t);
+	struct {
+		int32_t index;
+		struct flat_binder_object obj;
+	} __attribute__((packed)) reg;
+
+	binder_open_conn(&bc);
+
+	memset(&obj, 0, sizeof(obj));
+	obj.type = BINDER_TYPE_BINDER;
+	obj.flags = FLAT_BINDER_FLAG_ACCEPTS_FDS;
+	obj.binder = &server_cookie;
+	obj.cookie = &server_cookie;
+	reg.index = index;
+	reg.obj = obj;
+	binder_call(&bc, &cb, 0, BROKER_REGISTER, &reg, sizeof(reg),
+		    &offset, sizeof(offset), &tr);
+	cb.len = 0;
+	cmd_free_buffer(&cb, tr.data.ptr.buffer);
+
+	enter_looper(&bc);
+	for (;;) {
+		binder_wait_for(&bc, &cb, BR_TRANSACTION, &tr);
+		cb.len = 0;
+		cmd_free_buffer(&cb, tr.data.ptr.buffer);
+		reply_put(&cb, reply_data, payload, NULL, 0);
+	}
+}
+
+static uint32_t lookup_server(struct binder_conn *bc, int index)
+{
+	struct binder_transaction_data tr;
+	struct cmd_buf cb = { .len = 0 };
+	int32_t idx = index;
+	uint32_t handle = 0;
+	int tries;
+
+	for (tries = 0; tries < 5000 && !handle; tries++) {
+		binder_call(bc, &cb, 0, BROKER_LOOKUP, &idx, sizeof(idx),
+			    NULL, 0, &tr);
+		cb.len = 0;
+		if (tr.offsets_size == sizeof(size_t)) {
+			const struct flat_binder_object *fp =
+				tr.data.ptr.buffer;
+
+			handle = fp->handle;
+			cmd_put(&cb, BC_ACQUIRE, &handle, sizeof(handle));
+		} else {
+			usleep(1000);
+		}
+		cmd_free_buffer(&cb, tr.data.ptr.buffer);
+	}
+	if (!handle) {
+		fprintf(stderr, "binder_bench: server %d did not register\n",
+			index);
+		exit(1);
+	}
+	binder_write(bc, cb.data, cb.len);
+	return handle;
+}
+
+static char call_data[MAX_PAYLOAD];
+
+static void run_client(int index, int out_fd, int start_fd)
+{
+	struct binder_conn bc;
+	struct binder_transaction_data tr;
+	struct cmd_buf cb = { .len = 0 };
+	uint32_t *lat;
+	uint32_t handle;
+	uint64_t t0, t1, start, end;
+	size_t len;
+	char go;
+	int i;
+
+	lat = malloc(iterations * sizeof(*lat));
+	if (!lat)
+		die("malloc");
+
+	binder_open_conn(&bc);
+	handle = lookup_server(&bc, index);
+
+	/* all clients start together */
+	if (read(start_fd, &go, 1) != 1)
+		die("read start");
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		t0 = now_ns();
+		binder_call(&bc, &cb, handle, BENCH_CALL, call_data, payload,
+			    NULL, 0, &tr);
+		t1 = now_ns();
+		lat[i] = (t1 - t0) > UINT32_MAX ? UINT32_MAX : t1 - t0;
+		cb.len = 0;
+		cmd_free_buffer(&cb, tr.data.ptr.buffer);
+	}
+	binder_write(&bc, cb.data, cb.len);
+	end = now_ns();
+
+	if (write(out_fd, &end, sizeof(end)) != sizeof(end) ||
+	    write(out_fd, &start, sizeof(start)) != sizeof(start))
+		die("write result");
+	len = iterations * sizeof(*lat);
+	if (write(out_fd, lat, len) != (ssize_t)len)
+		die("write result");
+	exit(0);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+
+	while (len) {
+		ssize_t n = read(fd, p, len);
+
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: binder_bench [-p pairs] [-n iterations] "
+		"[-s payload bytes] [-v]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct binder_conn broker;
+	pthread_t broker_tid;
+	pid_t servers[MAX_PAIRS], clients[MAX_PAIRS];
+	int result_fds[MAX_PAIRS];
+	int start_pipe[2];
+	uint32_t *lat;
+	uint64_t first_start = UINT64_MAX, last_end = 0, sum = 0;
+	size_t total;
+	double secs;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "p:n:s:v")) != -1) {
+		switch (opt) {
+		case 'p':
+			pairs = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			payload = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (pairs < 1 || pairs > MAX_PAIRS || iterations < 1 ||
+	    payload > MAX_PAYLOAD)
+		usage();
+
+	binder_open_conn(&broker);
+	if (ioctl(broker.fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		die("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+	if (pthread_create(&broker_tid, NULL, broker_thread, &broker))
+		die("pthread_create");
+
+	if (pipe(start_pipe))
+		die("pipe");
+
+	for (i = 0; i < pairs; i++) {
+		int fds[2];
+
+		servers[i] = fork();
+		if (servers[i] < 0)
+			die("fork");
+		if (servers[i] == 0) {
+			close(broker.fd);
+			run_server(i);
+		}
+
+		if (pipe(fds))
+			die("pipe");
+		clients[i] = fork();
+		if (clients[i] < 0)
+			die("fork");
+		if (clients[i] == 0) {
+			close(broker.fd);
+			close(fds[0]);
+			close(start_pipe[1]);
+			run_client(i, fds[1], start_pipe[0]);
+		}
+		close(fds[1]);
+		result_fds[i] = fds[0];
+	}
+	close(start_pipe[0]);
+
+	/* give every client time to look up its server */
+	sleep(1);
+	for (i = 0; i < pairs; i++)
+		if (write(start_pipe[1], "g", 1) != 1)
+			die("write start");
+
+	total = (size_t)pairs * iterations;
+	lat = malloc(total * sizeof(*lat));
+	if (!lat)
+		die("malloc");
+
+	for (i = 0; i < pairs; i++) {
+		uint64_t start, end;
+		int status;
+
+		if (read_full(result_fds[i], &end, sizeof(end)) ||
+		    read_full(result_fds[i], &start, sizeof(start)) ||
+		    read_full(result_fds[i], lat + (size_t)i * iterations,
+			      iterations * sizeof(*lat))) {
+			fprintf(stderr, "binder_bench: client %d failed\n", i);
+			exit(1);
+		}
+		waitpid(clients[i], &status, 0);
+		if (start < first_start)
+			first_start = start;
+		if (end > last_end)
+			last_end = end;
+		if (verbose)
+			printf("pair %d: %.0f tx/s\n", i, iterations * 1e9 /
+			       (end - start));
+	}
+
+	for (i = 0; i < pairs; i++) {
+		kill(servers[i], SIGKILL);
+		waitpid(servers[i], NULL, 0);
+	}
+
+	for (i = 0; i < (int)total; i++)
+		sum += lat[i];
+	qsort(lat, total, sizeof(*lat), cmp_u32);
+	secs = (last_end - first_start) / 1e9;
+
+	printf("pairs %d, payload %zu bytes, %d transactions per pair\n",
+	       pairs, payload, iterations);
+	printf("throughput: %zu transactions in %.3f s, %.0f tx/s\n",
+	       total, secs, total / secs);
+	printf("latency (us): avg %.1f p50 %.1f p90 %.1f p99 %.1f "
+	       "max %.1f\n", sum / 1000.0 / total, lat[total / 2] / 1000.0,
+	       lat[total * 90 / 100] / 1000.0, lat[total * 99 / 100] / 1000.0,
+	       lat[total - 1] / 1000.0);
+	return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * cpufreq_bench - cpufreq governor response and idle wakeup benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Runs two tests for each governor given on the command line:
+ *
+ * - idle: sleeps for a while and reports how many times per second the
+ *   CPU left idle (sum of the cpuidle state usage counters) and how many
+ *   interrupts were taken. A sampling governor keeps waking the CPU to
+ *   look at its idle time, a scheduler driven one should not.
+ *
+ * - step: repeatedly lets the CPU settle at its idle speed, then starts
+ *   spinning and measures how long it takes until scaling_cur_freq reaches
+ *   the target frequency (policy max unless -f is given).
+ *
+ * The original governor is restored at exit. Run as root with the screen
+ * off and as little else running as possible:
+ *
+ *	cpufreq_bench -g interactive,sched -n 20 -i 10
+ *
+ * Build with "make" in this directory, CROSS_COMPILE=arm-linux-gnueabi-
+ * for the target.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CPUFREQ_DIR	"/sys/devices/system/cpu/cpu0/cpufreq/"
+#define CPUIDLE_DIR	"/sys/devices/system/cpu/cpu0/cpuidle/"
+#define MAX_GOVERNORS	8
+#define MAX_STEPS	1000
+
+/* give up on a step after this long, the governor may never get there */
+#define STEP_TIMEOUT_NS	(2000ULL * 1000000ULL)
+
+static char governors[256] = "interactive,smartass2,sched";
+static int steps = 10;
+static int idle_secs = 10;
+static unsigned long target_freq;
+static char saved_governor[64];
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "cpufreq_bench: %s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int read_str(const char *path, char *buf, size_t len)
+{
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return -1;
+	if (!fgets(buf, len, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static unsigned long read_ulong(const char *path)
+{
+	char buf[32];
+
+	if (read_str(path, buf, sizeof(buf)))
+		die(path);
+	return strtoul(buf, NULL, 0);
+}
+
+static int write_str(const char *path, const char *val)
+{
+	FILE *f = fopen(path, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fputs(val, f) < 0 ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static void restore_governor(void)
+{
+	if (saved_governor[0])
+		write_str(CPUFREQ_DIR "scaling_governor", saved_governor);
+}
+
+/* sum of the usage counters of all cpuidle states of cpu0 */
+static unsigned long long idle_entries(void)
+{
+	char path[128];
+	unsigned long long sum = 0;
+	int i;
+
+	for (i = 0; ; i++) {
+		char buf[32];
+
+		snprintf(path, sizeof(path), CPUIDLE_DIR "state%d/usage", i);
+		if (read_str(path, buf, sizeof(buf)))
+			break;
+		sum += strtoull(buf, NULL, 0);
+	}
+	return sum;
+}
+
+/* total from the "intr" line of /proc/stat */
+static unsigned long long interrupts(void)
+{
+	char line[256];
+	unsigned long long total = 0;
+	FILE *f = fopen("/proc/stat", "r");
+
+	if (!f)
+		die("/proc/stat");
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, "intr ", 5)) {
+			total = strtoull(line + 5, NULL, 0);
+			break;
+		}
+	}
+	fclose(f);
+	return total;
+}
+
+static void spin_until(uint64_t end)
+{
+	while (now_ns() < end)
+		;
+}
+
+static void run_idle(void)
+{
+	unsigned long long e0, e1, i0, i1;
+	uint64_t t0, t1;
+	double secs;
+
+	/* let the previous test wind down first */
+	sleep(1);
+
+	e0 = idle_entries();
+	i0 = interrupts();
+	t0 = now_ns();
+	sleep(idle_secs);
+	t1 = now_ns();
+	e1 = idle_entries();
+	i1 = interrupts();
+
+	secs = (t1 - t0) / 1e9;
+	printf("  idle: %.1f wakeups/s, %.1f irqs/s\n",
+	       (e1 - e0) / secs, (i1 - i0) / secs);
+}
+
+static void run_step(unsigned long want)
+{
+	uint64_t lat[MAX_STEPS];
+	uint64_t sum = 0, min = UINT64_MAX, max = 0;
+	int timeouts = 0, done = 0;
+	int i;
+
+	for (i = 0; i < steps; i++) {
+		uint64_t start, now;
+
+		sleep(1);
+
+		start = now_ns();
+		for (;;) {
+			now = now_ns();
+			if (read_ulong(CPUFREQ_DIR "scaling_cur_freq") >= want)
+				break;
+			if (now - start > STEP_TIMEOUT_NS) {
+				timeouts++;
+				break;
+			}
+			/* keep the CPU fully busy between the polls */
+			spin_until(now + 100000);
+		}
+		if (now - start > STEP_TIMEOUT_NS)
+			continue;
+
+		lat[done++] = now - start;
+	}
+
+	for (i = 0; i < done; i++) {
+		sum += lat[i];
+		if (lat[i] < min)
+			min = lat[i];
+		if (lat[i] > max)
+			max = lat[i];
+	}
+
+	if (done)
+		printf("  step to %lu kHz: min %.2f avg %.2f max %.2f ms",
+		       want, min / 1e6, sum / 1e6 / done, max / 1e6);
+	else
+		printf("  step to %lu kHz: never reached", want);
+	if (timeouts)
+		printf(" (%d/%d timed out)", timeouts, steps);
+	printf("\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: cpufreq_bench [-g governor,...] [-n steps] "
+		"[-i idle seconds] [-f target kHz]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	char *names[MAX_GOVERNORS];
+	char *tok, *save;
+	unsigned long want;
+	int ngov = 0, i, opt;
+
+	while ((opt = getopt(argc, argv, "g:n:i:f:")) != -1) {
+		switch (opt) {
+		case 'g':
+			snprintf(governors, sizeof(governors), "%s", optarg);
+			break;
+		case 'n':
+			steps = atoi(optarg);
+			break;
+		case 'i':
+			idle_secs = atoi(optarg);
+			break;
+		case 'f':
+			target_freq = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (steps < 1 || steps > MAX_STEPS || idle_secs < 1)
+		usage();
+
+	for (tok = strtok_r(governors, ",", &save);
+	     tok && ngov < MAX_GOVERNORS; tok = strtok_r(NULL, ",", &save))
+		names[ngov++] = tok;
+	if (!ngov)
+		usage();
+
+	if (read_str(CPUFREQ_DIR "scaling_governor", saved_governor,
+		     sizeof(saved_governor)))
+		die(CPUFREQ_DIR "scaling_governor");
+	atexit(restore_governor);
+
+	want = target_freq ? target_freq :
+		read_ulong(CPUFREQ_DIR "scaling_max_freq");
+
+	for (i = 0; i < ngov; i++) {
+		printf("%s:\n", names[i]);
+		if (write_str(CPUFREQ_DIR "scaling_governor", names[i])) {
+			printf("  not available\n");
+			continue;
+		}
+		run_idle();
+		run_step(want);
+	}
+
+	return 0;
+}
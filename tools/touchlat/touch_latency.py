@@ -0,0 +1,254 @@
+#!/usr/bin/env python
+#
+# touch_latency.py - touch to display latency breakdown from ftrace
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation.
+#
+# Follows every touch frame from the touchscreen interrupt to the display
+# interrupt that put the next composition on screen:
+#
+#   input:input_touch_irq	touch controller interrupt
+#   input:input_sync		frame handed to the input handlers
+#   dss:dsscomp_apply		next composition applied by dsscomp
+#   dss:dispc_go		GO bit set for the composition
+#   dss:dispc_irq		next VSYNC/FRAMEDONE, the frame is out
+#
+# and prints the time spent in the touch driver, in userspace (input_sync
+# to apply), in the DSS driver (apply to GO) and waiting for the display.
+# cpufreq_interactive:cpufreq_interactive_boost and power:cpu_frequency
+# are used to show how long after the touch the CPU was boosted.
+#
+# The kernel needs CONFIG_FTRACE and CONFIG_ENABLE_DEFAULT_TRACERS (for the
+# event tracer). On the target, as root:
+#
+#	touch_latency.py --enable
+#	(scroll around)
+#	cat /sys/kernel/debug/tracing/trace > trace.txt
+#	touch_latency.py --disable
+#
+# then on any host:
+#
+#	touch_latency.py [-v] [-d touch device] trace.txt
+
+from __future__ import print_function
+
+import getopt
+import re
+import sys
+
+TRACING = "/sys/kernel/debug/tracing/"
+
+EVENTS = [
+	"input/input_touch_irq",
+	"input/input_sync",
+	"dss/dsscomp_apply",
+	"dss/dispc_go",
+	"dss/dispc_irq",
+	"cpufreq_interactive/cpufreq_interactive_boost",
+	"power/cpu_frequency",
+]
+
+# give up on a touch frame if the display did not follow within this time
+MAX_FRAME_S = 0.5
+
+LINE_RE = re.compile(r"^\s*(.+?)-(\d+)\s+(?:\(\s*\S+\)\s+)?\[(\d+)\]\s+"
+		     r"(?:\S{4,5}\s+)?(\d+\.\d+):\s+(\w+):\s*(.*)$")
+ARG_RE = re.compile(r"(\w+)=(\S+)")
+
+STAGES = [
+	("driver", "irq to input_sync"),
+	("user", "input_sync to dsscomp apply"),
+	("dss", "apply to GO"),
+	("scanout", "GO to VSYNC/FRAMEDONE"),
+	("total", "touch irq to display"),
+]
+
+
+def usage():
+	print("usage: touch_latency.py [-v] [-d device] [trace file]\n"
+	      "       touch_latency.py --enable | --disable",
+	      file=sys.stderr)
+	sys.exit(2)
+
+
+def set_events(on):
+	val = "1" if on else "0"
+	for ev in EVENTS:
+		try:
+			with open(TRACING + "events/" + ev + "/enable", "w") as f:
+				f.write(val)
+		except IOError as e:
+			print("%s: %s" % (ev, e.strerror), file=sys.stderr)
+	if on:
+		with open(TRACING + "trace", "w") as f:
+			f.write("")
+	with open(TRACING + "tracing_on", "w") as f:
+		f.write(val)
+
+
+def parse(lines):
+	"""Yields (timestamp, event, args) for the events we know about."""
+	names = set(ev.split("/")[1] for ev in EVENTS)
+
+	for line in lines:
+		m = LINE_RE.match(line)
+		if not m or m.group(5) not in names:
+			continue
+		args = dict(ARG_RE.findall(m.group(6)))
+		yield float(m.group(4)), m.group(5), args
+
+
+class Frame(object):
+	def __init__(self, irq, dev):
+		self.irq = irq
+		self.dev = dev
+		self.sync = None
+		self.apply = None
+		self.go = None
+		self.out = None
+		self.boost = None
+		self.freq = None
+
+	def stages(self):
+		return {
+			"driver": self.sync - self.irq,
+			"user": self.apply - self.sync,
+			"dss": self.go - self.apply,
+			"scanout": self.out - self.go,
+			"total": self.out - self.irq,
+		}
+
+
+def reconstruct(events, device):
+	"""
+	Matches each touch interrupt to its input_sync, the first apply after
+	that, the first GO after the apply and the first display interrupt
+	after the GO. Several touch frames can end up on the same display
+	frame, each is reported with its own latency.
+	"""
+	done = []
+	open_frames = []
+
+	for ts, name, args in events:
+		if name == "input_touch_irq":
+			if device and args.get("dev") != device:
+				continue
+			open_frames.append(Frame(ts, args.get("dev")))
+		elif name == "input_sync":
+			for f in open_frames:
+				if f.sync is None and f.dev == args.get("dev"):
+					f.sync = ts
+					break
+		elif name == "dsscomp_apply":
+			for f in open_frames:
+				if f.sync is not None and f.apply is None:
+					f.apply = ts
+		elif name == "dispc_go":
+			for f in open_frames:
+				if f.apply is not None and f.go is None:
+					f.go = ts
+		elif name == "dispc_irq":
+			for f in open_frames:
+				if f.go is not None and f.out is None:
+					f.out = ts
+		elif name == "cpufreq_interactive_boost":
+			for f in open_frames:
+				if f.boost is None:
+					f.boost = ts
+		elif name == "cpu_frequency":
+			for f in open_frames:
+				if f.freq is None:
+					f.freq = ts
+
+		still_open = []
+		for f in open_frames:
+			if f.out is not None:
+				done.append(f)
+			elif ts - f.irq < MAX_FRAME_S:
+				still_open.append(f)
+		open_frames = still_open
+
+	return done
+
+
+def percentile(values, p):
+	values = sorted(values)
+	return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def report(frames, verbose):
+	if not frames:
+		print("no complete touch to display frame found")
+		return
+
+	if verbose:
+		print("%14s %8s %8s %8s %8s %8s %8s %8s" %
+		      ("irq", "driver", "user", "dss", "scanout", "total",
+		       "boost", "freq"))
+		for f in frames:
+			s = f.stages()
+			print("%14.6f %8.2f %8.2f %8.2f %8.2f %8.2f %8s %8s" %
+			      (f.irq, s["driver"] * 1e3, s["user"] * 1e3,
+			       s["dss"] * 1e3, s["scanout"] * 1e3,
+			       s["total"] * 1e3,
+			       "%.2f" % ((f.boost - f.irq) * 1e3)
+			       if f.boost is not None else "-",
+			       "%.2f" % ((f.freq - f.irq) * 1e3)
+			       if f.freq is not None else "-"))
+		print()
+
+	print("%d touch frames, latencies in ms" % len(frames))
+	print("%-8s %8s %8s %8s %8s  %s" %
+	      ("stage", "avg", "p50", "p90", "max", ""))
+	for key, desc in STAGES:
+		vals = [f.stages()[key] * 1e3 for f in frames]
+		print("%-8s %8.2f %8.2f %8.2f %8.2f  %s" %
+		      (key, sum(vals) / len(vals), percentile(vals, 50),
+		       percentile(vals, 90), max(vals), desc))
+
+	boosts = [(f.boost - f.irq) * 1e3 for f in frames
+		  if f.boost is not None]
+	if boosts:
+		print("%-8s %8.2f %8.2f %8.2f %8.2f  %s (%d frames)" %
+		      ("boost", sum(boosts) / len(boosts),
+		       percentile(boosts, 50), percentile(boosts, 90),
+		       max(boosts), "touch irq to cpufreq boost",
+		       len(boosts)))
+
+
+def main():
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "vd:h",
+					   ["enable", "disable"])
+	except getopt.GetoptError:
+		usage()
+
+	verbose = False
+	device = None
+	for o, a in opts:
+		if o == "--enable":
+			set_events(True)
+			return
+		elif o == "--disable":
+			set_events(False)
+			return
+		elif o == "-v":
+			verbose = True
+		elif o == "-d":
+			device = a
+		else:
+			usage()
+
+	if len(args) > 1:
+		usage()
+	f = open(args[0]) if args else open(TRACING + "trace")
+	frames = reconstruct(parse(f), device)
+	f.close()
+
+	report(frames, verbose)
+
+
+if __name__ == "__main__":
+	main()